@@ -0,0 +1,71 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "cube_state.h"
+#include "move_sequence.h"
+
+/*
+手順の情報を表示するコマンド
+手順を読んで一つの置換にまとめ、手数と、繰り返して元に戻るまでの回数 (位数) を表示する。
+一手ずつ回す場合とまとめた置換を施す場合の時間も比べる。
+使い方: ./alg_info [-n N] [-m モード] [-r 繰り返す回数] "手順"
+*/
+
+typedef std::chrono::steady_clock Clock;
+
+static double elapsedSeconds(const Clock::time_point &start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+int main(int argc, char **argv) {
+    int N = 3, mode = 0, reps = 10000;
+    std::string text;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            N = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            mode = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            reps = atoi(argv[++i]);
+        } else {
+            if (!text.empty()) text += " ";
+            text += argv[i];
+        }
+    }
+    if (N < 1 || reps < 1) {
+        fprintf(stderr, "usage: %s [-n N] [-m mode] [-r repetitions] \"moves\"\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<CubeMove> moves;
+    std::string error;
+    if (!parseMoves(text, N, &moves, &error)) {
+        fprintf(stderr, "Failed to parse moves: %s\n", error.c_str());
+        return 1;
+    }
+
+    Clock::time_point start = Clock::now();
+    const CompiledMoves compiled(N, mode, moves);
+    const double compileSeconds = elapsedSeconds(start);
+
+    printf("N = %d, %d slice moves\n", N, (int)moves.size());
+    printf("Order: %llu\n", (unsigned long long)compiled.order());
+
+    // 一手ずつ回した結果と、まとめた置換を施した結果を比べる
+    CubeState simulated(N, mode), gathered(N, mode);
+    start = Clock::now();
+    for (int k = 0; k < reps; k++) simulated.apply(moves);
+    const double simulateSeconds = elapsedSeconds(start);
+    start = Clock::now();
+    for (int k = 0; k < reps; k++) compiled.applyTo(&gathered);
+    const double gatherSeconds = elapsedSeconds(start);
+
+    printf("Compile: %.3f ms\n", compileSeconds * 1000.0);
+    printf("Apply x%d: %.3f ms by moves, %.3f ms compiled (%s)\n", reps, simulateSeconds * 1000.0, gatherSeconds * 1000.0,
+           simulated == gathered ? "same" : "DIFFERENT");
+    return simulated == gathered ? 0 : 1;
+}
@@ -0,0 +1,240 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cube_state.h"
+#include "cubie_cube.h"
+#include "move_sequence.h"
+#include "optimal_solver.h"
+#include "solution_cache.h"
+#include "two_phase.h"
+#include "work_stealing_pool.h"
+
+/*
+崩し手順をまとめて解くコマンド
+1行に1つの崩し手順 ("R U R' F2" など、記法はmove_sequence.hのparseMoves) を標準入力かファイルから読み、スレッドプールで並列に解いて、
+入力と同じ順番で1行に1つの解を標準出力に書く (読めない行や解けない行は "error: ..." を書く)。
+順番を揃えるために結果を貯めておくのは最大でwindow行分で、それ以上先の行は読まずに待つ。
+終わったら標準エラー出力にスレッドごとの稼働率と1秒あたりの解の数を表示する。
+使い方: ./batch_solve [-t スレッド数] [-w window] [-l 手数の上限] [-o] [-d データのディレクトリ] [-c キャッシュのファイル] [ファイル]
+-oを付けると最短手数のソルバ (パターンデータベース) を使う。
+-cを付けると解をファイルに覚えておき、対称性や逆で同じになる状態はソルバを使わずに答える。
+-oの時は、最短手数のソルバで覚えた解だけを使う (二段階法で覚えた解は、最短の解を求めて置き換える)。
+*/
+
+typedef std::chrono::steady_clock Clock;
+
+struct Options {
+    Options()
+        : threads(0)
+        , window(256)
+        , maxLength(-1)
+        , optimal(false)
+        , dataDirectory(defaultDataDirectory()) {
+    }
+
+    int threads;
+    int window;
+    int maxLength;
+    bool optimal;
+    std::string dataDirectory;
+    std::string cachePath;
+    std::string inputPath;
+};
+
+static bool parseOptions(int argc, char **argv, Options *options) {
+    for (int i = 1; i < argc; i++) {
+        const bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "-t") == 0 && hasValue) {
+            options->threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-w") == 0 && hasValue) {
+            options->window = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-l") == 0 && hasValue) {
+            options->maxLength = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-o") == 0) {
+            options->optimal = true;
+        } else if (strcmp(argv[i], "-d") == 0 && hasValue) {
+            options->dataDirectory = argv[++i];
+        } else if (strcmp(argv[i], "-c") == 0 && hasValue) {
+            options->cachePath = argv[++i];
+        } else if (argv[i][0] != '-' && options->inputPath.empty()) {
+            options->inputPath = argv[i];
+        } else {
+            return false;
+        }
+    }
+    if (options->maxLength < 0) options->maxLength = options->optimal ? 20 : TWO_PHASE_MAX_LENGTH;
+    return options->window > 0;
+}
+
+// 崩し手順を揃った3x3に施して (rotate()と同じCubeStateの回転操作)、その状態を解く (cacheがNULLでなければ先に引く)
+static std::string solveLine(const std::string &line, const Options &options, SolutionCache *cache) {
+    std::vector<CubeMove> scramble;
+    std::string error;
+    if (!parseMoves(line, 3, &scramble, &error)) return "error: " + error;
+
+    CubeState state(3, 0);
+    state.apply(scramble);
+
+    CubieCube cube;
+    std::vector<int> solution;
+    if (!cubieCubeFromState(state, &cube)) return "error: invalid state";
+    // -oなら二段階法で覚えた解は使わない (最短とは限らない)
+    if (cache != NULL && cache->lookup(cube, &solution, options.optimal) && (int)solution.size() <= options.maxLength) {
+        return faceTurnsToString(solution);
+    }
+    const bool ok = options.optimal ? solveOptimal(cube, options.maxLength, &solution) : solveTwoPhase(cube, options.maxLength, &solution);
+    if (!ok) return "error: no solution";
+    if (cache != NULL) cache->store(cube, solution, options.optimal);
+    return faceTurnsToString(solution);
+}
+
+/*
+ReorderBuffer
+順番の番号つきの結果を受け取り、入力と同じ順番で書き出す。
+受け取れるのは書き出し待ちの番号から window 個先までで、それより先の番号は reserve() で待たせる。
+*/
+class ReorderBuffer {
+public:
+    explicit ReorderBuffer(int window)
+        : slots(window)
+        , ready(window, false)
+        , nextWrite(0)
+        , total(-1) {
+    }
+
+    // 番号seqの結果を置ける場所が空くまで待つ
+    void reserve(long long seq) {
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [&]() { return seq - nextWrite < (long long)slots.size(); });
+    }
+
+    void put(long long seq, const std::string &result) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            slots[seq % slots.size()] = result;
+            ready[seq % slots.size()] = true;
+        }
+        condition.notify_all();
+    }
+
+    // 入力の行数が決まった
+    void finish(long long count) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            total = count;
+        }
+        condition.notify_all();
+    }
+
+    // 順番に書き出す (全て書き終わるまで戻らない)
+    void writeAll(FILE *fp) {
+        for (;;) {
+            std::string result;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                const size_t slot = nextWrite % slots.size();
+                condition.wait(lock, [&]() { return ready[slot] || nextWrite == total; });
+                if (!ready[slot]) break;
+                result.swap(slots[slot]);
+                ready[slot] = false;
+                nextWrite++;
+            }
+            condition.notify_all();
+            fprintf(fp, "%s\n", result.c_str());
+        }
+        fflush(fp);
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::vector<std::string> slots;
+    std::vector<bool> ready;
+    long long nextWrite;
+    long long total;
+};
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!parseOptions(argc, argv, &options)) {
+        fprintf(stderr, "usage: %s [-t threads] [-w window] [-l max length] [-o] [-d data directory] [-c cache file] [file]\n", argv[0]);
+        return 1;
+    }
+
+    std::ifstream file;
+    if (!options.inputPath.empty()) {
+        file.open(options.inputPath.c_str());
+        if (!file) {
+            fprintf(stderr, "Failed to open file: %s\n", options.inputPath.c_str());
+            return 1;
+        }
+    }
+    std::istream &input = options.inputPath.empty() ? std::cin : file;
+
+    // 表を作る時間は別に測る
+    Clock::time_point start = Clock::now();
+    if (options.optimal) {
+        if (!initOptimalSolver(options.dataDirectory, true)) {
+            fprintf(stderr, "Failed to open pattern databases in %s\n", options.dataDirectory.c_str());
+            return 1;
+        }
+    } else {
+        initTwoPhaseTables();
+    }
+    fprintf(stderr, "Tables: %.2f s\n", std::chrono::duration<double>(Clock::now() - start).count());
+
+    SolutionCache cache;
+    if (!options.cachePath.empty()) {
+        if (!cache.open(options.cachePath)) return 1;
+        fprintf(stderr, "Cache: %d solutions in %s\n", (int)cache.size(), options.cachePath.c_str());
+    }
+    SolutionCache *cachePtr = options.cachePath.empty() ? NULL : &cache;
+
+    start = Clock::now();
+    ReorderBuffer buffer(options.window);
+    std::thread writer([&]() { buffer.writeAll(stdout); });
+
+    std::vector<WorkStealingPool::ThreadStats> stats;
+    long long count = 0;
+    std::atomic<int> errors(0);
+    {
+        WorkStealingPool pool(options.threads);
+        std::string line;
+        while (std::getline(input, line)) {
+            const long long seq = count++;
+            buffer.reserve(seq);
+            pool.submit([&buffer, &options, &errors, cachePtr, seq, line]() {
+                const std::string result = solveLine(line, options, cachePtr);
+                if (result.compare(0, 6, "error:") == 0) errors++;
+                buffer.put(seq, result);
+            });
+        }
+        pool.wait();
+        stats = pool.stats();
+    }
+    buffer.finish(count);
+    writer.join();
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    for (size_t i = 0; i < stats.size(); i++) {
+        fprintf(stderr, "Thread %d: %llu solves (%llu stolen), busy %.2f s (%.1f%%)\n", (int)i, (unsigned long long)stats[i].tasks,
+                (unsigned long long)stats[i].steals, stats[i].busySeconds, seconds > 0 ? stats[i].busySeconds * 100.0 / seconds : 0.0);
+    }
+    fprintf(stderr, "Solved: %lld lines in %.3f s (%.1f solves/s, %d errors, %d threads, window %d)\n", count, seconds,
+            seconds > 0 ? count / seconds : 0.0, (int)errors, (int)stats.size(), options.window);
+    if (cachePtr != NULL) {
+        fprintf(stderr, "Cache: %d solutions, %llu hits, %llu misses\n", (int)cache.size(), (unsigned long long)cache.hits(),
+                (unsigned long long)cache.misses());
+    }
+    return errors == 0 ? 0 : 1;
+}
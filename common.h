@@ -1,8 +1,6 @@
 #ifndef _COMMON_H_
 #define _COMMON_H_
 
-static const char *SOURCE_DIRECTORY = "/Users/wajin/opengl/Mac_env/src/day5/cube/";
-static const char *SHADER_DIRECTORY = "/Users/wajin/opengl/Mac_env/src/day5/cube/shaders/";
-static const char *DATA_DIRECTORY = "/Users/wajin/opengl/Mac_env/src/day5/cube/data/";
+static const char *const SOURCE_DIRECTORY = "/Users/wajin/opengl/Mac_env/src/day5/cube/";
 
 #endif  // _COMMON_H_
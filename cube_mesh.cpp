@@ -0,0 +1,149 @@
+#include "cube_mesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// 箱の8つの角 (main.cppのpositionsと同じ並び)
+static const int cornerSigns[8][3] = {
+    { -1, -1, -1 },
+    {  1, -1, -1 },
+    { -1,  1, -1 },
+    { -1, -1,  1 },
+    {  1,  1, -1 },
+    { -1,  1,  1 },
+    {  1, -1,  1 },
+    {  1,  1,  1 }
+};
+
+// 面ごとの4つの角 (三角形は (0, 1, 2) と (0, 2, 3))
+static const int faceCorners[6][4] = {
+    { 1, 6, 7, 4 },  // R
+    { 2, 5, 7, 4 },  // U
+    { 3, 5, 7, 6 },  // F
+    { 0, 1, 4, 2 },  // B
+    { 0, 1, 6, 3 },  // D
+    { 0, 2, 5, 3 }   // L
+};
+
+// 面の法線の軸と向き
+static const int faceAxis[6] = { 0, 1, 2, 2, 1, 0 };
+static const int faceSign[6] = { 1, 1, 1, -1, -1, -1 };
+
+// floatを半精度浮動小数点数にする (最も近い値に丸める。小さすぎる値は0にする)
+static uint16_t floatToHalf(float f) {
+    uint32_t x;
+    memcpy(&x, &f, sizeof(x));
+    const uint32_t sign = (x >> 16) & 0x8000;
+    const int exponent = (int)((x >> 23) & 0xff) - 127 + 15;
+    const uint32_t mantissa = x & 0x7fffff;
+    if (exponent <= 0) return (uint16_t)sign;
+    if (exponent >= 31) return (uint16_t)(sign | 0x7c00);
+    uint32_t h = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+    if ((mantissa & 0x1000) != 0) h++;
+    return (uint16_t)h;
+}
+
+// 8bitの符号付き正規化
+static uint32_t snorm8(float v) {
+    const int q = (int)std::floor(std::max(-1.0f, std::min(1.0f, v)) * 127.0f + 0.5f);
+    return (uint32_t)(q & 0xff);
+}
+
+// 単位ベクトルのoctahedral表現 (八面体に射影して下半分を折り返す)
+static uint32_t packNormal(const float *n) {
+    const float l1 = std::fabs(n[0]) + std::fabs(n[1]) + std::fabs(n[2]);
+    float px = n[0] / l1, py = n[1] / l1;
+    if (n[2] < 0.0f) {
+        const float qx = (1.0f - std::fabs(py)) * (px >= 0.0f ? 1.0f : -1.0f);
+        const float qy = (1.0f - std::fabs(px)) * (py >= 0.0f ? 1.0f : -1.0f);
+        px = qx;
+        py = qy;
+    }
+    return snorm8(px) | (snorm8(py) << 8);
+}
+
+static uint32_t packColor(const float *c) {
+    uint32_t rgba = 0xff000000u;
+    for (int k = 0; k < 3; k++) {
+        const int q = (int)std::floor(std::max(0.0f, std::min(1.0f, c[k])) * 255.0f + 0.5f);
+        rgba |= (uint32_t)q << (8 * k);
+    }
+    return rgba;
+}
+
+/*
+1つのブロックの24頂点を追加する
+block: ブロックの各軸の位置 (-1, 0, 1)。mirrorならミラーブロックスのように、端の角を軸ごとに違う量だけ外に出す。
+*/
+static void appendGeometry(const int *block, bool mirror, CubeMesh *mesh, float *boxMin, float *boxMax, double *sum) {
+    static const float mirrorOffsets[3] = { 0.5f, 0.1f, 0.9f };
+    for (int k = 0; k < 3; k++) {
+        boxMin[k] = 1e30f;
+        boxMax[k] = -1e30f;
+    }
+
+    for (int f = 0; f < 6; f++) {
+        for (int j = 0; j < 4; j++) {
+            const int *s = cornerSigns[faceCorners[f][j]];
+            float position[3], normal[3];
+            const float length = std::sqrt(3.0f);
+            for (int k = 0; k < 3; k++) {
+                position[k] = (float)s[k];
+                if (mirror && s[k] == block[k]) position[k] += mirrorOffsets[k];
+                normal[k] = s[k] / length;
+                boxMin[k] = std::min(boxMin[k], position[k]);
+                boxMax[k] = std::max(boxMax[k], position[k]);
+                sum[k] += position[k];
+            }
+
+            PackedVertex v;
+            v.posXY = floatToHalf(position[0]) | ((uint32_t)floatToHalf(position[1]) << 16);
+            v.posZNormal = floatToHalf(position[2]) | (packNormal(normal) << 16);
+            mesh->vertices.push_back(v);
+        }
+    }
+}
+
+void buildCubeMesh(int N, int mode, const float *palette, CubeMesh *mesh) {
+    mesh->vertices.clear();
+    mesh->faceColors.clear();
+    mesh->indices.clear();
+    mesh->blockGeometry.clear();
+    mesh->blockMin.clear();
+    mesh->blockMax.clear();
+
+    for (int f = 0; f < 6; f++) {
+        static const int quad[6] = { 0, 1, 2, 0, 2, 3 };
+        for (int j = 0; j < 6; j++) mesh->indices.push_back((uint16_t)(4 * f + quad[j]));
+    }
+
+    // ミラーブロックスだけブロックごとに形が違う (N = 1は普通の箱)
+    const bool mirror = N > 1 && mode == 1;
+    const int numBlocks = N == 1 ? 1 : 27;
+    const float black[3] = { 0.0f, 0.0f, 0.0f };
+    mesh->blockMin.resize(numBlocks * 3);
+    mesh->blockMax.resize(numBlocks * 3);
+
+    double sum[3] = { 0.0, 0.0, 0.0 };
+    float geometryMin[3], geometryMax[3];
+    for (int b = 0; b < numBlocks; b++) {
+        // N = 1なら全ての面が外側
+        const int block[3] = { N == 1 ? 0 : b / 9 - 1, N == 1 ? 0 : b / 3 % 3 - 1, N == 1 ? 0 : b % 3 - 1 };
+        for (int f = 0; f < 6; f++) {
+            const bool outside = N == 1 || block[faceAxis[f]] == faceSign[f];
+            mesh->faceColors.push_back(packColor(outside ? palette + 3 * f : black));
+        }
+
+        // 形が共通なら全ブロックの重心は形0の重心と同じなので、形は1つだけ作る
+        if (mirror || b == 0) appendGeometry(block, mirror, mesh, geometryMin, geometryMax, sum);
+        mesh->blockGeometry.push_back(mirror ? b : 0);
+        for (int k = 0; k < 3; k++) {
+            mesh->blockMin[3 * b + k] = geometryMin[k];
+            mesh->blockMax[3 * b + k] = geometryMax[k];
+        }
+    }
+
+    const int geometries = (int)mesh->vertices.size() / MESH_BLOCK_VERTICES;
+    for (int k = 0; k < 3; k++) mesh->gravity[k] = (float)(sum[k] / (geometries * MESH_BLOCK_VERTICES));
+}
@@ -0,0 +1,48 @@
+#ifndef _CUBE_MESH_H_
+#define _CUBE_MESH_H_
+
+#include <cstdint>
+#include <vector>
+
+/*
+ブロックのメッシュ
+ブロックは面ごとに4頂点の24頂点で、全てのブロックで同じ36個の頂点番号 (MESH_INDICES) を使う。
+面fの頂点は 4f ~ 4f+3、頂点番号は 6f ~ 6f+5 番目で、面の番号はCubeStateと同じ (R, U, F, B, D, L)。
+*/
+static const int MESH_BLOCK_VERTICES = 24;
+static const int MESH_BLOCK_INDICES = 36;
+
+/*
+PackedVertex (8バイト、テクスチャバッファのRG32UIの1テクセル)
+posXY: 位置のx (下位16bit) とy (上位16bit) の半精度浮動小数点数
+posZNormal: 位置のzの半精度浮動小数点数 (下位16bit) と、法線のoctahedral表現 (8bitの符号付き正規化 x2、上位16bit)
+*/
+struct PackedVertex {
+    uint32_t posXY;
+    uint32_t posZNormal;
+};
+
+/*
+CubeMesh
+vertices: 形ごとの24頂点 (形の番号 * 24 + 頂点番号)
+faceColors: ブロックの種類ごとの6面の色 (RGBA8、ブロックの種類 * 6 + 面)。内側の面は黒。
+indices: 全てのブロックで共通の頂点番号
+blockGeometry: ブロックの種類 -> 形の番号 (普通のキューブとボイドキューブでは全て0、ミラーブロックスではブロックごとに違う)
+blockMin, blockMax: ブロックの種類ごとの頂点を囲む箱 (3つずつ)
+gravity: 全ブロックの頂点の重心
+ブロックの種類はN = 1なら0の1つ、それ以外は各軸の (負の端, 中, 正の端) を0, 1, 2として 9x + 3y + z の27通り。
+*/
+struct CubeMesh {
+    std::vector<PackedVertex> vertices;
+    std::vector<uint32_t> faceColors;
+    std::vector<uint16_t> indices;
+    std::vector<int> blockGeometry;
+    std::vector<float> blockMin;
+    std::vector<float> blockMax;
+    float gravity[3];
+};
+
+// palette: 面ごとの色 (RGB、0 ~ 1を6面分)
+void buildCubeMesh(int N, int mode, const float *palette, CubeMesh *mesh);
+
+#endif  // _CUBE_MESH_H_
@@ -0,0 +1,433 @@
+#include "cube_state.h"
+
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <utility>
+
+// 面の番号に対応する法線ベクトル
+static const int faceNormals[6][3] = {
+    {  1,  0,  0 },  // R
+    {  0,  1,  0 },  // U
+    {  0,  0,  1 },  // F
+    {  0,  0, -1 },  // B
+    {  0, -1,  0 },  // D
+    { -1,  0,  0 }   // L
+};
+
+static int faceFromNormal(const int *n) {
+    for (int f = 0; f < 6; f++) {
+        if (faceNormals[f][0] == n[0] && faceNormals[f][1] == n[1] && faceNormals[f][2] == n[2]) return f;
+    }
+    return -1;
+}
+
+/*
+RotationTables
+24通りの回転の行列と合成表。x, y, z軸周りの90度回転から生成する。
+*/
+struct RotationTables {
+    RotationTables();
+    int mat[24][9];
+    int compose[24][24];
+    int inverse[24];
+    int quarter[3][4];
+    int face[24][6];
+};
+
+static void multiply(const int *a, const int *b, int *out) {
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            out[i * 3 + j] = a[i * 3 + 0] * b[0 * 3 + j] + a[i * 3 + 1] * b[1 * 3 + j] + a[i * 3 + 2] * b[2 * 3 + j];
+        }
+    }
+}
+
+static bool sameMatrix(const int *a, const int *b) {
+    for (int i = 0; i < 9; i++) {
+        if (a[i] != b[i]) return false;
+    }
+    return true;
+}
+
+RotationTables::RotationTables() {
+    // 各軸周りに反時計回りに90度回す行列
+    static const int gen[3][9] = {
+        { 1, 0, 0,   0, 0, -1,   0, 1, 0 },
+        { 0, 0, 1,   0, 1, 0,   -1, 0, 0 },
+        { 0, -1, 0,  1, 0, 0,    0, 0, 1 }
+    };
+
+    int n = 1;
+    for (int i = 0; i < 9; i++) mat[0][i] = (i % 4 == 0) ? 1 : 0;
+
+    // 生成元を掛け続けて閉包を作る
+    for (int k = 0; k < n; k++) {
+        for (int a = 0; a < 3; a++) {
+            int m[9];
+            multiply(gen[a], mat[k], m);
+            bool found = false;
+            for (int j = 0; j < n; j++) {
+                if (sameMatrix(mat[j], m)) {
+                    found = true;
+                    break;
+                }
+            }
+            if (!found) {
+                for (int i = 0; i < 9; i++) mat[n][i] = m[i];
+                n++;
+            }
+        }
+    }
+
+    for (int a = 0; a < 24; a++) {
+        for (int b = 0; b < 24; b++) {
+            int m[9];
+            multiply(mat[a], mat[b], m);
+            for (int j = 0; j < 24; j++) {
+                if (sameMatrix(mat[j], m)) {
+                    compose[a][b] = j;
+                    break;
+                }
+            }
+        }
+    }
+
+    for (int a = 0; a < 24; a++) {
+        for (int b = 0; b < 24; b++) {
+            if (compose[a][b] == 0) inverse[a] = b;
+        }
+    }
+
+    for (int a = 0; a < 3; a++) {
+        quarter[a][0] = 0;
+        for (int t = 1; t < 4; t++) {
+            int m[9];
+            multiply(gen[a], mat[quarter[a][t - 1]], m);
+            for (int j = 0; j < 24; j++) {
+                if (sameMatrix(mat[j], m)) {
+                    quarter[a][t] = j;
+                    break;
+                }
+            }
+        }
+    }
+
+    for (int r = 0; r < 24; r++) {
+        for (int f = 0; f < 6; f++) {
+            int v[3];
+            for (int i = 0; i < 3; i++) {
+                v[i] = mat[r][i * 3 + 0] * faceNormals[f][0] + mat[r][i * 3 + 1] * faceNormals[f][1] + mat[r][i * 3 + 2] * faceNormals[f][2];
+            }
+            face[r][f] = faceFromNormal(v);
+        }
+    }
+}
+
+static const RotationTables &rotationTables() {
+    static const RotationTables tables;
+    return tables;
+}
+
+const int *rotationMatrix(int r) {
+    return rotationTables().mat[r];
+}
+
+int composeRotation(int a, int b) {
+    return rotationTables().compose[a][b];
+}
+
+int inverseRotation(int r) {
+    return rotationTables().inverse[r];
+}
+
+int quarterTurnRotation(int axis, int turns) {
+    return rotationTables().quarter[axis][turns & 3];
+}
+
+int rotateFace(int r, int face) {
+    return rotationTables().face[r][face];
+}
+
+// キューブの初期位置 (main.cppのcCubePositions等を整数にしたもの)
+static const int cCubeCoords[8][3] = {
+    { -1,  1, -1 },
+    {  1,  1, -1 },
+    {  1,  1,  1 },
+    { -1,  1,  1 },
+    { -1, -1, -1 },
+    {  1, -1, -1 },
+    {  1, -1,  1 },
+    { -1, -1,  1 }
+};
+
+static const int cubeEdgeCorners[12][2] = {
+    { 0, 4 }, { 1, 5 }, { 2, 6 }, { 3, 7 },
+    { 0, 1 }, { 1, 2 }, { 2, 3 }, { 3, 0 },
+    { 4, 5 }, { 5, 6 }, { 6, 7 }, { 7, 4 }
+};
+
+static const int eCubeCoords[12][3] = {
+    { -1,  0, -1 },
+    {  1,  0, -1 },
+    {  1,  0,  1 },
+    { -1,  0,  1 },
+    {  0,  1, -1 },
+    {  1,  1,  0 },
+    {  0,  1,  1 },
+    { -1,  1,  0 },
+    {  0, -1, -1 },
+    {  1, -1,  0 },
+    {  0, -1,  1 },
+    { -1, -1,  0 }
+};
+
+static const int cubeFaceEdges[6][4] = {
+    { 2, 10, 3, 6 },  // F
+    { 1, 9, 2, 5 },   // R
+    { 8, 9, 10, 11 }, // D
+    { 3, 11, 0, 7 },  // L
+    { 4, 5, 6, 7 },   // U
+    { 0, 8, 1, 4 }    // B
+};
+
+static const int fCubeCoords[6][3] = {
+    {  0,  0,  1 },  // F
+    {  1,  0,  0 },  // R
+    {  0, -1,  0 },  // D
+    { -1,  0,  0 },  // L
+    {  0,  1,  0 },  // U
+    {  0,  0, -1 }   // B
+};
+
+static void addCubie(CubeTopology *t, int type, int x, int y, int z) {
+    const int N = t->N;
+    t->homeCoord.push_back(x);
+    t->homeCoord.push_back(y);
+    t->homeCoord.push_back(z);
+    t->homePos.push_back((((x + N - 1) / 2) * N + (y + N - 1) / 2) * N + (z + N - 1) / 2);
+    t->cubeType.push_back(type);
+}
+
+static std::shared_ptr<const CubeTopology> buildTopology(int N, bool voidCube) {
+    std::shared_ptr<CubeTopology> t = std::make_shared<CubeTopology>();
+    t->N = N;
+    t->voidCube = voidCube;
+
+    // initCube()と同じ順番でキューブを並べる
+    if (N == 1) {
+        addCubie(t.get(), 1, 0, 0, 0);
+    } else {
+        for (int i = 0; i < 8; i++) {
+            addCubie(t.get(), 1, cCubeCoords[i][0] * (N - 1), cCubeCoords[i][1] * (N - 1), cCubeCoords[i][2] * (N - 1));
+        }
+
+        for (int i = 0; i < 12; i++) {
+            int dir[3];
+            for (int a = 0; a < 3; a++) {
+                dir[a] = (cCubeCoords[cubeEdgeCorners[i][0]][a] - cCubeCoords[cubeEdgeCorners[i][1]][a]) / 2;
+            }
+            for (int j = 0; j < N - 2; j++) {
+                int p[3];
+                for (int a = 0; a < 3; a++) p[a] = eCubeCoords[i][a] * (N - 1) + dir[a] * (2 * j - (N - 3));
+                addCubie(t.get(), 2, p[0], p[1], p[2]);
+            }
+        }
+
+        // ボイドキューブの場合はフェイスキューブは作成しない
+        if (!voidCube) {
+            for (int i = 0; i < 6; i++) {
+                int dir1[3], dir2[3];
+                for (int a = 0; a < 3; a++) {
+                    dir1[a] = (eCubeCoords[cubeFaceEdges[i][0]][a] - eCubeCoords[cubeFaceEdges[i][2]][a]) / 2;
+                    dir2[a] = (eCubeCoords[cubeFaceEdges[i][1]][a] - eCubeCoords[cubeFaceEdges[i][3]][a]) / 2;
+                }
+                for (int j = 0; j < N - 2; j++) {
+                    for (int k = 0; k < N - 2; k++) {
+                        int p[3];
+                        for (int a = 0; a < 3; a++) {
+                            p[a] = fCubeCoords[i][a] * (N - 1) + dir1[a] * (2 * j - (N - 3)) + dir2[a] * (2 * k - (N - 3));
+                        }
+                        addCubie(t.get(), 3, p[0], p[1], p[2]);
+                    }
+                }
+            }
+        }
+    }
+    t->numCubies = (int)t->cubeType.size();
+
+    std::vector<bool> occupied(N * N * N, false);
+    for (int i = 0; i < t->numCubies; i++) occupied[t->homePos[i]] = true;
+
+    // 回転面ごとに、+90度回転で入れ替わる4つ組を列挙する
+    const int *q[3] = { rotationMatrix(quarterTurnRotation(0, 1)),
+                        rotationMatrix(quarterTurnRotation(1, 1)),
+                        rotationMatrix(quarterTurnRotation(2, 1)) };
+    std::vector<bool> visited(N * N * N, false);
+    for (int axis = 0; axis < 3; axis++) {
+        for (int layer = 0; layer < N; layer++) {
+            std::vector<int> fixed;
+            t->sliceBegin.push_back((int)t->slicePos.size());
+            for (int u = 0; u < N; u++) {
+                for (int v = 0; v < N; v++) {
+                    int g[3];
+                    g[axis] = layer;
+                    g[(axis + 1) % 3] = u;
+                    g[(axis + 2) % 3] = v;
+                    int pos = (g[0] * N + g[1]) * N + g[2];
+                    if (!occupied[pos] || visited[pos]) continue;
+
+                    int c[3] = { 2 * g[0] - (N - 1), 2 * g[1] - (N - 1), 2 * g[2] - (N - 1) };
+                    int cycle[4];
+                    for (int k = 0; k < 4; k++) {
+                        cycle[k] = (((c[0] + N - 1) / 2) * N + (c[1] + N - 1) / 2) * N + (c[2] + N - 1) / 2;
+                        visited[cycle[k]] = true;
+                        int r[3];
+                        for (int i = 0; i < 3; i++) r[i] = q[axis][i * 3 + 0] * c[0] + q[axis][i * 3 + 1] * c[1] + q[axis][i * 3 + 2] * c[2];
+                        c[0] = r[0];
+                        c[1] = r[1];
+                        c[2] = r[2];
+                    }
+
+                    if (cycle[1] == cycle[0]) {
+                        fixed.push_back(cycle[0]);
+                    } else {
+                        for (int k = 0; k < 4; k++) t->slicePos.push_back(cycle[k]);
+                    }
+                }
+            }
+            t->sliceFixed.push_back((int)t->slicePos.size());
+            t->slicePos.insert(t->slicePos.end(), fixed.begin(), fixed.end());
+            t->sliceEnd.push_back((int)t->slicePos.size());
+
+            // 次の回転面のために訪問済みの印を消す
+            for (int k = t->sliceBegin.back(); k < t->sliceEnd.back(); k++) visited[t->slicePos[k]] = false;
+        }
+    }
+
+    return t;
+}
+
+std::shared_ptr<const CubeTopology> getCubeTopology(int N, int mode) {
+    static std::mutex mutex;
+    static std::map<std::pair<int, bool>, std::shared_ptr<const CubeTopology> > cache;
+
+    const bool voidCube = (mode == 2 && N > 1);
+    std::lock_guard<std::mutex> lock(mutex);
+    std::shared_ptr<const CubeTopology> &t = cache[std::make_pair(N, voidCube)];
+    if (!t) t = buildTopology(N, voidCube);
+    return t;
+}
+
+CubeState::CubeState(int N_, int mode_)
+    : N(N_)
+    , cubeMode(mode_)
+    , topo(getCubeTopology(N_, mode_)) {
+    reset();
+}
+
+void CubeState::reset() {
+    cubeAtPos.assign(N * N * N, -1);
+    cubePos = topo->homePos;
+    cubeOri.assign(topo->numCubies, 0);
+    for (int i = 0; i < topo->numCubies; i++) cubeAtPos[cubePos[i]] = i;
+}
+
+void CubeState::apply(const CubeMove &move) {
+    const int turns = move.turns & 3;
+    if (turns == 0) return;
+
+    const RotationTables &rt = rotationTables();
+    const int *rot = rt.compose[rt.quarter[move.axis][turns]];
+    const int s = move.axis * N + move.layer;
+    const int *p = &topo->slicePos[0];
+    const int fixed = topo->sliceFixed[s];
+
+    // 4つ組ごとの巡回置換 (ヒープの確保は無い)
+    for (int k = topo->sliceBegin[s]; k < fixed; k += 4) {
+        int c[4] = { cubeAtPos[p[k]], cubeAtPos[p[k + 1]], cubeAtPos[p[k + 2]], cubeAtPos[p[k + 3]] };
+        for (int i = 0; i < 4; i++) {
+            const int dst = p[k + ((i + turns) & 3)];
+            cubeAtPos[dst] = c[i];
+            cubePos[c[i]] = dst;
+            cubeOri[c[i]] = (uint8_t)rot[cubeOri[c[i]]];
+        }
+    }
+
+    // 回転軸上のキューブは向きだけが変わる
+    for (int k = fixed; k < topo->sliceEnd[s]; k++) {
+        const int c = cubeAtPos[p[k]];
+        cubeOri[c] = (uint8_t)rot[cubeOri[c]];
+    }
+}
+
+void CubeState::apply(const std::vector<CubeMove> &moves) {
+    for (size_t i = 0; i < moves.size(); i++) apply(moves[i]);
+}
+
+void CubeState::permute(const int *src, const uint8_t *rot) {
+    const RotationTables &rt = rotationTables();
+    const std::vector<int> old = cubeAtPos;
+    for (int q = 0; q < (int)old.size(); q++) {
+        const int c = old[src[q]];
+        cubeAtPos[q] = c;
+        if (c < 0) continue;
+        cubePos[c] = q;
+        cubeOri[c] = (uint8_t)rt.compose[rot[q]][cubeOri[c]];
+    }
+}
+
+void CubeState::posCoord(int pos, int *x, int *y, int *z) const {
+    *z = pos % N;
+    *y = (pos / N) % N;
+    *x = pos / (N * N);
+}
+
+int CubeState::sliceSize(int axis, int layer) const {
+    const int s = axis * N + layer;
+    return topo->sliceEnd[s] - topo->sliceBegin[s];
+}
+
+int CubeState::sliceCubie(int axis, int layer, int k) const {
+    return cubeAtPos[topo->slicePos[topo->sliceBegin[axis * N + layer] + k]];
+}
+
+int CubeState::stickerAt(int face, int x, int y, int z) const {
+    const int c = cubeAt(x, y, z);
+    if (c < 0) return -1;
+
+    // 面の法線をキューブの初期の向きに戻すと、そのステッカーの元の面 (= 色) が分かる
+    return rotateFace(inverseRotation(cubeOri[c]), face);
+}
+
+bool CubeState::isSolved() const {
+    for (int face = 0; face < 6; face++) {
+        const int axis = face == FACE_R || face == FACE_L ? 0 : face == FACE_U || face == FACE_D ? 1 : 2;
+        const int layer = face < 3 ? N - 1 : 0;
+        const int s = axis * N + layer;
+        int color = -1;
+        for (int k = topo->sliceBegin[s]; k < topo->sliceEnd[s]; k++) {
+            const int c = cubeAtPos[topo->slicePos[k]];
+            const int sticker = rotateFace(inverseRotation(cubeOri[c]), face);
+            if (color < 0) color = sticker;
+            if (sticker != color) return false;
+        }
+    }
+    return true;
+}
+
+uint64_t CubeState::hash() const {
+    // FNV-1aでキューブ番号と向きを順に混ぜ、最後にsplitmix64で散らす
+    uint64_t h = 0xcbf29ce484222325ULL ^ (uint64_t)N;
+    for (size_t pos = 0; pos < cubeAtPos.size(); pos++) {
+        const int c = cubeAtPos[pos];
+        if (c < 0) continue;
+        h = (h ^ (uint64_t)((uint32_t)c << 5 | cubeOri[c])) * 0x100000001b3ULL;
+    }
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return h;
+}
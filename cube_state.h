@@ -0,0 +1,148 @@
+#ifndef _CUBE_STATE_H_
+#define _CUBE_STATE_H_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/*
+キューブの面の番号
+main.cppのcolors[]の並びと同じで、面の番号がそのまま色の番号になる。
+反対側の面の番号は 5 - face で求まる。
+*/
+enum CubeFace {
+    FACE_R = 0,  // +x
+    FACE_U = 1,  // +y
+    FACE_F = 2,  // +z
+    FACE_B = 3,  // -z
+    FACE_D = 4,  // -y
+    FACE_L = 5   // -x
+};
+
+/*
+CubeMove
+一回の回転操作。
+axis: 回転軸 (0: x, 1: y, 2: z)
+layer: 回転させる層 (0 ~ N-1)。xCubePlanes[layer]等と同じ番号。
+turns: 軸の正の方向から見て反時計回りに90度回す回数 (1 ~ 3)。rotate()のrotateDir = trueが1、falseが3に相当する。
+*/
+struct CubeMove {
+    CubeMove()
+        : axis(0)
+        , layer(0)
+        , turns(1) {
+    }
+    CubeMove(int axis_, int layer_, int turns_)
+        : axis(axis_)
+        , layer(layer_)
+        , turns(turns_) {
+    }
+    bool operator==(const CubeMove &m) const { return axis == m.axis && layer == m.layer && turns == m.turns; }
+    bool operator!=(const CubeMove &m) const { return !(*this == m); }
+
+    int axis;
+    int layer;
+    int turns;
+};
+
+/*
+回転群
+キューブの向きは24通りの回転のいずれかで表す。0が恒等変換。
+rotationMatrix: 3x3の整数行列 (行優先、v' = M v)
+composeRotation(a, b): bを施した後にaを施す回転 (行列の積 a * b)
+quarterTurnRotation(axis, turns): 軸周りに反時計回りに90度 * turns回す回転
+*/
+const int *rotationMatrix(int r);
+int composeRotation(int a, int b);
+int inverseRotation(int r);
+int quarterTurnRotation(int axis, int turns);
+int rotateFace(int r, int face);
+
+/*
+CubeTopology
+同じNとモードのキューブで共有する不変な表。一度作ったら変更しないので、スレッド間で共有できる。
+homeCoord: 各キューブの初期位置 (中心を原点とし、隣のキューブとの間隔を2とした整数座標)
+cubeType: 1: コーナー、2: エッジ、3: フェイス (main.cppのCube::cubeTypeと同じ)
+slicePos: 各回転面に含まれる位置。+90度回転で p0 -> p1 -> p2 -> p3 と移る4つ組を並べ、最後に回転軸上の位置を並べる。
+sliceBegin / sliceFixed / sliceEnd: slicePosの中での回転面 (axis * N + layer) ごとの範囲
+*/
+struct CubeTopology {
+    int N;
+    bool voidCube;
+    int numCubies;
+    std::vector<int> homeCoord;
+    std::vector<int> homePos;
+    std::vector<int> cubeType;
+    std::vector<int> slicePos;
+    std::vector<int> sliceBegin;
+    std::vector<int> sliceFixed;
+    std::vector<int> sliceEnd;
+};
+
+// 同じ (N, ボイドかどうか) の表は一つだけ作って使い回す (スレッドセーフ)
+std::shared_ptr<const CubeTopology> getCubeTopology(int N, int mode);
+
+/*
+CubeState
+OpenGLやglmに依存しないキューブの状態。
+位置はN^3の格子の番号 ((x * N + y) * N + z) で表し、
+cubeAtPos: 位置 -> キューブ番号 (キューブの無い位置は-1)
+cubePos: キューブ番号 -> 位置
+cubeOri: キューブ番号 -> 向き (回転群の番号)
+を持つ。キューブ番号はmain.cppのinitCube()でCubesに追加される順番と同じ。
+*/
+class CubeState {
+public:
+    explicit CubeState(int N_ = 3, int mode_ = 0);
+
+    int size() const { return N; }
+    int mode() const { return cubeMode; }
+    int numCubies() const { return topo->numCubies; }
+    const CubeTopology &topology() const { return *topo; }
+
+    // 揃った状態に戻す
+    void reset();
+
+    // 回転操作を適用する
+    void apply(const CubeMove &move);
+    void apply(const std::vector<CubeMove> &moves);
+
+    // 位置qに位置src[q]のキューブを移し、その向きにrot[q]の回転を掛ける (全ての位置を一度に動かす)
+    void permute(const int *src, const uint8_t *rot);
+
+    // 位置の番号と格子座標の変換
+    int posIndex(int x, int y, int z) const { return (x * N + y) * N + z; }
+    void posCoord(int pos, int *x, int *y, int *z) const;
+
+    int cubeAt(int pos) const { return cubeAtPos[pos]; }
+    int cubeAt(int x, int y, int z) const { return cubeAtPos[posIndex(x, y, z)]; }
+    int position(int cubie) const { return cubePos[cubie]; }
+    int orientation(int cubie) const { return cubeOri[cubie]; }
+    int cubeType(int cubie) const { return topo->cubeType[cubie]; }
+
+    // 回転面に含まれるキューブ番号 (回転面はaxis * N + layerで指定し、kはsliceSize未満)
+    int sliceSize(int axis, int layer) const;
+    int sliceCubie(int axis, int layer, int k) const;
+
+    // 格子座標 (x, y, z) にあるキューブの、face面に見えているステッカーの色 (= 面の番号)
+    int stickerAt(int face, int x, int y, int z) const;
+
+    // 全ての面について、見えているステッカーの色が揃っているか
+    bool isSolved() const;
+
+    // 位置ごとのキューブ番号と向きから求める64bitのハッシュ (同じ状態なら同じ値)
+    uint64_t hash() const;
+
+    bool operator==(const CubeState &s) const { return N == s.N && cubeAtPos == s.cubeAtPos && cubeOri == s.cubeOri; }
+    bool operator!=(const CubeState &s) const { return !(*this == s); }
+
+private:
+    int N;
+    int cubeMode;
+    std::shared_ptr<const CubeTopology> topo;
+    std::vector<int> cubeAtPos;
+    std::vector<int> cubePos;
+    std::vector<uint8_t> cubeOri;
+};
+
+#endif  // _CUBE_STATE_H_
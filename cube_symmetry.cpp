@@ -0,0 +1,196 @@
+#include "cube_symmetry.h"
+
+#include "cube_state.h"
+
+/*
+鏡映を含む合成 (Kociembaの定義)
+角の向きが3以上のものは鏡映された角で、向きの足し算が引き算になる。
+*/
+static void symMultiply(const CubieCube &a, const CubieCube &b, CubieCube *out) {
+    for (int i = 0; i < 8; i++) {
+        const int oa = a.co[b.cp[i]], ob = b.co[i];
+        int o;
+        if (oa < 3 && ob < 3) {
+            o = (oa + ob) % 3;
+        } else if (oa < 3) {
+            o = oa + ob;
+            if (o >= 6) o -= 3;
+        } else if (ob < 3) {
+            o = oa - ob;
+            if (o < 3) o += 3;
+        } else {
+            o = oa - ob;
+            if (o < 0) o += 3;
+        }
+        out->cp[i] = a.cp[b.cp[i]];
+        out->co[i] = o;
+    }
+    for (int i = 0; i < 12; i++) {
+        out->ep[i] = a.ep[b.ep[i]];
+        out->eo[i] = (a.eo[b.ep[i]] + b.eo[i]) & 1;
+    }
+}
+
+static CubieCube symInverse(const CubieCube &a) {
+    CubieCube c;
+    for (int i = 0; i < 8; i++) c.cp[a.cp[i]] = i;
+    for (int i = 0; i < 8; i++) {
+        const int o = a.co[c.cp[i]];
+        c.co[i] = o >= 3 ? o : (3 - o) % 3;
+    }
+    for (int i = 0; i < 12; i++) c.ep[a.ep[i]] = i;
+    for (int i = 0; i < 12; i++) c.eo[i] = a.eo[c.ep[i]];
+    return c;
+}
+
+/*
+SymmetryTables
+x, y軸周りの持ち替えから24通りの回転を作り、左右の鏡映 (x -> -x) を掛けて48通りにする。
+*/
+struct SymmetryTables {
+    SymmetryTables();
+    CubieCube cubes[NUM_SYMMETRIES];
+    CubieCube inverses[NUM_SYMMETRIES];
+    int inverse[NUM_SYMMETRIES];
+    int turn[NUM_SYMMETRIES][NUM_FACE_TURNS];
+};
+
+SymmetryTables::SymmetryTables() {
+    int n = 1;
+    const CubieCube gen[2] = { wholeCubeRotation(0), wholeCubeRotation(1) };
+    for (int k = 0; k < n; k++) {
+        for (int g = 0; g < 2; g++) {
+            CubieCube c;
+            symMultiply(cubes[k], gen[g], &c);
+            bool found = false;
+            for (int j = 0; j < n && !found; j++) found = cubes[j] == c;
+            if (!found) cubes[n++] = c;
+        }
+    }
+
+    // 左右の鏡映: URF <-> UFL, UBR <-> ULB, ... 、UR <-> UL, ...
+    static const int mirrorCorners[8] = { UFL, URF, UBR, ULB, DLF, DFR, DRB, DBL };
+    static const int mirrorEdges[12] = { UL, UF, UR, UB, DL, DF, DR, DB, FL, FR, BR, BL };
+    CubieCube mirror;
+    for (int i = 0; i < 8; i++) {
+        mirror.cp[i] = mirrorCorners[i];
+        mirror.co[i] = 3;
+    }
+    for (int i = 0; i < 12; i++) mirror.ep[i] = mirrorEdges[i];
+    for (int k = 0; k < 24; k++) symMultiply(cubes[k], mirror, &cubes[24 + k]);
+
+    for (int s = 0; s < NUM_SYMMETRIES; s++) inverses[s] = symInverse(cubes[s]);
+    for (int s = 0; s < NUM_SYMMETRIES; s++) {
+        for (int j = 0; j < NUM_SYMMETRIES; j++) {
+            if (cubes[j] == inverses[s]) inverse[s] = j;
+        }
+    }
+
+    for (int s = 0; s < NUM_SYMMETRIES; s++) {
+        for (int t = 0; t < NUM_FACE_TURNS; t++) {
+            CubieCube a, b;
+            symMultiply(inverses[s], faceTurnCube(t), &a);
+            symMultiply(a, cubes[s], &b);
+            turn[s][t] = -1;
+            for (int u = 0; u < NUM_FACE_TURNS; u++) {
+                if (faceTurnCube(u) == b) turn[s][t] = u;
+            }
+        }
+    }
+}
+
+static const SymmetryTables &symmetryTables() {
+    static const SymmetryTables tables;
+    return tables;
+}
+
+int inverseSymmetry(int s) {
+    return symmetryTables().inverse[s];
+}
+
+CubieCube conjugateBySymmetry(const CubieCube &c, int s) {
+    const SymmetryTables &st = symmetryTables();
+    CubieCube a, b;
+    symMultiply(st.inverses[s], c, &a);
+    symMultiply(a, st.cubes[s], &b);
+    return b;
+}
+
+int conjugateTurn(int s, int turn) {
+    return symmetryTables().turn[s][turn];
+}
+
+bool cubieCubeLess(const CubieCube &a, const CubieCube &b) {
+    for (int i = 0; i < 8; i++) {
+        if (a.cp[i] != b.cp[i]) return a.cp[i] < b.cp[i];
+    }
+    for (int i = 0; i < 8; i++) {
+        if (a.co[i] != b.co[i]) return a.co[i] < b.co[i];
+    }
+    for (int i = 0; i < 12; i++) {
+        if (a.ep[i] != b.ep[i]) return a.ep[i] < b.ep[i];
+    }
+    for (int i = 0; i < 12; i++) {
+        if (a.eo[i] != b.eo[i]) return a.eo[i] < b.eo[i];
+    }
+    return false;
+}
+
+// splitmix64の最後の混ぜ合わせ
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+uint64_t cubieCubeHash(const CubieCube &c) {
+    // 角と辺をそれぞれ1語に詰めてから混ぜる (1要素4bit、向きは2bit)
+    uint64_t corners = 0, edges = 0;
+    for (int i = 0; i < 8; i++) corners = (corners << 6) | (uint64_t)(c.cp[i] << 2 | c.co[i]);
+    for (int i = 0; i < 12; i++) edges = (edges << 5) | (uint64_t)(c.ep[i] << 1 | c.eo[i]);
+    return mix64(corners ^ mix64(edges));
+}
+
+CanonicalCube canonicalize(const CubieCube &c, bool useInverse) {
+    CanonicalCube best;
+    best.cube = c;
+    const CubieCube inv = c.inverse();
+    for (int k = 0; k < (useInverse ? 2 : 1); k++) {
+        for (int s = 0; s < NUM_SYMMETRIES; s++) {
+            if (k == 0 && s == 0) continue;
+            const CubieCube x = conjugateBySymmetry(k == 0 ? c : inv, s);
+            if (cubieCubeLess(x, best.cube)) {
+                best.cube = x;
+                best.symmetry = s;
+                best.inverted = k == 1;
+            }
+        }
+    }
+    best.hash = cubieCubeHash(best.cube);
+    return best;
+}
+
+// 面の回転の列の逆 (逆順にして、回す向きを逆にする)
+static std::vector<int> inverseTurns(const std::vector<int> &turns) {
+    std::vector<int> inv;
+    for (int i = (int)turns.size() - 1; i >= 0; i--) inv.push_back(turns[i] - turns[i] % 3 + 2 - turns[i] % 3);
+    return inv;
+}
+
+std::vector<int> fromCanonicalSolution(const CanonicalCube &canonical, const std::vector<int> &solution) {
+    // cube * sol = 1 なら x * (S sol S^-1) = 1
+    const int back = inverseSymmetry(canonical.symmetry);
+    std::vector<int> turns;
+    for (size_t i = 0; i < solution.size(); i++) turns.push_back(conjugateTurn(back, solution[i]));
+    return canonical.inverted ? inverseTurns(turns) : turns;
+}
+
+std::vector<int> toCanonicalSolution(const CanonicalCube &canonical, const std::vector<int> &solution) {
+    const std::vector<int> x = canonical.inverted ? inverseTurns(solution) : solution;
+    std::vector<int> turns;
+    for (size_t i = 0; i < x.size(); i++) turns.push_back(conjugateTurn(canonical.symmetry, x[i]));
+    return turns;
+}
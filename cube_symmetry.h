@@ -0,0 +1,54 @@
+#ifndef _CUBE_SYMMETRY_H_
+#define _CUBE_SYMMETRY_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "cubie_cube.h"
+
+/*
+3x3の対称性
+キューブ全体の24通りの回転と、それぞれに左右の鏡映を組み合わせた48通り。0が恒等変換。
+対称性Sで見た状態は S^-1 * c * S。鏡映では角の向きを3 ~ 5で表す (Kociembaの定義)。
+*/
+static const int NUM_SYMMETRIES = 48;
+
+int inverseSymmetry(int s);
+
+// S^-1 * c * S
+CubieCube conjugateBySymmetry(const CubieCube &c, int s);
+
+// S^-1 * (面の回転turn) * S となる面の回転 (鏡映では向きが逆になる)
+int conjugateTurn(int s, int turn);
+
+// 状態の辞書順の比較 (cp, co, ep, eoの順)
+bool cubieCubeLess(const CubieCube &a, const CubieCube &b);
+
+// 角と辺の配列から求める64bitのハッシュ
+uint64_t cubieCubeHash(const CubieCube &c);
+
+/*
+CanonicalCube
+48通りの対称性 (useInverseなら逆の状態も) で見た状態のうち、辞書順で最小のもの。
+cube = S^-1 * x * S (xは元の状態、invertedなら元の状態の逆) で、Sがsymmetry。
+*/
+struct CanonicalCube {
+    CanonicalCube()
+        : symmetry(0)
+        , inverted(false)
+        , hash(0) {
+    }
+
+    CubieCube cube;
+    int symmetry;
+    bool inverted;
+    uint64_t hash;
+};
+
+CanonicalCube canonicalize(const CubieCube &c, bool useInverse);
+
+// 代表の状態の解を元の状態の解に直す (逆にtoCanonicalSolutionは元の状態の解を代表の解に直す)
+std::vector<int> fromCanonicalSolution(const CanonicalCube &canonical, const std::vector<int> &solution);
+std::vector<int> toCanonicalSolution(const CanonicalCube &canonical, const std::vector<int> &solution);
+
+#endif  // _CUBE_SYMMETRY_H_
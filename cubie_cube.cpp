@@ -0,0 +1,447 @@
+#include "cubie_cube.h"
+
+#include <cctype>
+
+// 各位置の角と辺が接する面 (最初がU, D面で、角は時計回りの順)
+static const int cornerFaces[8][3] = {
+    { FACE_U, FACE_R, FACE_F },  // URF
+    { FACE_U, FACE_F, FACE_L },  // UFL
+    { FACE_U, FACE_L, FACE_B },  // ULB
+    { FACE_U, FACE_B, FACE_R },  // UBR
+    { FACE_D, FACE_F, FACE_R },  // DFR
+    { FACE_D, FACE_L, FACE_F },  // DLF
+    { FACE_D, FACE_B, FACE_L },  // DBL
+    { FACE_D, FACE_R, FACE_B }   // DRB
+};
+
+static const int edgeFaces[12][2] = {
+    { FACE_U, FACE_R }, { FACE_U, FACE_F }, { FACE_U, FACE_L }, { FACE_U, FACE_B },
+    { FACE_D, FACE_R }, { FACE_D, FACE_F }, { FACE_D, FACE_L }, { FACE_D, FACE_B },
+    { FACE_F, FACE_R }, { FACE_F, FACE_L }, { FACE_B, FACE_L }, { FACE_B, FACE_R }
+};
+
+static const char *faceTurnFaces = "URFDLB";
+
+CubeMove faceTurnToCubeMove(int turn, int N) {
+    const int face = turn / 3;
+    const int power = turn % 3 + 1;
+
+    // U, R, Fは軸の正の側の層を時計回り (= 軸周りに-90度) に回す
+    switch (face) {
+        case TURN_U: return CubeMove(1, N - 1, 4 - power);
+        case TURN_R: return CubeMove(0, N - 1, 4 - power);
+        case TURN_F: return CubeMove(2, N - 1, 4 - power);
+        case TURN_D: return CubeMove(1, 0, power);
+        case TURN_L: return CubeMove(0, 0, power);
+        default:     return CubeMove(2, 0, power);
+    }
+}
+
+std::string faceTurnName(int turn) {
+    static const char *suffix[3] = { "", "2", "'" };
+    return std::string(1, faceTurnFaces[turn / 3]) + suffix[turn % 3];
+}
+
+std::string faceTurnsToString(const std::vector<int> &turns) {
+    std::string s;
+    for (size_t i = 0; i < turns.size(); i++) {
+        if (i > 0) s += " ";
+        s += faceTurnName(turns[i]);
+    }
+    return s;
+}
+
+bool parseFaceTurns(const std::string &text, std::vector<int> *turns) {
+    turns->clear();
+    size_t i = 0;
+    for (;;) {
+        while (i < text.size() && isspace((unsigned char)text[i])) i++;
+        if (i == text.size()) return true;
+
+        int face = 0;
+        while (face < 6 && faceTurnFaces[face] != text[i]) face++;
+        if (face == 6) return false;
+        i++;
+
+        // R, R2, R' (R2'はR2と同じ)
+        int power = 1;
+        if (i < text.size() && text[i] == '2') {
+            power = 2;
+            i++;
+        }
+        if (i < text.size() && text[i] == '\'') {
+            power = 4 - power;
+            i++;
+        }
+        if (i < text.size() && !isspace((unsigned char)text[i])) return false;
+        turns->push_back(face * 3 + power - 1);
+    }
+}
+
+CubieCube::CubieCube() {
+    for (int i = 0; i < 8; i++) {
+        cp[i] = i;
+        co[i] = 0;
+    }
+    for (int i = 0; i < 12; i++) {
+        ep[i] = i;
+        eo[i] = 0;
+    }
+}
+
+bool CubieCube::operator==(const CubieCube &c) const {
+    for (int i = 0; i < 8; i++) {
+        if (cp[i] != c.cp[i] || co[i] != c.co[i]) return false;
+    }
+    for (int i = 0; i < 12; i++) {
+        if (ep[i] != c.ep[i] || eo[i] != c.eo[i]) return false;
+    }
+    return true;
+}
+
+void CubieCube::cornerMultiply(const CubieCube &b) {
+    int p[8], o[8];
+    for (int i = 0; i < 8; i++) {
+        p[i] = cp[b.cp[i]];
+        o[i] = (co[b.cp[i]] + b.co[i]) % 3;
+    }
+    for (int i = 0; i < 8; i++) {
+        cp[i] = p[i];
+        co[i] = o[i];
+    }
+}
+
+void CubieCube::edgeMultiply(const CubieCube &b) {
+    int p[12], o[12];
+    for (int i = 0; i < 12; i++) {
+        p[i] = ep[b.ep[i]];
+        o[i] = (eo[b.ep[i]] + b.eo[i]) & 1;
+    }
+    for (int i = 0; i < 12; i++) {
+        ep[i] = p[i];
+        eo[i] = o[i];
+    }
+}
+
+void CubieCube::multiply(const CubieCube &b) {
+    cornerMultiply(b);
+    edgeMultiply(b);
+}
+
+CubieCube CubieCube::inverse() const {
+    CubieCube c;
+    for (int i = 0; i < 8; i++) {
+        c.cp[cp[i]] = i;
+    }
+    for (int i = 0; i < 8; i++) {
+        c.co[i] = (3 - co[c.cp[i]]) % 3;
+    }
+    for (int i = 0; i < 12; i++) {
+        c.ep[ep[i]] = i;
+    }
+    for (int i = 0; i < 12; i++) {
+        c.eo[i] = eo[c.ep[i]];
+    }
+    return c;
+}
+
+void CubieCube::move(int turn) {
+    multiply(faceTurnCube(turn));
+}
+
+static int permParity(const int *p, int n) {
+    int s = 0;
+    for (int i = 0; i < n; i++) {
+        for (int j = i + 1; j < n; j++) {
+            if (p[j] < p[i]) s++;
+        }
+    }
+    return s & 1;
+}
+
+int CubieCube::cornerParity() const {
+    return permParity(cp, 8);
+}
+
+int CubieCube::edgeParity() const {
+    return permParity(ep, 12);
+}
+
+bool CubieCube::isValid() const {
+    bool used[12] = { false };
+    int twistSum = 0, flipSum = 0;
+    for (int i = 0; i < 8; i++) {
+        if (cp[i] < 0 || cp[i] >= 8 || used[cp[i]] || co[i] < 0 || co[i] > 2) return false;
+        used[cp[i]] = true;
+        twistSum += co[i];
+    }
+    for (int i = 0; i < 12; i++) used[i] = false;
+    for (int i = 0; i < 12; i++) {
+        if (ep[i] < 0 || ep[i] >= 12 || used[ep[i]] || eo[i] < 0 || eo[i] > 1) return false;
+        used[ep[i]] = true;
+        flipSum += eo[i];
+    }
+    return twistSum % 3 == 0 && flipSum % 2 == 0 && cornerParity() == edgeParity();
+}
+
+// 二項係数
+static int binomial(int n, int k) {
+    if (k < 0 || n < k) return 0;
+    int r = 1;
+    for (int i = 0; i < k; i++) r = r * (n - i) / (i + 1);
+    return r;
+}
+
+// 置換の番号 (Lehmer code)
+static int permRank(const int *p, int n) {
+    int rank = 0;
+    for (int i = 0; i < n; i++) {
+        int s = 0;
+        for (int j = i + 1; j < n; j++) {
+            if (p[j] < p[i]) s++;
+        }
+        rank = rank * (n - i) + s;
+    }
+    return rank;
+}
+
+static void permUnrank(int rank, int *p, int n, int base) {
+    int digits[12];
+    for (int i = n - 1; i >= 0; i--) {
+        digits[i] = rank % (n - i);
+        rank /= (n - i);
+    }
+    bool used[12] = { false };
+    for (int i = 0; i < n; i++) {
+        int s = digits[i];
+        for (int v = 0; v < n; v++) {
+            if (used[v]) continue;
+            if (s == 0) {
+                used[v] = true;
+                p[i] = base + v;
+                break;
+            }
+            s--;
+        }
+    }
+}
+
+int CubieCube::twist() const {
+    int r = 0;
+    for (int i = URF; i < DRB; i++) r = 3 * r + co[i];
+    return r;
+}
+
+void CubieCube::setTwist(int twist) {
+    int parity = 0;
+    for (int i = DRB - 1; i >= URF; i--) {
+        co[i] = twist % 3;
+        parity += co[i];
+        twist /= 3;
+    }
+    co[DRB] = (3 - parity % 3) % 3;
+}
+
+int CubieCube::flip() const {
+    int r = 0;
+    for (int i = UR; i < BR; i++) r = 2 * r + eo[i];
+    return r;
+}
+
+void CubieCube::setFlip(int flip) {
+    int parity = 0;
+    for (int i = BR - 1; i >= UR; i--) {
+        eo[i] = flip & 1;
+        parity += eo[i];
+        flip >>= 1;
+    }
+    eo[BR] = parity & 1;
+}
+
+int CubieCube::slice() const {
+    int a = 0, x = 0;
+    for (int j = BR; j >= UR; j--) {
+        if (ep[j] >= FR) {
+            a += binomial(11 - j, x + 1);
+            x++;
+        }
+    }
+    return a;
+}
+
+void CubieCube::setSlice(int slice) {
+    bool inSlice[12] = { false };
+    for (int x = 4; x >= 1; x--) {
+        int k = x - 1;
+        while (binomial(k + 1, x) <= slice) k++;
+        slice -= binomial(k, x);
+        inSlice[11 - k] = true;
+    }
+    int s = FR, o = UR;
+    for (int j = 0; j < 12; j++) {
+        ep[j] = inSlice[j] ? s++ : o++;
+    }
+}
+
+int CubieCube::cornerPerm() const {
+    return permRank(cp, 8);
+}
+
+void CubieCube::setCornerPerm(int perm) {
+    permUnrank(perm, cp, 8, 0);
+}
+
+int CubieCube::udEdgePerm() const {
+    return permRank(ep, 8);
+}
+
+void CubieCube::setUDEdgePerm(int perm) {
+    permUnrank(perm, ep, 8, 0);
+}
+
+int CubieCube::slicePerm() const {
+    return permRank(ep + FR, 4);
+}
+
+void CubieCube::setSlicePerm(int perm) {
+    permUnrank(perm, ep + FR, 4, FR);
+}
+
+/*
+色 -> 面の対応 colorToFace を使って、格子座標の層 (0またはN-1、Nが奇数の場合は中央) から読み取る。
+*/
+static bool readCubies(const CubeState &state, const int *colorToFace, bool withEdges, CubieCube *cube) {
+    const int N = state.size();
+    const int mid = (N - 1) / 2;
+
+    for (int i = 0; i < 8; i++) {
+        int g[3] = { mid, mid, mid };
+        int col[3];
+        for (int k = 0; k < 3; k++) {
+            const int f = cornerFaces[i][k];
+            const int axis = f == FACE_R || f == FACE_L ? 0 : f == FACE_U || f == FACE_D ? 1 : 2;
+            g[axis] = f < 3 ? N - 1 : 0;
+        }
+        for (int k = 0; k < 3; k++) {
+            const int sticker = state.stickerAt(cornerFaces[i][k], g[0], g[1], g[2]);
+            if (sticker < 0) return false;
+            col[k] = colorToFace[sticker];
+        }
+
+        // U, D面の色が何番目にあるかが向き
+        int ori = 0;
+        while (ori < 3 && col[ori] != FACE_U && col[ori] != FACE_D) ori++;
+        if (ori == 3) return false;
+        cube->cp[i] = -1;
+        for (int j = 0; j < 8; j++) {
+            if (col[(ori + 1) % 3] == cornerFaces[j][1] && col[(ori + 2) % 3] == cornerFaces[j][2] && col[ori] == cornerFaces[j][0]) {
+                cube->cp[i] = j;
+                cube->co[i] = ori;
+                break;
+            }
+        }
+        if (cube->cp[i] < 0) return false;
+    }
+
+    for (int i = 0; i < 12; i++) {
+        cube->ep[i] = i;
+        cube->eo[i] = 0;
+    }
+    if (withEdges) {
+        for (int i = 0; i < 12; i++) {
+            int g[3] = { mid, mid, mid };
+            int col[2];
+            for (int k = 0; k < 2; k++) {
+                const int f = edgeFaces[i][k];
+                const int axis = f == FACE_R || f == FACE_L ? 0 : f == FACE_U || f == FACE_D ? 1 : 2;
+                g[axis] = f < 3 ? N - 1 : 0;
+            }
+            for (int k = 0; k < 2; k++) {
+                const int sticker = state.stickerAt(edgeFaces[i][k], g[0], g[1], g[2]);
+                if (sticker < 0) return false;
+                col[k] = colorToFace[sticker];
+            }
+            cube->ep[i] = -1;
+            for (int j = 0; j < 12; j++) {
+                if (col[0] == edgeFaces[j][0] && col[1] == edgeFaces[j][1]) {
+                    cube->ep[i] = j;
+                    cube->eo[i] = 0;
+                    break;
+                }
+                if (col[0] == edgeFaces[j][1] && col[1] == edgeFaces[j][0]) {
+                    cube->ep[i] = j;
+                    cube->eo[i] = 1;
+                    break;
+                }
+            }
+            if (cube->ep[i] < 0) return false;
+        }
+    } else if (cube->cornerParity() != 0) {
+        // 辺が無い場合は、角の置換の偶奇に合わせて辺を入れ替えておく
+        cube->ep[UR] = UF;
+        cube->ep[UF] = UR;
+    }
+
+    return cube->isValid();
+}
+
+bool cubieCubeFromState(const CubeState &state, CubieCube *cube) {
+    const int N = state.size();
+    if (N < 2) return false;
+
+    const bool withEdges = N % 2 == 1;
+    const int mid = (N - 1) / 2;
+    int colorToFace[6];
+
+    // センターがあればその色を基準にする
+    if (N % 2 == 1 && state.cubeAt(N - 1, mid, mid) >= 0) {
+        for (int f = 0; f < 6; f++) {
+            const int axis = f == FACE_R || f == FACE_L ? 0 : f == FACE_U || f == FACE_D ? 1 : 2;
+            int g[3] = { mid, mid, mid };
+            g[axis] = f < 3 ? N - 1 : 0;
+            colorToFace[state.stickerAt(f, g[0], g[1], g[2])] = f;
+        }
+        return readCubies(state, colorToFace, withEdges, cube);
+    }
+
+    // センターが無い場合は、揃えられる向きを探す
+    for (int r = 0; r < 24; r++) {
+        for (int c = 0; c < 6; c++) colorToFace[c] = rotateFace(r, c);
+        if (readCubies(state, colorToFace, withEdges, cube)) return true;
+    }
+    return false;
+}
+
+bool cubieCubeFromStateAsIs(const CubeState &state, CubieCube *cube) {
+    static const int identity[6] = { 0, 1, 2, 3, 4, 5 };
+    if (state.size() < 2) return false;
+    return readCubies(state, identity, state.size() % 2 == 1, cube);
+}
+
+CubieCube wholeCubeRotation(int axis) {
+    // 揃った3x3を回して、色を面に読み替えずにそのまま読み取る
+    CubeState state(3, 0);
+    for (int layer = 0; layer < 3; layer++) state.apply(CubeMove(axis, layer, 1));
+
+    static const int identity[6] = { 0, 1, 2, 3, 4, 5 };
+    CubieCube cube;
+    readCubies(state, identity, true, &cube);
+    return cube;
+}
+
+struct FaceTurnCubes {
+    FaceTurnCubes() {
+        // 揃った3x3のCubeStateを一回ずつ回して、その結果を基本の状態とする
+        for (int t = 0; t < NUM_FACE_TURNS; t++) {
+            CubeState state(3, 0);
+            state.apply(faceTurnToCubeMove(t, 3));
+            cubieCubeFromState(state, &cubes[t]);
+        }
+    }
+    CubieCube cubes[NUM_FACE_TURNS];
+};
+
+const CubieCube &faceTurnCube(int turn) {
+    static const FaceTurnCubes table;
+    return table.cubes[turn];
+}
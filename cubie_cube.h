@@ -0,0 +1,101 @@
+#ifndef _CUBIE_CUBE_H_
+#define _CUBIE_CUBE_H_
+
+#include <string>
+#include <vector>
+
+#include "cube_state.h"
+
+/*
+3x3の角と辺の番号 (Kociembaの定義に合わせる)
+角: URF, UFL, ULB, UBR, DFR, DLF, DBL, DRB
+辺: UR, UF, UL, UB, DR, DF, DL, DB, FR, FL, BL, BR
+*/
+enum { URF, UFL, ULB, UBR, DFR, DLF, DBL, DRB };
+enum { UR, UF, UL, UB, DR, DF, DL, DB, FR, FL, BL, BR };
+
+/*
+面の回転 (face turn)
+0 ~ 17の番号で、面 (U, R, F, D, L, B) * 3 + (回数 - 1) を表す。回数は時計回りに90度回す回数。
+*/
+static const int NUM_FACE_TURNS = 18;
+enum { TURN_U, TURN_R, TURN_F, TURN_D, TURN_L, TURN_B };
+
+// 面の回転をN x Nのキューブの一番外側の層の回転に変換する
+CubeMove faceTurnToCubeMove(int turn, int N);
+
+// 面の回転の表記 ("U", "R2", "F'" など)
+std::string faceTurnName(int turn);
+std::string faceTurnsToString(const std::vector<int> &turns);
+
+// 空白で区切った面の回転の表記 ("R U R' F2" など) を読む。読めない表記があればfalseを返す。
+bool parseFaceTurns(const std::string &text, std::vector<int> *turns);
+
+/*
+CubieCube
+3x3の角と辺の置換と向き。cp[i]は位置iにある角の番号、co[i]はその向き (0 ~ 2)。
+ep, eoは辺について同じ。(a * b)はaの後にbを施した状態になる。
+*/
+struct CubieCube {
+    CubieCube();
+
+    int cp[8];
+    int co[8];
+    int ep[12];
+    int eo[12];
+
+    bool operator==(const CubieCube &c) const;
+    bool operator!=(const CubieCube &c) const { return !(*this == c); }
+
+    // 合成 (this = this * b)
+    void cornerMultiply(const CubieCube &b);
+    void edgeMultiply(const CubieCube &b);
+    void multiply(const CubieCube &b);
+    CubieCube inverse() const;
+
+    // 面の回転を施す
+    void move(int turn);
+
+    // 揃えられる状態か (置換の偶奇と向きの和)
+    bool isValid() const;
+
+    // 座標
+    int twist() const;          // 角の向き 0 ~ 2186
+    int flip() const;           // 辺の向き 0 ~ 2047
+    int slice() const;          // UDスライスの辺の位置の組み合わせ 0 ~ 494
+    int cornerPerm() const;     // 角の置換 0 ~ 40319
+    int udEdgePerm() const;     // フェーズ2でのU, D面の辺の置換 0 ~ 40319
+    int slicePerm() const;      // フェーズ2でのUDスライスの辺の置換 0 ~ 23
+    void setTwist(int twist);
+    void setFlip(int flip);
+    void setSlice(int slice);
+    void setCornerPerm(int perm);
+    void setUDEdgePerm(int perm);
+    void setSlicePerm(int perm);
+
+    int cornerParity() const;
+    int edgeParity() const;
+};
+
+// 面の回転ごとの基本の状態 (CubeStateで回転させた結果から作る)
+const CubieCube &faceTurnCube(int turn);
+
+/*
+キューブ全体をaxis軸周りに+90度回す持ち替え
+状態cを持ち替えた向きから見た状態は wholeCubeRotation(axis).inverse() * c * wholeCubeRotation(axis) になる。
+(向きの和や置換の偶奇が合わないので、isValid()はfalseになる)
+*/
+CubieCube wholeCubeRotation(int axis);
+
+/*
+CubeStateから角と辺の状態を読み取る
+N >= 2の一番外側の角と、Nが奇数のときの辺の中央のキューブを使う (Nが偶数の場合は辺を揃った状態とみなす)。
+色は各面のセンターの色を基準に面へ読み替える。センターの無いキューブ (ボイドキューブ、偶数のN) では
+24通りの向きから揃えられるものを選ぶ。読み取れなければfalseを返す。
+*/
+bool cubieCubeFromState(const CubeState &state, CubieCube *cube);
+
+// 色をそのまま面として読み取る (揃ったときに各色が元の面に来る向きで読む)
+bool cubieCubeFromStateAsIs(const CubeState &state, CubieCube *cube);
+
+#endif  // _CUBIE_CUBE_H_
@@ -0,0 +1,85 @@
+#include "facelet_colors.h"
+
+#include <algorithm>
+
+// 面の法線の軸 (R, Lはx、U, Dはy、F, Bはz)
+static int faceAxis(int face) {
+    return face < 3 ? face : 5 - face;
+}
+
+const uint8_t FaceletColors::NO_STICKER;
+
+FaceletColors::FaceletColors()
+    : N(0) {
+    clearDirty();
+}
+
+void FaceletColors::reset(const CubeState &state) {
+    N = state.size();
+    values.assign(6 * N * N, NO_STICKER);
+    for (int face = 0; face < 6; face++) {
+        for (int i = 0; i < N; i++) {
+            for (int j = 0; j < N; j++) refresh(state, face, i, j);
+        }
+        begin[face] = face * N * N;
+        end[face] = (face + 1) * N * N;
+    }
+}
+
+void FaceletColors::update(const CubeState &state, const CubeMove &move) {
+    if (state.size() != N) {
+        reset(state);
+        return;
+    }
+
+    for (int face = 0; face < 6; face++) {
+        const int a = faceAxis(face);
+        if (a == move.axis) {
+            // 回した層が面そのものなら面の全体
+            if ((face < 3 ? N - 1 : 0) != move.layer) continue;
+            for (int i = 0; i < N; i++) {
+                for (int j = 0; j < N; j++) refresh(state, face, i, j);
+            }
+        } else if ((a + 1) % 3 == move.axis) {
+            for (int j = 0; j < N; j++) refresh(state, face, move.layer, j);
+        } else {
+            for (int i = 0; i < N; i++) refresh(state, face, i, move.layer);
+        }
+    }
+}
+
+bool FaceletColors::isDirty() const {
+    for (int face = 0; face < 6; face++) {
+        if (begin[face] < end[face]) return true;
+    }
+    return false;
+}
+
+void FaceletColors::clearDirty() {
+    for (int face = 0; face < 6; face++) {
+        begin[face] = 0;
+        end[face] = 0;
+    }
+}
+
+void FaceletColors::refresh(const CubeState &state, int face, int i, int j) {
+    const int a = faceAxis(face);
+    int coord[3];
+    coord[a] = face < 3 ? N - 1 : 0;
+    coord[(a + 1) % 3] = i;
+    coord[(a + 2) % 3] = j;
+
+    const int sticker = state.stickerAt(face, coord[0], coord[1], coord[2]);
+    const uint8_t value = sticker < 0 ? NO_STICKER : (uint8_t)sticker;
+    const int index = (face * N + i) * N + j;
+    if (values[index] == value) return;
+
+    values[index] = value;
+    if (begin[face] == end[face]) {
+        begin[face] = index;
+        end[face] = index + 1;
+    } else {
+        begin[face] = std::min(begin[face], index);
+        end[face] = std::max(end[face], index + 1);
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef _FACELET_COLORS_H_
+#define _FACELET_COLORS_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "cube_state.h"
+
+/*
+FaceletColors
+描画用の全ステッカーの色 (6N^2個)。ステッカーの番号は 面 * N^2 + i * N + j で、
+面fの軸をa (R, Lはx、U, Dはy、F, Bはz) とすると、ステッカー (i, j) のキューブの格子座標は
+a成分が面の向きに応じてN-1か0、(a+1)%3成分がi、(a+2)%3成分がj (shaders/sticker.vertと同じ並び)。
+値はステッカーの元の面 (= 色、0 ~ 5) で、キューブが無い所 (ボイドキューブの中心) はNO_STICKER。
+回転操作の後は、その回転面に含まれるステッカー (4N + N^2個まで) だけを計算し直し、
+変わったステッカーの範囲を面ごとに覚えておく (GPUへはその範囲だけを転送する)。
+*/
+class FaceletColors {
+public:
+    static const uint8_t NO_STICKER = 255;
+
+    FaceletColors();
+
+    // 全てのステッカーを計算し直す (全てが変わったことにする)
+    void reset(const CubeState &state);
+    // moveを施した後の状態から、回転面のステッカーだけを計算し直す
+    void update(const CubeState &state, const CubeMove &move);
+
+    int size() const { return (int)values.size(); }
+    const uint8_t *data() const { return values.data(); }
+
+    // 面ごとの変わった範囲 [dirtyBegin, dirtyEnd) (無ければ同じ値)
+    bool isDirty() const;
+    int dirtyBegin(int face) const { return begin[face]; }
+    int dirtyEnd(int face) const { return end[face]; }
+    void clearDirty();
+
+private:
+    void refresh(const CubeState &state, int face, int i, int j);
+
+    int N;
+    std::vector<uint8_t> values;
+    int begin[6];
+    int end[6];
+};
+
+#endif  // _FACELET_COLORS_H_
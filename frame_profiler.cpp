@@ -0,0 +1,227 @@
+#include "frame_profiler.h"
+
+#include <algorithm>
+#include <vector>
+
+static const char *phaseNames[NUM_FRAME_PHASES] = { "transforms", "upload", "draw", "animate", "swap", "events" };
+
+// 並べ替えてp分位の値を取る (無ければ-1)
+static double percentileOf(std::vector<double> &values, double p) {
+    if (values.empty()) return -1.0;
+    std::sort(values.begin(), values.end());
+    const int k = (int)(p / 100.0 * (values.size() - 1) + 0.5);
+    return values[std::max(0, std::min((int)values.size() - 1, k))];
+}
+
+FrameProfiler::Scope::Scope(FrameProfiler &profiler_, FramePhase phase)
+    : profiler(profiler_)
+    , previous(-2) {
+    if (!profiler.inFrame) return;
+    previous = profiler.current;
+    profiler.enter(phase);
+}
+
+FrameProfiler::Scope::~Scope() {
+    if (previous != -2 && profiler.inFrame) profiler.enter(previous);
+}
+
+FrameProfiler::FrameProfiler()
+    : enabled(false)
+    , csv(NULL)
+    , startTime(Clock::now())
+    , inFrame(false)
+    , current(-1)
+    , frameCount(0)
+    , nextQuery(0)
+    , inputWaiting(false)
+    , inputStart(0.0) {
+    for (int k = 0; k < GPU_QUERY_RING; k++) {
+        queries[k] = 0;
+        queryBusy[k] = false;
+    }
+}
+
+FrameProfiler::~FrameProfiler() {
+    closeCsv();
+}
+
+void FrameProfiler::setEnabled(bool enabled_) {
+    enabled = enabled_;
+    if (!enabled) inFrame = false;
+}
+
+bool FrameProfiler::openCsv(const std::string &path) {
+    closeCsv();
+    csv = fopen(path.c_str(), "w");
+    if (csv == NULL) {
+        fprintf(stderr, "Failed to open file: %s\n", path.c_str());
+        return false;
+    }
+
+    fprintf(csv, "frame,time_s");
+    for (int i = 0; i < NUM_FRAME_PHASES; i++) fprintf(csv, ",%s_ms", phaseNames[i]);
+    fprintf(csv, ",cpu_ms,gpu_ms,latency_ms\n");
+    return true;
+}
+
+void FrameProfiler::closeCsv() {
+    if (csv != NULL) fclose(csv);
+    csv = NULL;
+}
+
+void FrameProfiler::beginFrame() {
+    if (!enabled) return;
+
+    frameStart = Clock::now();
+    lastSwitch = frameStart;
+    current = -1;
+    inFrame = true;
+
+    frame.index = frameCount++;
+    frame.seconds = std::chrono::duration<double>(frameStart - startTime).count();
+    for (int i = 0; i < NUM_FRAME_PHASES; i++) frame.phaseMs[i] = 0.0;
+    frame.cpuMs = 0.0;
+    frame.gpuMs = -1.0;
+    frame.latencyMs = -1.0;
+    frame.query = -1;
+}
+
+void FrameProfiler::endFrame() {
+    if (!inFrame) return;
+
+    enter(-1);
+    frame.cpuMs = std::chrono::duration<double, std::milli>(lastSwitch - frameStart).count();
+    inFrame = false;
+
+    pending.push_back(frame);
+    resolve(false);
+}
+
+void FrameProfiler::beginGpu() {
+    if (!inFrame) return;
+
+    if (queries[0] == 0) glGenQueries(GPU_QUERY_RING, queries);
+    // 次のクエリがまだ結果を待っていれば、このフレームのGPUは測らない
+    if (queryBusy[nextQuery]) return;
+
+    frame.query = nextQuery;
+    queryBusy[nextQuery] = true;
+    nextQuery = (nextQuery + 1) % GPU_QUERY_RING;
+    glBeginQuery(GL_TIME_ELAPSED, queries[frame.query]);
+}
+
+void FrameProfiler::endGpu() {
+    if (inFrame && frame.query >= 0) glEndQuery(GL_TIME_ELAPSED);
+}
+
+void FrameProfiler::markInput(double time) {
+    if (!enabled || inputWaiting) return;
+    inputWaiting = true;
+    inputStart = time;
+}
+
+void FrameProfiler::inputShown(double time) {
+    if (!inputWaiting) return;
+    inputWaiting = false;
+
+    const double ms = (time - inputStart) * 1000.0;
+    if (inFrame) frame.latencyMs = ms;
+    latencies.push_back(ms);
+    if (latencies.size() > HISTORY_FRAMES) latencies.pop_front();
+}
+
+double FrameProfiler::percentile(int phase, double p) const {
+    std::vector<double> values;
+    for (size_t i = 0; i < history.size(); i++) {
+        values.push_back(phase < NUM_FRAME_PHASES ? history[i].phaseMs[phase] : history[i].cpuMs);
+    }
+    return percentileOf(values, p);
+}
+
+double FrameProfiler::gpuPercentile(double p) const {
+    std::vector<double> values;
+    for (size_t i = 0; i < history.size(); i++) {
+        if (history[i].gpuMs >= 0.0) values.push_back(history[i].gpuMs);
+    }
+    return percentileOf(values, p);
+}
+
+double FrameProfiler::latencyPercentile(double p) const {
+    std::vector<double> values(latencies.begin(), latencies.end());
+    return percentileOf(values, p);
+}
+
+std::string FrameProfiler::summary() const {
+    char text[512];
+    int length = snprintf(text, sizeof(text), "cpu %.1f/%.1f ms, gpu %.1f/%.1f ms |", percentile(NUM_FRAME_PHASES, 50.0),
+                          percentile(NUM_FRAME_PHASES, 95.0), gpuPercentile(50.0), gpuPercentile(95.0));
+    for (int i = 0; i < NUM_FRAME_PHASES && length < (int)sizeof(text); i++) {
+        length += snprintf(text + length, sizeof(text) - length, " %s %.2f", phaseNames[i], percentile(i, 50.0));
+    }
+    if (!latencies.empty() && length < (int)sizeof(text)) {
+        snprintf(text + length, sizeof(text) - length, " | input %.0f/%.0f ms", latencyPercentile(50.0), latencyPercentile(95.0));
+    }
+    return text;
+}
+
+void FrameProfiler::flush() {
+    resolve(true);
+}
+
+void FrameProfiler::reset() {
+    flush();
+    history.clear();
+    latencies.clear();
+    inputWaiting = false;
+}
+
+void FrameProfiler::release() {
+    flush();
+    if (queries[0] != 0) glDeleteQueries(GPU_QUERY_RING, queries);
+    for (int k = 0; k < GPU_QUERY_RING; k++) {
+        queries[k] = 0;
+        queryBusy[k] = false;
+    }
+    nextQuery = 0;
+    if (csv != NULL) fflush(csv);
+}
+
+void FrameProfiler::enter(int phase) {
+    const Clock::time_point now = Clock::now();
+    if (current >= 0) frame.phaseMs[current] += std::chrono::duration<double, std::milli>(now - lastSwitch).count();
+    lastSwitch = now;
+    current = phase;
+}
+
+// 古いフレームから順に、GPUの結果が出ていれば記録する (allなら結果を待つ)
+void FrameProfiler::resolve(bool all) {
+    while (!pending.empty()) {
+        FrameRecord &record = pending.front();
+        if (record.query >= 0) {
+            GLuint available = GL_FALSE;
+            if (!all) glGetQueryObjectuiv(queries[record.query], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!all && available == GL_FALSE) break;
+
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(queries[record.query], GL_QUERY_RESULT, &nanoseconds);
+            record.gpuMs = nanoseconds / 1.0e6;
+            queryBusy[record.query] = false;
+        }
+        finish(record);
+        pending.pop_front();
+    }
+}
+
+void FrameProfiler::finish(const FrameRecord &record) {
+    history.push_back(record);
+    if (history.size() > HISTORY_FRAMES) history.pop_front();
+    if (csv == NULL) return;
+
+    fprintf(csv, "%lld,%.6f", record.index, record.seconds);
+    for (int i = 0; i < NUM_FRAME_PHASES; i++) fprintf(csv, ",%.4f", record.phaseMs[i]);
+    fprintf(csv, ",%.4f,", record.cpuMs);
+    if (record.gpuMs >= 0.0) fprintf(csv, "%.4f", record.gpuMs);
+    fprintf(csv, ",");
+    if (record.latencyMs >= 0.0) fprintf(csv, "%.2f", record.latencyMs);
+    fprintf(csv, "\n");
+}
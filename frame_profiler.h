@@ -0,0 +1,133 @@
+#ifndef _FRAME_PROFILER_H_
+#define _FRAME_PROFILER_H_
+
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <string>
+
+#include <glad/gl.h>
+
+// 1フレームの処理の区間
+enum FramePhase {
+    PHASE_TRANSFORMS = 0,  // キューブごとの変換行列とインスタンスの並びを作る
+    PHASE_UPLOAD,          // Uniformバッファ、インスタンスバッファ、ステッカーの色の転送
+    PHASE_DRAW,            // 描画命令の発行 (paintGLのうち上の2つ以外)
+    PHASE_ANIMATE,         // アニメーションの更新 (animateRotate)
+    PHASE_SWAP,            // バッファの切り替え (ベンチマークではglFinish)
+    PHASE_EVENTS,          // イベントの処理 (glfwPollEvents、キーボードとマウスの処理を含む)
+    NUM_FRAME_PHASES
+};
+
+/*
+FrameProfiler
+フレームの時間を区間 (FramePhase) ごとに測る。
+CPUの時間はScopeを作ってから消すまでの時間で、内側のScopeの時間は外側の区間に含めない (区間の和はフレームの時間以下)。
+GPUの時間はbeginGpuとendGpuの間のGL_TIME_ELAPSEDのクエリで測る。クエリはGPU_QUERY_RING個のリングで使い回し、
+結果が出たかを待たずに確かめるので描画は止まらない (結果が出るまでそのフレームの記録は保留する。リングが一杯ならGPUは測らない)。
+直近HISTORY_FRAMESフレームの分位数をpercentileで引けて、openCsvしておけばフレームごとに1行ずつ書き出す。
+キー入力から、それによる回転が初めて画面に出るまでの時間 (markInputとinputShown) も記録する。
+*/
+class FrameProfiler {
+public:
+    static const int GPU_QUERY_RING = 4;
+    static const int HISTORY_FRAMES = 240;
+
+    // 作ってから消すまでをphaseの時間にする (測っていない時は何もしない)
+    class Scope {
+    public:
+        Scope(FrameProfiler &profiler_, FramePhase phase);
+        ~Scope();
+
+    private:
+        FrameProfiler &profiler;
+        int previous;
+    };
+
+    FrameProfiler();
+    ~FrameProfiler();
+
+    // 測るかどうか (falseの間はbeginFrameなども何もしない)
+    void setEnabled(bool enabled_);
+    bool isEnabled() const { return enabled; }
+
+    // フレームごとの記録をCSVに書き出す (開けなければfalse)
+    bool openCsv(const std::string &path);
+    void closeCsv();
+    bool isWriting() const { return csv != NULL; }
+
+    // フレームの始めと終わり
+    void beginFrame();
+    void endFrame();
+    // GPUの時間を測る区間 (1フレームに1回、他のGL_TIME_ELAPSEDのクエリと重ねない)
+    void beginGpu();
+    void endGpu();
+
+    // 入力の時刻 (秒) を覚える (前の入力がまだ画面に出ていなければ、そちらを優先する)
+    void markInput(double time);
+    bool waitingInput() const { return inputWaiting; }
+    double inputTime() const { return inputStart; }
+    // 覚えた入力が画面に出た時刻 (秒)
+    void inputShown(double time);
+    // 覚えた入力を忘れる (回転が取り消された時)
+    void cancelInput() { inputWaiting = false; }
+
+    // 直近のフレームのp分位 (0 ~ 100) のミリ秒 (無ければ-1)
+    // phase: FramePhase、NUM_FRAME_PHASESならフレーム全体のCPUの時間
+    double percentile(int phase, double p) const;
+    double gpuPercentile(double p) const;
+    double latencyPercentile(double p) const;
+    // 分位数の1行の要約 (ウィンドウのタイトルに出す)
+    std::string summary() const;
+
+    // 保留中のフレームを、GPUの結果を待って記録する
+    void flush();
+    // 記録を消す (CSVの行の番号は続ける)
+    void reset();
+    // 保留中のフレームを書き出し、クエリを消す (OpenGLのコンテキストを消す前に呼ぶ)
+    void release();
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct FrameRecord {
+        long long index;
+        double seconds;
+        double phaseMs[NUM_FRAME_PHASES];
+        double cpuMs;
+        double gpuMs;
+        double latencyMs;
+        int query;
+    };
+
+    void enter(int phase);
+    void resolve(bool all);
+    void finish(const FrameRecord &record);
+
+    bool enabled;
+    FILE *csv;
+    Clock::time_point startTime;
+
+    // 今のフレーム
+    FrameRecord frame;
+    bool inFrame;
+    Clock::time_point frameStart;
+    Clock::time_point lastSwitch;
+    int current;
+    long long frameCount;
+
+    // GPUのクエリのリング (queryBusyはそのクエリを待っているか)
+    GLuint queries[GPU_QUERY_RING];
+    bool queryBusy[GPU_QUERY_RING];
+    int nextQuery;
+    std::deque<FrameRecord> pending;
+
+    // 入力の遅延
+    bool inputWaiting;
+    double inputStart;
+
+    std::deque<FrameRecord> history;
+    std::deque<double> latencies;
+};
+
+#endif  // _FRAME_PROFILER_H_
@@ -1,11 +1,20 @@
 ﻿#include <cmath>
 #include <cstdio>
+#include <cstdlib>
 #include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <future>
+#include <limits>
+#include <map>
+#include <memory>
 #include <string>
+#include <thread>
 #include <vector>
-#include <set>
 #include <time.h>
 
 #define GLAD_GL_IMPLEMENTATION
@@ -23,38 +32,58 @@
 // ディレクトリの設定ファイル
 #include "common.h"
 
+// ヘッドレスなキューブの状態
+#include "cube_state.h"
+
+// 全キューブの変換行列をまとめて計算する
+#include "transform_batch.h"
+
+// マウスで指したキューブを光線との交差で求める
+#include "ray_pick.h"
+
+// ブロックのメッシュ (頂点の共有と詰め込み)
+#include "cube_mesh.h"
+
+// シェーダのソースコード (ビルドの時にshaders/から作る) と、リンクしたプログラムのキャッシュ
+#include "shader_sources.h"
+#include "program_cache.h"
+
+// ステッカーの色の配列 (ステッカー描画モード)
+#include "facelet_colors.h"
+
+// 手順の記法 (ヘッドレスモードの入力)
+#include "move_sequence.h"
+
+// フレームの区間ごとの時間 (Tキーでタイトルに出す)
+#include "frame_profiler.h"
+
+// 小さな処理の時間 (マイクロベンチマーク)
+#include "micro_bench.h"
+
+// ウィンドウを使わない描画 (ヘッドレスモード)
+#include "offscreen.h"
+#include "png_writer.h"
+
+// ソルバ (3x3は二段階法、それ以外は還元法)
+#include "reduction_solver.h"
+#include "two_phase.h"
+
 static int WIN_WIDTH   = 500;                       // ウィンドウの幅
 static int WIN_HEIGHT  = 500;                       // ウィンドウの高さ
 static const char *WIN_TITLE = "Rubik's Cube";     // ウィンドウのタイトル
 
 static const double PI = 4.0 * std::atan(1.0);
 
-// シェーダファイル
-static std::string VERT_SHADER_FILE = std::string(SHADER_DIRECTORY) + "render.vert";
-static std::string FRAG_SHADER_FILE = std::string(SHADER_DIRECTORY) + "render.frag";
-
-// 頂点オブジェクト
-struct Vertex {
-    Vertex(const glm::vec3 &position_, const glm::vec3 &color_, const glm::vec3 &normal_)
-        : position(position_)
-        , color(color_)
-        , normal(normal_) {
-    }
-
-    glm::vec3 position;
-    glm::vec3 color;
-    glm::vec3 normal;
-};
+// シェーダプログラムのバイナリを保存する場所 (空ならキャッシュを使わず、毎回ソースからコンパイルする)
+// 場所はprogram_cache.hのprogramCacheDirectory (環境変数CUBE_SHADER_CACHEで変えられる)
+static std::string SHADER_CACHE_DIRECTORY = programCacheDirectory();
 
-static const glm::vec3 positions[8] = {
-    glm::vec3(-1.0f, -1.0f, -1.0f),
-    glm::vec3( 1.0f, -1.0f, -1.0f),
-    glm::vec3(-1.0f,  1.0f, -1.0f),
-    glm::vec3(-1.0f, -1.0f,  1.0f),
-    glm::vec3( 1.0f,  1.0f, -1.0f),
-    glm::vec3(-1.0f,  1.0f,  1.0f),
-    glm::vec3( 1.0f, -1.0f,  1.0f),
-    glm::vec3( 1.0f,  1.0f,  1.0f)
+// インスタンス (キューブ1つ分) ごとに頂点シェーダに渡すデータ
+// mvMatは剛体変換なので、法線の変換には左上3x3をそのまま使う
+// info: ブロックの種類 (cubeIds2vaoの値、面の色を選ぶ), ブロックの形の番号 (頂点を選ぶ), キューブの種類, キューブのID
+struct CubeInstance {
+    glm::mat4 mvMat;
+    glm::ivec4 info;
 };
 
 static const glm::vec3 colors[6] = {
@@ -66,33 +95,113 @@ static const glm::vec3 colors[6] = {
     glm::vec3(236/255.0f, 151/255.0f, 63/255.0f),  // 橙
 };
 
-static const unsigned int faces[12][3] = {
-    { 1, 6, 7 }, { 1, 7, 4 },
-    { 2, 5, 7 }, { 2, 7, 4 },
-    { 3, 5, 7 }, { 3, 7, 6 },
-    { 0, 1, 4 }, { 0, 4, 2 },
-    { 0, 1, 6 }, { 0, 6, 3 },
-    { 0, 2, 5 }, { 0, 5, 3 }
-};
-
-static const glm::vec3 normals[8] = {
-    glm::vec3(-1.0f, -1.0f, -1.0f),
-    glm::vec3( 1.0f, -1.0f, -1.0f),
-    glm::vec3(-1.0f,  1.0f, -1.0f),
-    glm::vec3(-1.0f, -1.0f,  1.0f),
-    glm::vec3( 1.0f,  1.0f, -1.0f),
-    glm::vec3(-1.0f,  1.0f,  1.0f),
-    glm::vec3( 1.0f, -1.0f,  1.0f),
-    glm::vec3( 1.0f,  1.0f,  1.0f)
-};
-
 // バッファを参照する番号
 GLuint vaoId;
 GLuint vertexBufferId;
 GLuint indexBufferId;
+GLuint instanceBufferId;
+
+// 頂点バッファと面の色をシェーダから読むためのテクスチャ
+GLuint meshTextureId;
+GLuint faceColorBufferId;
+GLuint faceColorTextureId;
+
+// 毎フレーム詰め直すインスタンスのデータ
+std::vector<CubeInstance> cubeInstances;
+RigidTransformsSoA cubeTransforms;
+
+/*
+隠れた面を描かない描画 (Hキーで切り替え)
+止まっている普通のキューブで見えるのは、キューブの初期位置で外側だった面だけなので、
+面fごとに初期位置が面fにあるキューブ (exteriorCubiesの [exteriorBegin[f], exteriorBegin[f + 1])) の面fだけを描く。
+回転中は、回転している層とその両隣の層のキューブ (turnCubies) だけ全ての面を描く (切り口に内側の面が見える)。
+インスタンスバッファには6面の分と回転中の分を続けて並べ、partVaoIds[0 ~ 5] (面) と [6] (回転中) がその位置から読む。
+面の分の場所は決まっていて、turnCubiesに入ったキューブの分だけ詰めて少なく描く。
+ミラーブロックスとボイドキューブ、手で動かしたキューブがある時は内側の面も見えるので、全ての面を描く。
+*/
+bool hideInnerFaces = true;
+std::vector<int> exteriorCubies;
+int exteriorBegin[7];
+GLuint partVaoIds[7];
+std::vector<CubeInstance> partInstances;
+std::vector<int> turnCubies;
+std::vector<char> turnCubieMarks;
+// 最後のフレームで描いた三角形の数
+long long drawnTriangles = 0;
 
-// シェーダを参照する番号
-GLuint programId;
+/*
+フレームの時間の計測
+Tキーで、直近のフレームの区間ごとの時間の分位数 (中央値/95パーセンタイル) をウィンドウのタイトルに出す
+(文字を描く仕組みが無いので、タイトルを重ね書きの代わりにする)。--profile ファイル名で起動すると、
+フレームごとの時間をCSVに書き出す。回転のキーを押してから、その回転が初めて画面に出るまでの時間も記録する。
+*/
+FrameProfiler profiler;
+bool showProfile = false;
+double lastProfileTitleTime = 0.0;
+// 始めた回転の数と、時間を測っているキー入力の回転の番号 (startedTurnsがこれに届いたら画面に出る)
+long long startedTurns = 0;
+long long inputTurn = 0;
+
+// シェーダを参照する番号 (色モードごとに、render.fragをOUT_COLOR_MODEを変えてコンパイルしたもの)
+static const int NUM_COLOR_MODES = 3;
+GLuint programIds[NUM_COLOR_MODES];
+
+/*
+Uniformブロック (std140)
+FrameUniforms: フレームごとに変わる可能性のある値 (カメラと光源)
+MaterialUniforms: マテリアル (起動中は変わらない)
+C++側の構造体はstd140の並び (vec3はvec4に詰める) に合わせている。
+*/
+struct FrameUniforms {
+    glm::mat4 viewMat;
+    glm::mat4 projMat;
+    glm::mat4 lightMat;
+    glm::vec4 lightPos;
+};
+
+struct MaterialUniforms {
+    glm::vec3 diffColor;
+    float pad0;
+    glm::vec3 specColor;
+    float pad1;
+    glm::vec3 ambiColor;
+    float shininess;  // std140ではvec3の直後のfloatは同じ16バイトに入る
+};
+
+// Uniformブロックの結合番号
+static const GLuint FRAME_BLOCK_BINDING = 0;
+static const GLuint MATERIAL_BLOCK_BINDING = 1;
+
+// Uniformバッファを参照する番号
+GLuint frameUboId;
+GLuint materialUboId;
+
+// 最後に転送したフレームのUniform (変わっていなければ転送しない)
+FrameUniforms lastFrameUniforms;
+bool frameUniformsUploaded = false;
+
+/*
+ステッカー描画モード (Gキーで切り替え)
+キューブごとの行列の代わりに、全ステッカーの色 (6N^2バイト、facelets) をテクスチャバッファに置き、
+頂点シェーダ (sticker.vert) がgl_VertexIDからステッカーの位置を決める。回転中の層だけを層ごとの角度で回す。
+回転操作の後は変わったステッカーだけを転送するので、毎フレームの転送量とCPUの処理はキューブの数によらない。
+普通のキューブ (mode 0) で、手で動かしたキューブが無い時だけ使う (それ以外は今まで通りキューブごとに描く)。
+*/
+bool stickerRender = false;
+FaceletColors facelets;
+GLuint stickerProgramIds[NUM_COLOR_MODES];
+GLuint stickerVaoId;
+GLuint faceletBufferId;
+GLuint faceletTextureId;
+struct StickerUniformLocations {
+    GLint faceletBuffer;
+    GLint palette;
+    GLint N;
+    GLint mvMat;
+    GLint turnAxis;
+    GLint layerAngles;
+};
+StickerUniformLocations stickerUniformLocs[NUM_COLOR_MODES];
 
 // シェーディングのための情報
 // Gold (参照: http://www.barradeau.com/nicoptere/dump/materials.html)
@@ -119,184 +228,58 @@ glm::mat4 acRotMat, acTransMat, acScaleMat;
 glm::vec3 gravity;
 
 int N = 3;
+// Nの上限 (表面のキューブの数は6N^2ほどなので、128で約10万個。sticker.vertのu_layerAnglesの大きさと同じ)
+static const int MAX_N = 128;
+// Nの入力 (Nキーで始め、数字を打ってEnterで決める。Escで取り消す)
+bool enteringN = false;
+std::string enteredN;
 int outColorMode = 0;
 int mode = 0;
 
 /*
-Cube
-cubeType: コーナーキューブ、エッジキューブ、フェイスキューブ（センターキューブ）の種類を表す。
-position: キューブの位置。現在は回転によって更新はせず、キューブの初期位置として利用している。
-rotMat: キューブにかけられた回転行列。これによってキューブを回転させている。
-transMat: キューブの位置までの並進行列。現在は回転によって更新はせず、キューブの初期位置までの並進行列として利用している。
-pn: キューブの位置。0~N-1までの値を持つベクトル。
+キューブの状態
+キューブの種類、初期位置 (整数座標) と向き (24通りの回転の番号、合成は整数の表) はcubeStateが持ち、
+描画や選択の時にだけ行列にする (キューブごとに行列を持たないので、大きなNでもメモリが少なく、誤差も溜まらない)。
 */
-struct Cube {
-    Cube(const int &cubeType_, const glm::vec3 &position_, const glm::mat4 &rotMat_)
-        : cubeType(cubeType_)
-        , position(position_)
-        , rotMat(rotMat_)
-        , transMat(glm::translate(glm::mat4(1.0), position_)) {
-    }
-    int cubeType;
-    glm::vec3 position;
-    glm::mat4 rotMat;
-    glm::mat4 transMat;
-    std::vector<int> pn;
-};
-std::vector<Cube> Cubes;
+CubeState cubeState;
 
 /*
-CubePlane
-一回の操作で同時に動くキューブの集合を格納する。回転面というのが分かりやすい。
-nv: 回転面の法線ベクトル
-cubeIds: キューブのインデックスの集合。Cubesのインデックスが格納される。
+CubeAdjust
+手で動かしたキューブ (Wキーを押しながらの回転と、右ドラッグでの移動) の、向きと初期位置に加える変換。
+rotMat: キューブの局所座標での回転 (cubeStateの向きの後に掛ける)
+offset: 初期位置に足す移動量
+動かしたキューブの分だけcubeAdjustsに持つ。
 */
-struct CubePlane {
-    CubePlane(const glm::vec3 &nv_)
-        : nv(nv_) {
+struct CubeAdjust {
+    CubeAdjust()
+        : rotMat(1.0f)
+        , offset(0.0f) {
     }
-    glm::vec3 nv;
-    std::set<int> cubeIds;
-};
-
-std::vector<CubePlane> xCubePlanes;
-std::vector<CubePlane> yCubePlanes;
-std::vector<CubePlane> zCubePlanes;
-
-static const glm::vec3 cCubePositions[8] = {
-    glm::vec3(-1.0f,  1.0f, -1.0f),
-    glm::vec3( 1.0f,  1.0f, -1.0f),
-    glm::vec3( 1.0f,  1.0f,  1.0f),
-    glm::vec3(-1.0f,  1.0f,  1.0f),
-    glm::vec3(-1.0f, -1.0f, -1.0f),
-    glm::vec3( 1.0f, -1.0f, -1.0f),
-    glm::vec3( 1.0f, -1.0f,  1.0f),
-    glm::vec3(-1.0f, -1.0f,  1.0f)
-};
-
-static const unsigned int cubeEdgeCorners[12][2] = {
-    { 0, 4 },
-    { 1, 5 },
-    { 2, 6 },
-    { 3, 7 },
-    { 0, 1 },
-    { 1, 2 },
-    { 2, 3 },
-    { 3, 0 },
-    { 4, 5 },
-    { 5, 6 },
-    { 6, 7 },
-    { 7, 4 }
-};
-
-static const glm::vec3 eCubePositions[12] = {
-    glm::vec3(-1.0f,  0.0f, -1.0f),
-    glm::vec3( 1.0f,  0.0f, -1.0f),
-    glm::vec3( 1.0f,  0.0f,  1.0f),
-    glm::vec3(-1.0f,  0.0f,  1.0f),
-    glm::vec3( 0.0f,  1.0f, -1.0f),
-    glm::vec3( 1.0f,  1.0f,  0.0f),
-    glm::vec3( 0.0f,  1.0f,  1.0f),
-    glm::vec3(-1.0f,  1.0f,  0.0f),
-    glm::vec3( 0.0f, -1.0f, -1.0f),
-    glm::vec3( 1.0f, -1.0f,  0.0f),
-    glm::vec3( 0.0f, -1.0f,  1.0f),
-    glm::vec3(-1.0f, -1.0f,  0.0f)
+    glm::mat3 rotMat;
+    glm::vec3 offset;
 };
-
-static const unsigned int cubeFaceEdges[6][4] = {
-    { 2, 10, 3, 6 }, // F
-    { 1, 9, 2, 5 }, // R
-    { 8, 9, 10, 11 }, // D
-    { 3, 11, 0, 7 }, // L
-    { 4, 5, 6, 7 }, // U
-    { 0, 8, 1, 4 }  // B
-};
-
-static const glm::vec3 fCubePositions[6] = {
-    glm::vec3( 0.0f,  0.0f,  1.0f), // F
-    glm::vec3( 1.0f,  0.0f,  0.0f), // R
-    glm::vec3( 0.0f, -1.0f,  0.0f), // D
-    glm::vec3(-1.0f,  0.0f,  0.0f), // L
-    glm::vec3( 0.0f,  1.0f,  0.0f), // U
-    glm::vec3( 0.0f,  0.0f, -1.0f)  // B
-};
-
+std::map<int, CubeAdjust> cubeAdjusts;
 
 std::vector<int> cubeIds2vao;
 
-void initCube(int N) {
-
-    for (int i = 0; i < N; i++) {
-        CubePlane plane(glm::vec3(1.0f, 0.0f, 0.0f));
-        xCubePlanes.push_back(plane);
-    }
-    for (int i = 0; i < N; i++) {
-        CubePlane plane(glm::vec3(0.0f, 1.0f, 0.0f));
-        yCubePlanes.push_back(plane);
-    }
-    for (int i = 0; i < N; i++) {
-        CubePlane plane(glm::vec3(0.0f, 0.0f, 1.0f));
-        zCubePlanes.push_back(plane);
-    }
-
-    if (N == 1) {
-        glm::vec3 p = glm::vec3(N-1);
-        Cube c(1, p, glm::mat4(1.0));
-        Cubes.push_back(c);
-        
-    } else {
-
-        // corner
-        for (int i = 0; i < 8; i++) {
-            glm::vec3 p = cCubePositions[i] * glm::vec3(N-1);
-            Cube c(1, p, glm::mat4(1.0));
-            Cubes.push_back(c);
-        }
-
-        // edge
-        for (int i = 0; i < 12; i++) {
-            glm::vec3 dir = (cCubePositions[cubeEdgeCorners[i][0]] - cCubePositions[cubeEdgeCorners[i][1]]) * glm::vec3(0.5f);
-            for (int j = 0; j < N-2; j++) {
-                glm::vec3 p = eCubePositions[i] * glm::vec3(N-1) + dir * glm::vec3(2*j-(N-3));
-                Cube c(2, p, glm::mat4(1.0));
-                Cubes.push_back(c);
-            }
-        }
+// 選択しているキューブの番号 (-1なら未選択)
+int selectedCubie = -1;
 
-        // ボイドキューブの場合はフェイスキューブは作成しない
-        if (mode != 2) {
-            // face
-            for (int i = 0; i < 6; i++) {
-                glm::vec3 dir1 = (eCubePositions[cubeFaceEdges[i][0]] - eCubePositions[cubeFaceEdges[i][2]]) * glm::vec3(0.5f);
-                glm::vec3 dir2 = (eCubePositions[cubeFaceEdges[i][1]] - eCubePositions[cubeFaceEdges[i][3]]) * glm::vec3(0.5f);
-                for (int j = 0; j < N-2; j++) {
-                    glm::vec3 pj = fCubePositions[i] * glm::vec3(N-1) + dir1 * glm::vec3(2*j-(N-3));
-                    for (int k = 0; k < N-2; k++) {
-                        glm::vec3 p = pj + dir2 * glm::vec3(2*k-(N-3));
-                        Cube c(3, p, glm::mat4(1.0));
-                        Cubes.push_back(c);
-                    }
-                }
-            }
-        }
-    }
+// 選択中のキューブが今のcubeStateにあるか
+bool hasSelectedCubie() {
+    return selectedCubie >= 0 && selectedCubie < cubeState.numCubies();
+}
 
-    for (int i = 0; i < Cubes.size(); i++) {
-        glm::vec3 pn = (Cubes[i].position + glm::vec3(N-1)) * glm::vec3(0.5f);
-        int xn = (int)(pn.x);
-        int yn = (int)(pn.y);
-        int zn = (int)(pn.z);
-        xCubePlanes[xn].cubeIds.insert(i);
-        yCubePlanes[yn].cubeIds.insert(i);
-        zCubePlanes[zn].cubeIds.insert(i);
-        Cubes[i].pn = {xn, yn, zn};
-    }
+void initCube(int N) {
+    // キューブの番号、種類と初期位置はcubeStateの表 (CubeTopology) にある
+    cubeState = CubeState(N, mode);
+    cubeAdjusts.clear();
+    // 作り直したキューブでは前の選択の番号は意味がない
+    selectedCubie = -1;
 
-    for (int i = 0; i < Cubes.size(); i++) {
-        int x = Cubes[i].pn[0];
-        int y = Cubes[i].pn[1];
-        int z = Cubes[i].pn[2];
+    for (int i = 0; i < cubeState.numCubies(); i++) {
+        int x, y, z;
+        cubeState.posCoord(cubeState.position(i), &x, &y, &z);
 
         if (x < N-1 && x > 0) x = 1;
         if (y < N-1 && y > 0) y = 1;
@@ -318,192 +301,250 @@ float acScale = 1.0f;
 glm::ivec2 oldPos;
 glm::ivec2 newPos;
 
-// オブジェクトを選択するためのID
-bool selectMode = false;
-Cube *selectedObj = &Cubes[0];
+// ブロックの種類ごとの頂点を囲む箱 (選択の判定に使う)
+std::vector<glm::vec3> blockMin;
+std::vector<glm::vec3> blockMax;
+// ブロックの種類ごとの形の番号
+std::vector<int> blockGeometry;
 
-// VAOの初期化
-void initVAO() {
-    // Vertex配列の作成
-    // ここら辺のコード冗長的になっちゃってます。
-    std::vector<Vertex> vertices;
-    std::vector<unsigned int> indices;
-    int idx = 0;
-    gravity = glm::vec3(0.0f, 0.0f, 0.0f);
-
-    if (N == 1) {
-        for (int i = 0; i < 6; i++) {
-            for (int j = 0; j < 3; j++) {
-                Vertex v(positions[faces[i * 2 + 0][j]], colors[i], glm::normalize(normals[faces[i * 2 + 0][j]]));
-                vertices.push_back(v);
-                indices.push_back(idx++);
-                gravity += v.position;
-            }
-            
-            for (int j = 0; j < 3; j++) {
-                Vertex v(positions[faces[i * 2 + 1][j]], colors[i], glm::normalize(normals[faces[i * 2 + 1][j]]));
-                vertices.push_back(v);
-                indices.push_back(idx++);
-                gravity += v.position;
-            }
-        }
-    } else {
+// 今のVAOのインスタンスのAttribute変数を、インスタンスバッファのfirst番目から読むようにする
+void setInstanceAttributes(int first) {
+    const size_t base = sizeof(CubeInstance) * first;
 
-        // 通常のルービックキューブ及びボイドキューブの場合
-        if (mode == 0 || mode == 2) {
-            for (float x = -1; x < 2; x++) {
-                for (float y = -1; y < 2; y++) {
-                    for (float z = -1; z < 2; z++) {
-                        for (int i = 0; i < 6; i++) {
-                            for (int j = 0; j < 3; j++) {
-                                if ((x == -1 && i == 5)||(y == -1 && i == 4)||(z == -1 && i == 3)||(z == 1 && i == 2)||(y == 1 && i == 1)||(x == 1 && i == 0)) {
-                                    Vertex v(positions[faces[i * 2 + 0][j]], colors[i], glm::normalize(normals[faces[i * 2 + 0][j]]));
-                                    vertices.push_back(v);
-                                    indices.push_back(idx++);
-                                    gravity += v.position;
-                                } else {
-                                    Vertex v(positions[faces[i * 2 + 0][j]], glm::vec3( 0.0f,  0.0f,  0.0f), glm::normalize(normals[faces[i * 2 + 0][j]]));
-                                    vertices.push_back(v);
-                                    indices.push_back(idx++);
-                                    gravity += v.position;
-                                }
-                                
-
-                            }
-
-                            for (int j = 0; j < 3; j++) {
-
-                                if ((x == -1 && i == 5)||(y == -1 && i == 4)||(z == -1 && i == 3)||(z == 1 && i == 2)||(y == 1 && i == 1)||(x == 1 && i == 0)) {
-                                    Vertex v(positions[faces[i * 2 + 1][j]], colors[i], glm::normalize(normals[faces[i * 2 + 1][j]]));
-                                    vertices.push_back(v);
-                                    indices.push_back(idx++);
-                                    gravity += v.position;
-                                } else {
-                                    Vertex v(positions[faces[i * 2 + 1][j]], glm::vec3( 0.0f,  0.0f,  0.0f), glm::normalize(normals[faces[i * 2 + 1][j]]));
-                                    vertices.push_back(v);
-                                    indices.push_back(idx++);
-                                    gravity += v.position;
-                                }
-                            }
-                        }
-                    }
-                }
-            }
+    // mat4は4つのvec4として渡す
+    for (int i = 0; i < 4; i++) {
+        glEnableVertexAttribArray(0 + i);
+        glVertexAttribPointer(0 + i, 4, GL_FLOAT, GL_FALSE, sizeof(CubeInstance), (void*)(base + offsetof(CubeInstance, mvMat) + sizeof(glm::vec4) * i));
+        glVertexAttribDivisor(0 + i, 1);
+    }
 
-        // ミラーブロックスの場合
-        } else if (mode == 1) {
-            for (float x = -1; x < 2; x++) {
-                for (float y = -1; y < 2; y++) {
-                    for (float z = -1; z < 2; z++) {
-                        for (int i = 0; i < 6; i++) {
-                            for (int j = 0; j < 3; j++) {
-
-                                glm::vec3 d = glm::vec3( 0.0f,  0.0f,  0.0f);
-
-                                if ((int)positions[faces[i * 2 + 0][j]].x == x) d += glm::vec3( 0.5f,  0.0f,  0.0f);
-                                if ((int)positions[faces[i * 2 + 0][j]].y == y) d += glm::vec3( 0.0f,  0.1f,  0.0f);
-                                if ((int)positions[faces[i * 2 + 0][j]].z == z) d += glm::vec3( 0.0f,  0.0f,  0.9f);
-                                if ((x == -1 && i == 5)||(y == -1 && i == 4)||(z == -1 && i == 3)||(z == 1 && i == 2)||(y == 1 && i == 1)||(x == 1 && i == 0)) {
-                                    Vertex v(positions[faces[i * 2 + 0][j]] + d, colors[i], glm::normalize(normals[faces[i * 2 + 0][j]]));
-                                    vertices.push_back(v);
-                                    indices.push_back(idx++);
-                                    gravity += v.position;
-                                } else {
-                                    Vertex v(positions[faces[i * 2 + 0][j]] + d, glm::vec3( 0.0f,  0.0f,  0.0f), glm::normalize(normals[faces[i * 2 + 0][j]]));
-                                    vertices.push_back(v);
-                                    indices.push_back(idx++);
-                                    gravity += v.position;
-                                }
-                            }
-
-                            for (int j = 0; j < 3; j++) {
-
-                                glm::vec3 d = glm::vec3( 0.0f,  0.0f,  0.0f);
-
-                                if ((int)positions[faces[i * 2 + 1][j]].x == x) d += glm::vec3( 0.5f,  0.0f,  0.0f);
-                                if ((int)positions[faces[i * 2 + 1][j]].y == y) d += glm::vec3( 0.0f,  0.1f,  0.0f);
-                                if ((int)positions[faces[i * 2 + 1][j]].z == z) d += glm::vec3( 0.0f,  0.0f,  0.9f);
-
-                                if ((x == -1 && i == 5)||(y == -1 && i == 4)||(z == -1 && i == 3)||(z == 1 && i == 2)||(y == 1 && i == 1)||(x == 1 && i == 0)) {
-                                    Vertex v(positions[faces[i * 2 + 1][j]] + d, colors[i], glm::normalize(normals[faces[i * 2 + 1][j]]));
-                                    vertices.push_back(v);
-                                    indices.push_back(idx++);
-                                    gravity += v.position;
-                                } else {
-                                    Vertex v(positions[faces[i * 2 + 1][j]] + d, glm::vec3( 0.0f,  0.0f,  0.0f), glm::normalize(normals[faces[i * 2 + 1][j]]));
-                                    vertices.push_back(v);
-                                    indices.push_back(idx++);
-                                    gravity += v.position;
-                                }
-                            }
-                        }
-                    }
-                }
-            }
-        }
+    glEnableVertexAttribArray(4);
+    glVertexAttribIPointer(4, 4, GL_INT, sizeof(CubeInstance), (void*)(base + offsetof(CubeInstance, info)));
+    glVertexAttribDivisor(4, 1);
+}
+
+// VAOの初期化
+void initVAO() {
+    // メッシュの作成 (普通のキューブ、ミラーブロックス、ボイドキューブとN = 1を同じ手順で作る)
+    CubeMesh mesh;
+    buildCubeMesh(N, mode, glm::value_ptr(colors[0]), &mesh);
+    gravity = glm::vec3(mesh.gravity[0], mesh.gravity[1], mesh.gravity[2]);
+    blockGeometry = mesh.blockGeometry;
+
+    // ブロックの種類ごとの箱
+    blockMin.resize(mesh.blockGeometry.size());
+    blockMax.resize(mesh.blockGeometry.size());
+    for (int i = 0; i < mesh.blockGeometry.size(); i++) {
+        blockMin[i] = glm::make_vec3(&mesh.blockMin[3 * i]);
+        blockMax[i] = glm::make_vec3(&mesh.blockMax[3 * i]);
     }
-    gravity /= indices.size();
 
     // VAOの作成
     glGenVertexArrays(1, &vaoId);
     glBindVertexArray(vaoId);
 
     // 頂点バッファの作成
+    // ブロックの形ごとに頂点の位置が違うので、頂点シェーダがテクスチャバッファとして
+    // (形の番号 * 24 + gl_VertexID) 番目の頂点を読む (1頂点 = RG32UIの1テクセル、8バイト)
     glGenBuffers(1, &vertexBufferId);
-    glBindBuffer(GL_ARRAY_BUFFER, vertexBufferId);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * vertices.size(), vertices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, vertexBufferId);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(PackedVertex) * mesh.vertices.size(), mesh.vertices.data(), GL_STATIC_DRAW);
 
-    // 頂点バッファの有効化
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
+    glGenTextures(1, &meshTextureId);
+    glBindTexture(GL_TEXTURE_BUFFER, meshTextureId);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32UI, vertexBufferId);
 
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, color));
+    // 面の色 (ブロックの種類 * 6 + 面、RGBA8)
+    glGenBuffers(1, &faceColorBufferId);
+    glBindBuffer(GL_TEXTURE_BUFFER, faceColorBufferId);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(uint32_t) * mesh.faceColors.size(), mesh.faceColors.data(), GL_STATIC_DRAW);
 
-    glEnableVertexAttribArray(2);
-    glBindBuffer(GL_ARRAY_BUFFER, vertexBufferId);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+    glGenTextures(1, &faceColorTextureId);
+    glBindTexture(GL_TEXTURE_BUFFER, faceColorTextureId);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA8, faceColorBufferId);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
 
-    // 頂点番号バッファの作成
+    // 頂点番号バッファの作成 (全てのブロックで共通の36個、面fは6f番目から6個)
     glGenBuffers(1, &indexBufferId);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferId);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * indices.size(),
-                 indices.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint16_t) * mesh.indices.size(),
+                 mesh.indices.data(), GL_STATIC_DRAW);
+
+    // 初期位置が面fにあるキューブの並び (隠れた面を描かない時に使う)
+    const std::vector<int> &homeCoord = cubeState.topology().homeCoord;
+    exteriorCubies.clear();
+    for (int f = 0; f < 6; f++) {
+        const int axis = f < 3 ? f : 5 - f;
+        const int coord = f < 3 ? N - 1 : -(N - 1);
+        exteriorBegin[f] = (int)exteriorCubies.size();
+        for (int i = 0; i < cubeState.numCubies(); i++) {
+            if (homeCoord[3 * i + axis] == coord) exteriorCubies.push_back(i);
+        }
+    }
+    exteriorBegin[6] = (int)exteriorCubies.size();
+
+    // インスタンスバッファの作成 (中身は毎フレームpaintGLで転送する)
+    // 全ての面を描く時はキューブの数だけ、隠れた面を描かない時は6面の分と回転中のキューブの分を並べる
+    const int instanceCapacity = std::max(cubeState.numCubies(), exteriorBegin[6] + cubeState.numCubies());
+    glGenBuffers(1, &instanceBufferId);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBufferId);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(CubeInstance) * instanceCapacity, NULL, GL_STREAM_DRAW);
+
+    setInstanceAttributes(0);
+    for (int k = 0; k < 7; k++) {
+        glGenVertexArrays(1, &partVaoIds[k]);
+        glBindVertexArray(partVaoIds[k]);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBufferId);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferId);
+        setInstanceAttributes(exteriorBegin[k]);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 
     // VAOをOFFにしておく
     glBindVertexArray(0);
+
+    // ステッカー描画モードのバッファ (中身は切り替えの度にfacelets.resetで全て変わったことにし、paintStickersで転送する)
+    glGenBuffers(1, &faceletBufferId);
+    glBindBuffer(GL_TEXTURE_BUFFER, faceletBufferId);
+    glBufferData(GL_TEXTURE_BUFFER, 6 * N * N, NULL, GL_DYNAMIC_DRAW);
+
+    glGenTextures(1, &faceletTextureId);
+    glBindTexture(GL_TEXTURE_BUFFER, faceletTextureId);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R8UI, faceletBufferId);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
 }
 
-GLuint compileShader(const std::string &filename, GLuint type) {
-    // シェーダの作成
-    GLuint shaderId = glCreateShader(type);
-    
-    // ファイルの読み込み
-    std::ifstream reader;
-    size_t codeSize;
-    std::string code;
-
-    // ファイルを開く
-    reader.open(filename.c_str(), std::ios::in);
-    if (!reader.is_open()) {
-        // ファイルを開けなかったらエラーを出して終了
-        fprintf(stderr, "Failed to load a shader: %s\n", VERT_SHADER_FILE.c_str());
-        exit(1);
+/*
+CubeResources
+(N, モード) ごとの描画の資源。initVAOで作ったGPUのバッファ、テクスチャ、VAOと、それに合わせたCPU側の表を持つ。
+一度作った構成はcubeResourcesに残しておき、Nやモードを切り替えた時は作り直さずに今の資源 (vaoIdなど) に戻す。
+残すのは最近使ったMAX_CUBE_RESOURCES個までで、それを超えたら一番長く使っていない構成を消す
+(何度切り替えてもGPUのメモリは一定量を超えない)。シェーダとUniformバッファは全ての構成で共通なので持たない。
+*/
+struct CubeResources {
+    GLuint vaoId;
+    GLuint vertexBufferId;
+    GLuint indexBufferId;
+    GLuint instanceBufferId;
+    GLuint meshTextureId;
+    GLuint faceColorBufferId;
+    GLuint faceColorTextureId;
+    GLuint partVaoIds[7];
+    GLuint faceletBufferId;
+    GLuint faceletTextureId;
+
+    glm::vec3 gravity;
+    std::vector<glm::vec3> blockMin;
+    std::vector<glm::vec3> blockMax;
+    std::vector<int> blockGeometry;
+    std::vector<int> exteriorCubies;
+    int exteriorBegin[7];
+
+    // 最後に使った順番 (大きいほど新しい)
+    long long lastUsed;
+};
+static const int MAX_CUBE_RESOURCES = 8;
+std::map<std::pair<int, int>, CubeResources> cubeResources;
+long long cubeResourcesClock = 0;
+
+// 今の資源をresに覚える
+void storeCubeResources(CubeResources *res) {
+    res->vaoId = vaoId;
+    res->vertexBufferId = vertexBufferId;
+    res->indexBufferId = indexBufferId;
+    res->instanceBufferId = instanceBufferId;
+    res->meshTextureId = meshTextureId;
+    res->faceColorBufferId = faceColorBufferId;
+    res->faceColorTextureId = faceColorTextureId;
+    for (int k = 0; k < 7; k++) res->partVaoIds[k] = partVaoIds[k];
+    res->faceletBufferId = faceletBufferId;
+    res->faceletTextureId = faceletTextureId;
+
+    res->gravity = gravity;
+    res->blockMin = blockMin;
+    res->blockMax = blockMax;
+    res->blockGeometry = blockGeometry;
+    res->exteriorCubies = exteriorCubies;
+    for (int k = 0; k < 7; k++) res->exteriorBegin[k] = exteriorBegin[k];
+}
+
+// resを今の資源にする
+void loadCubeResources(const CubeResources &res) {
+    vaoId = res.vaoId;
+    vertexBufferId = res.vertexBufferId;
+    indexBufferId = res.indexBufferId;
+    instanceBufferId = res.instanceBufferId;
+    meshTextureId = res.meshTextureId;
+    faceColorBufferId = res.faceColorBufferId;
+    faceColorTextureId = res.faceColorTextureId;
+    for (int k = 0; k < 7; k++) partVaoIds[k] = res.partVaoIds[k];
+    faceletBufferId = res.faceletBufferId;
+    faceletTextureId = res.faceletTextureId;
+
+    gravity = res.gravity;
+    blockMin = res.blockMin;
+    blockMax = res.blockMax;
+    blockGeometry = res.blockGeometry;
+    exteriorCubies = res.exteriorCubies;
+    for (int k = 0; k < 7; k++) exteriorBegin[k] = res.exteriorBegin[k];
+}
+
+// resのGPUの資源を消す
+void deleteCubeResources(const CubeResources &res) {
+    glDeleteVertexArrays(1, &res.vaoId);
+    glDeleteVertexArrays(7, res.partVaoIds);
+    const GLuint buffers[5] = { res.vertexBufferId, res.indexBufferId, res.instanceBufferId, res.faceColorBufferId, res.faceletBufferId };
+    glDeleteBuffers(5, buffers);
+    const GLuint textures[3] = { res.meshTextureId, res.faceColorTextureId, res.faceletTextureId };
+    glDeleteTextures(3, textures);
+}
+
+// 今のNとモード (cubeStateは初期化済み) の資源を用意する (作ったことがあれば作り直さない)
+void useCubeResources() {
+    const std::pair<int, int> key(N, mode);
+    std::map<std::pair<int, int>, CubeResources>::iterator it = cubeResources.find(key);
+    if (it != cubeResources.end()) {
+        loadCubeResources(it->second);
+    } else {
+        // 一杯なら一番長く使っていない構成を消す
+        if (cubeResources.size() >= MAX_CUBE_RESOURCES) {
+            std::map<std::pair<int, int>, CubeResources>::iterator oldest = cubeResources.begin();
+            for (it = cubeResources.begin(); it != cubeResources.end(); it++) {
+                if (it->second.lastUsed < oldest->second.lastUsed) oldest = it;
+            }
+            deleteCubeResources(oldest->second);
+            cubeResources.erase(oldest);
+        }
+
+        initVAO();
+        it = cubeResources.insert(std::make_pair(key, CubeResources())).first;
+        storeCubeResources(&it->second);
     }
+    it->second.lastUsed = ++cubeResourcesClock;
 
-    // ファイルをすべて読んで変数に格納 (やや難)
-    reader.seekg(0, std::ios::end);             // ファイル読み取り位置を終端に移動 
-    codeSize = reader.tellg();                  // 現在の箇所(=終端)の位置がファイルサイズ
-    code.resize(codeSize);                      // コードを格納する変数の大きさを設定
-    reader.seekg(0);                            // ファイルの読み取り位置を先頭に移動
-    reader.read(&code[0], codeSize);            // 先頭からファイルサイズ分を読んでコードの変数に格納
+    // 構成ごとに残さない状態は作り直す
+    turnCubieMarks.assign(cubeState.numCubies(), 0);
+    facelets.reset(cubeState);
+}
 
-    // ファイルを閉じる
-    reader.close();
+/*
+シェーダのコンパイル
+code: プログラムに埋め込んだソースコード。definesは#versionの行のすぐ後に足す
+(#lineで行番号を戻すので、エラーメッセージの行番号は元のファイルと同じ)。
+*/
+GLuint compileShader(const std::string &name, const char *code, const std::string &defines, GLuint type) {
+    // シェーダの作成
+    GLuint shaderId = glCreateShader(type);
 
     // コードのコンパイル
-    const char *codeChars = code.c_str();
-    glShaderSource(shaderId, 1, &codeChars, NULL);
+    const char *body = strchr(code, '\n');
+    body = body != NULL ? body + 1 : code + strlen(code);
+    const std::string version(code, body);
+    const std::string header = defines + "#line 2\n";
+    const char *sources[3] = { version.c_str(), header.c_str(), body };
+    glShaderSource(shaderId, 3, sources, NULL);
     glCompileShader(shaderId);
 
     // コンパイルの成否を判定する
@@ -511,7 +552,7 @@ GLuint compileShader(const std::string &filename, GLuint type) {
     glGetShaderiv(shaderId, GL_COMPILE_STATUS, &compileStatus);
     if (compileStatus == GL_FALSE) {
         // コンパイルが失敗したらエラーメッセージとソースコードを表示して終了
-        fprintf(stderr, "Failed to compile a shader!\n");
+        fprintf(stderr, "Failed to compile a shader: %s\n", name.c_str());
 
         // エラーメッセージの長さを取得する
         GLint logLength;
@@ -525,7 +566,7 @@ GLuint compileShader(const std::string &filename, GLuint type) {
 
             // エラーメッセージとソースコードの出力
             fprintf(stderr, "[ ERROR ] %s\n", errMsg.c_str());
-            fprintf(stderr, "%s\n", code.c_str());
+            fprintf(stderr, "%s\n", code);
         }
         exit(1);
     }
@@ -533,48 +574,131 @@ GLuint compileShader(const std::string &filename, GLuint type) {
     return shaderId;
 }
 
-GLuint buildShaderProgram(const std::string &vShaderFile, const std::string &fShaderFile) {
-    // シェーダの作成
-    GLuint vertShaderId = compileShader(vShaderFile, GL_VERTEX_SHADER);
-    GLuint fragShaderId = compileShader(fShaderFile, GL_FRAGMENT_SHADER);
-    
-    // シェーダプログラムのリンク
+GLuint buildShaderProgram(const std::string &vShaderName, const char *vShaderCode, const std::string &fShaderName, const char *fShaderCode,
+                          const std::string &defines) {
     GLuint programId = glCreateProgram();
-    glAttachShader(programId, vertShaderId);
-    glAttachShader(programId, fragShaderId);
-    glLinkProgram(programId);
-    
-    // リンクの成否を判定する
-    GLint linkState;
-    glGetProgramiv(programId, GL_LINK_STATUS, &linkState);
-    if (linkState == GL_FALSE) {
-        // リンクに失敗したらエラーメッセージを表示して終了
-        fprintf(stderr, "Failed to link shaders!\n");
-
-        // エラーメッセージの長さを取得する
-        GLint logLength;
-        glGetProgramiv(programId, GL_INFO_LOG_LENGTH, &logLength);
-        if (logLength > 0) {
-            // エラーメッセージを取得する
-            GLsizei length;
-            std::string errMsg;
-            errMsg.resize(logLength);
-            glGetProgramInfoLog(programId, logLength, &length, &errMsg[0]);
 
-            // エラーメッセージを出力する
-            fprintf(stderr, "[ ERROR ] %s\n", errMsg.c_str());
+    // 前の起動で保存したバイナリがあれば、コンパイルとリンクを省く
+    const std::string cachePath = SHADER_CACHE_DIRECTORY.empty() ? "" : programCachePath(SHADER_CACHE_DIRECTORY, defines, vShaderCode, fShaderCode);
+    if (cachePath.empty() || !loadProgramBinary(programId, cachePath)) {
+        // シェーダの作成
+        GLuint vertShaderId = compileShader(vShaderName, vShaderCode, defines, GL_VERTEX_SHADER);
+        GLuint fragShaderId = compileShader(fShaderName, fShaderCode, defines, GL_FRAGMENT_SHADER);
+
+        // シェーダプログラムのリンク (後でバイナリを取り出せるようにしておく)
+        glAttachShader(programId, vertShaderId);
+        glAttachShader(programId, fragShaderId);
+        glProgramParameteri(programId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(programId);
+
+        // リンクの成否を判定する
+        GLint linkState;
+        glGetProgramiv(programId, GL_LINK_STATUS, &linkState);
+        if (linkState == GL_FALSE) {
+            // リンクに失敗したらエラーメッセージを表示して終了
+            fprintf(stderr, "Failed to link shaders: %s, %s\n", vShaderName.c_str(), fShaderName.c_str());
+
+            // エラーメッセージの長さを取得する
+            GLint logLength;
+            glGetProgramiv(programId, GL_INFO_LOG_LENGTH, &logLength);
+            if (logLength > 0) {
+                // エラーメッセージを取得する
+                GLsizei length;
+                std::string errMsg;
+                errMsg.resize(logLength);
+                glGetProgramInfoLog(programId, logLength, &length, &errMsg[0]);
+
+                // エラーメッセージを出力する
+                fprintf(stderr, "[ ERROR ] %s\n", errMsg.c_str());
+            }
+            exit(1);
         }
-        exit(1);
+
+        // シェーダはプログラムに入ったので要らない
+        glDetachShader(programId, vertShaderId);
+        glDetachShader(programId, fragShaderId);
+        glDeleteShader(vertShaderId);
+        glDeleteShader(fragShaderId);
+
+        // 次の起動のためにバイナリを保存する
+        if (!cachePath.empty()) saveProgramBinary(programId, cachePath);
     }
-    
-    // シェーダを無効化した後にIDを返す
-    glUseProgram(0);
+
+    // Uniformブロックを決まった結合番号に割り当てる (バイナリから読んだ時も割り当て直す)
+    GLuint blockIndex = glGetUniformBlockIndex(programId, "FrameBlock");
+    if (blockIndex != GL_INVALID_INDEX) glUniformBlockBinding(programId, blockIndex, FRAME_BLOCK_BINDING);
+    blockIndex = glGetUniformBlockIndex(programId, "MaterialBlock");
+    if (blockIndex != GL_INVALID_INDEX) glUniformBlockBinding(programId, blockIndex, MATERIAL_BLOCK_BINDING);
+
     return programId;
 }
 
 // シェーダの初期化
 void initShaders() {
-    programId = buildShaderProgram(VERT_SHADER_FILE, FRAG_SHADER_FILE);
+    for (int k = 0; k < NUM_COLOR_MODES; k++) {
+        // 色モードはフラグメントごとに分岐せず、プログラムを分ける
+        char defines[64];
+        snprintf(defines, sizeof(defines), "#define OUT_COLOR_MODE %d\n", k);
+
+        // テクスチャユニットは変わらないので一度だけ設定する
+        programIds[k] = buildShaderProgram("render.vert", SHADER_RENDER_VERT, "render.frag", SHADER_RENDER_FRAG, defines);
+        glUseProgram(programIds[k]);
+        glUniform1i(glGetUniformLocation(programIds[k], "u_meshBuffer"), 0);
+        glUniform1i(glGetUniformLocation(programIds[k], "u_faceColors"), 1);
+
+        // ステッカー描画モードのシェーダ (フラグメントシェーダは共通)
+        const GLuint stickerProgramId = buildShaderProgram("sticker.vert", SHADER_STICKER_VERT, "render.frag", SHADER_RENDER_FRAG, defines);
+        StickerUniformLocations &locs = stickerUniformLocs[k];
+        locs.faceletBuffer = glGetUniformLocation(stickerProgramId, "u_faceletBuffer");
+        locs.palette = glGetUniformLocation(stickerProgramId, "u_palette");
+        locs.N = glGetUniformLocation(stickerProgramId, "u_N");
+        locs.mvMat = glGetUniformLocation(stickerProgramId, "u_mvMat");
+        locs.turnAxis = glGetUniformLocation(stickerProgramId, "u_turnAxis");
+        locs.layerAngles = glGetUniformLocation(stickerProgramId, "u_layerAngles");
+        stickerProgramIds[k] = stickerProgramId;
+
+        glUseProgram(stickerProgramId);
+        glUniform1i(locs.faceletBuffer, 0);
+        glUniform3fv(locs.palette, 6, glm::value_ptr(colors[0]));
+    }
+    glUseProgram(0);
+
+    // ステッカー描画モードのVAO (頂点はシェーダが作るので空)
+    glGenVertexArrays(1, &stickerVaoId);
+
+    // フレームごとのUniformバッファ (中身はpaintGLで転送する)
+    glGenBuffers(1, &frameUboId);
+    glBindBuffer(GL_UNIFORM_BUFFER, frameUboId);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), NULL, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_BLOCK_BINDING, frameUboId);
+    frameUniformsUploaded = false;
+
+    // マテリアルのUniformバッファ (変わらないので最初に一度だけ転送する)
+    MaterialUniforms material;
+    material.diffColor = diffColor;
+    material.pad0 = 0.0f;
+    material.specColor = specColor;
+    material.pad1 = 0.0f;
+    material.ambiColor = ambiColor;
+    material.shininess = shininess;
+    glGenBuffers(1, &materialUboId);
+    glBindBuffer(GL_UNIFORM_BUFFER, materialUboId);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(MaterialUniforms), &material, GL_STATIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, MATERIAL_BLOCK_BINDING, materialUboId);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+// カメラの初期化 (視点の距離はNで決まる)
+void resetCamera() {
+    projMat = glm::perspective(45.0f, (float)WIN_WIDTH / (float)WIN_HEIGHT, 0.1f, 1000.0f);
+
+    viewMat = glm::lookAt(glm::vec3(3.0f*N*0.75, 4.0f*N*0.75, 5.0f*N*0.75),   // 視点の位置
+                          glm::vec3(0.0f, 0.0f, 0.0f),   // 見ている先
+                          glm::vec3(0.0f, 1.0f, 0.0f));  // 視界の上方向
+
+    // その他の行列の初期化
+    modelMat = glm::mat4(1.0);
+    acRotMat = glm::mat4(1.0);
 }
 
 // OpenGLの初期化関数
@@ -585,85 +709,305 @@ void initializeGL() {
     // 背景色の設定 (黒)
     glClearColor(0.3f, 0.3f, 0.3f, 1.0f);
 
-    // キューブの初期化
+    // シェーダの用意 (全ての構成で共通なので最初の一回だけ)
+    if (programIds[0] == 0) initShaders();
+
+    // キューブの初期化と、そのNとモードの描画の資源の用意
     initCube(N);
+    useCubeResources();
 
-    // VAOの初期化
-    initVAO();
+    // カメラの初期化
+    resetCamera();
+}
 
-    // シェーダの用意
-    initShaders();
+// OpenGLの資源を全て消す (終了する前に呼ぶ。また使う時はinitializeGLから)
+void releaseGL() {
+    std::map<std::pair<int, int>, CubeResources>::iterator it;
+    for (it = cubeResources.begin(); it != cubeResources.end(); it++) deleteCubeResources(it->second);
+    cubeResources.clear();
+
+    // 今の資源は消した構成の番号をそのまま持っているので0に戻す
+    vaoId = vertexBufferId = indexBufferId = instanceBufferId = 0;
+    meshTextureId = faceColorBufferId = faceColorTextureId = 0;
+    for (int k = 0; k < 7; k++) partVaoIds[k] = 0;
+    faceletBufferId = faceletTextureId = 0;
+
+    // initializeGLはprogramIds[0]が0ならシェーダから作り直すので、消したものは全て0にしておく
+    for (int k = 0; k < NUM_COLOR_MODES; k++) {
+        glDeleteProgram(programIds[k]);
+        glDeleteProgram(stickerProgramIds[k]);
+        programIds[k] = 0;
+        stickerProgramIds[k] = 0;
+    }
+    glDeleteVertexArrays(1, &stickerVaoId);
+    glDeleteBuffers(1, &frameUboId);
+    glDeleteBuffers(1, &materialUboId);
+    stickerVaoId = 0;
+    frameUboId = 0;
+    materialUboId = 0;
+
+    // 計測のクエリ
+    profiler.release();
+}
 
-    // カメラの初期化
-    projMat = glm::perspective(45.0f, (float)WIN_WIDTH / (float)WIN_HEIGHT, 0.1f, 1000.0f);
+/*
+ActiveTurn
+アニメーション中の回転操作。
+cubies: 回転面のキューブ (開始時のcubeStateから求める)
+start, duration: 開始時刻と長さ (秒)。角度は経過時間で決めるので、フレームレートによらず同じ速さで回る。
+angle: 今の回転角 (ラジアン)。終わったらcubeStateに操作を適用するので、向きは常に整数のまま (行列の誤差が溜まらない)。
+*/
+struct ActiveTurn {
+    CubeMove move;
+    std::vector<int> cubies;
+    double start;
+    double duration;
+    float angle;
+};
+std::vector<ActiveTurn> activeTurns;
 
-    viewMat = glm::lookAt(glm::vec3(3.0f*N*0.75, 4.0f*N*0.75, 5.0f*N*0.75),   // 視点の位置
-                          glm::vec3(0.0f, 0.0f, 0.0f),   // 見ている先
-                          glm::vec3(0.0f, 1.0f, 0.0f));  // 視界の上方向
+// 順番待ちの操作 (キー入力やソルバの解)
+std::deque<CubeMove> pendingMoves;
 
-    // その他の行列の初期化
-    modelMat = glm::mat4(1.0);
-    acRotMat = glm::mat4(1.0);
+// 回転の番号の整数行列をglmの行列にする
+glm::mat3 orientationMatrix(int r) {
+    const int *m = rotationMatrix(r);
+    glm::mat3 rotMat(1.0f);
+    for (int row = 0; row < 3; row++) {
+        for (int col = 0; col < 3; col++) rotMat[col][row] = (float)m[3 * row + col];
+    }
+    return rotMat;
+}
+
+// キューブごとの回転と位置を成分ごとの配列に並べる
+// 向きと初期位置の整数から作り、手で動かした分とアニメーション中の回転だけを行列で掛ける
+void updateCubeTransforms() {
+    const int count = cubeState.numCubies();
+    const std::vector<int> &homeCoord = cubeState.topology().homeCoord;
+    cubeTransforms.resize(count);
+    for (int i = 0; i < count; i++) {
+        const int *m = rotationMatrix(cubeState.orientation(i));
+        for (int col = 0; col < 3; col++) {
+            for (int row = 0; row < 3; row++) {
+                cubeTransforms.r[3 * col + row][i] = (float)m[3 * row + col];
+            }
+            cubeTransforms.p[col][i] = (float)homeCoord[3 * i + col];
+        }
+    }
+
+    for (std::map<int, CubeAdjust>::const_iterator it = cubeAdjusts.begin(); it != cubeAdjusts.end(); ++it) {
+        const glm::mat3 rotMat = orientationMatrix(cubeState.orientation(it->first)) * it->second.rotMat;
+        for (int col = 0; col < 3; col++) {
+            for (int row = 0; row < 3; row++) cubeTransforms.r[3 * col + row][it->first] = rotMat[col][row];
+            cubeTransforms.p[col][it->first] += it->second.offset[col];
+        }
+    }
+
+    for (int i = 0; i < activeTurns.size(); i++) {
+        const ActiveTurn &turn = activeTurns[i];
+        glm::vec3 nv(0.0f);
+        nv[turn.move.axis] = 1.0f;
+        const glm::mat3 turnMat = glm::mat3(glm::rotate(turn.angle, nv));
+        for (int k = 0; k < turn.cubies.size(); k++) {
+            const int c = turn.cubies[k];
+            glm::mat3 rotMat;
+            for (int col = 0; col < 3; col++) {
+                for (int row = 0; row < 3; row++) rotMat[col][row] = cubeTransforms.r[3 * col + row][c];
+            }
+            rotMat = turnMat * rotMat;
+            for (int col = 0; col < 3; col++) {
+                for (int row = 0; row < 3; row++) cubeTransforms.r[3 * col + row][c] = rotMat[col][row];
+            }
+        }
+    }
+}
+
+// 隠れた面を描かないか
+bool useHiddenFaceCulling() {
+    return hideInnerFaces && mode == 0 && cubeAdjusts.empty();
+}
+
+// ステッカー描画モードで描くか
+bool useStickerRender() {
+    return stickerRender && mode == 0 && cubeAdjusts.empty();
+}
+
+// 今の色モードで使うプログラムの番号 (0: 描画色、1: 描画色のBlinn-Phong、それ以外: 金のBlinn-Phong)
+int colorModeVariant() {
+    return outColorMode == 0 || outColorMode == 1 ? outColorMode : 2;
+}
+
+// ステッカー描画モードで全てのステッカーを一回で描画する
+void paintStickers() {
+    // 色モードのプログラムを選ぶ
+    const int variant = colorModeVariant();
+    const StickerUniformLocations &locs = stickerUniformLocs[variant];
+    glUseProgram(stickerProgramIds[variant]);
+    glBindVertexArray(stickerVaoId);
+
+    // 変わったステッカーだけを面ごとの範囲で転送する
+    if (facelets.isDirty()) {
+        FrameProfiler::Scope scope(profiler, PHASE_UPLOAD);
+        glBindBuffer(GL_TEXTURE_BUFFER, faceletBufferId);
+        for (int face = 0; face < 6; face++) {
+            const int begin = facelets.dirtyBegin(face), end = facelets.dirtyEnd(face);
+            if (begin < end) glBufferSubData(GL_TEXTURE_BUFFER, begin, end - begin, facelets.data() + begin);
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        facelets.clearDirty();
+    }
+
+    const glm::mat4 mvMat = viewMat * modelMat * acRotMat;
+    glUniformMatrix4fv(locs.mvMat, 1, GL_FALSE, glm::value_ptr(mvMat));
+    glUniform1i(locs.N, N);
+
+    // 回転中の層の角度 (同時に回るのは同じ軸の層だけ)。回転中は層の境目の蓋 (2(N-1)枚) も描く
+    int quads = 6 * N * N;
+    if (activeTurns.empty()) {
+        glUniform1i(locs.turnAxis, -1);
+    } else {
+        std::vector<float> layerAngles(N, 0.0f);
+        for (int i = 0; i < activeTurns.size(); i++) layerAngles[activeTurns[i].move.layer] = activeTurns[i].angle;
+        glUniform1i(locs.turnAxis, activeTurns[0].move.axis);
+        glUniform1fv(locs.layerAngles, N, layerAngles.data());
+        quads += 2 * (N - 1);
+    }
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, faceletTextureId);
+    glDrawArrays(GL_TRIANGLES, 0, quads * 6);
+    drawnTriangles = 2LL * quads;
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+    glBindVertexArray(0);
+    glUseProgram(0);
 }
 
 // OpenGLの描画関数
 void paintGL() {
     // 背景色の描画
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    
-    // シェーダの有効化
-    glUseProgram(programId);
-        
+
+    // フレームごとのUniformブロック (前回から変わった時だけ転送する)
+    FrameUniforms frame;
+    frame.viewMat = viewMat;
+    frame.projMat = projMat;
+    frame.lightMat = viewMat;
+    frame.lightPos = glm::vec4(lightPos, 1.0f);
+    if (!frameUniformsUploaded || memcmp(&frame, &lastFrameUniforms, sizeof(FrameUniforms)) != 0) {
+        FrameProfiler::Scope scope(profiler, PHASE_UPLOAD);
+        glBindBuffer(GL_UNIFORM_BUFFER, frameUboId);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &frame);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        lastFrameUniforms = frame;
+        frameUniformsUploaded = true;
+    }
+
+    if (useStickerRender()) {
+        paintStickers();
+        return;
+    }
+
+    // シェーダの有効化 (色モードのプログラムを選ぶ)
+    glUseProgram(programIds[colorModeVariant()]);
+
     // VAOの有効化
     glBindVertexArray(vaoId);
 
-    
+    // メッシュと面の色のテクスチャバッファ
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, meshTextureId);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_BUFFER, faceColorTextureId);
+
+    // Cube (キューブごとの行列をインスタンスバッファに詰める)
+    // 全キューブ共通の変換 (カメラ * モデル * アークボール) は一度だけ計算し、
+    // キューブごとの回転と位置は成分ごとの配列に並べてまとめて掛ける
+    FrameProfiler::Scope transformScope(profiler, PHASE_TRANSFORMS);
+    glm::mat4 prefixMat = viewMat * modelMat * acRotMat;
+    updateCubeTransforms();
+
+    cubeInstances.resize(cubeState.numCubies());
+    composeRigidTransforms(glm::value_ptr(prefixMat), cubeTransforms, glm::value_ptr(cubeInstances[0].mvMat), sizeof(CubeInstance) / sizeof(float));
+    for (int i = 0; i < cubeInstances.size(); i++) {
+        cubeInstances[i].info = glm::ivec4(cubeIds2vao[i], blockGeometry[cubeIds2vao[i]], cubeState.cubeType(i), i);
+    }
+
+    if (useHiddenFaceCulling()) {
+        // 回転中の層とその両隣の層のキューブ (重なりは1つにまとめる)
+        turnCubies.clear();
+        for (int i = 0; i < activeTurns.size(); i++) {
+            const CubeMove &move = activeTurns[i].move;
+            for (int layer = std::max(0, move.layer - 1); layer <= std::min(N - 1, move.layer + 1); layer++) {
+                const int count = cubeState.sliceSize(move.axis, layer);
+                for (int k = 0; k < count; k++) {
+                    const int c = cubeState.sliceCubie(move.axis, layer, k);
+                    if (turnCubieMarks[c]) continue;
+                    turnCubieMarks[c] = 1;
+                    turnCubies.push_back(c);
+                }
+            }
+        }
 
-    GLuint uid;
-    uid = glGetUniformLocation(programId, "u_lightPos");
-    glUniform3fv(uid, 1, glm::value_ptr(lightPos));
-    uid = glGetUniformLocation(programId, "u_diffColor");
-    glUniform3fv(uid, 1, glm::value_ptr(diffColor));
-    uid = glGetUniformLocation(programId, "u_specColor");
-    glUniform3fv(uid, 1, glm::value_ptr(specColor));
-    uid = glGetUniformLocation(programId, "u_ambiColor");
-    glUniform3fv(uid, 1, glm::value_ptr(ambiColor));
-    uid = glGetUniformLocation(programId, "u_shininess");
-    glUniform1f(uid, shininess);
-    uid = glGetUniformLocation(programId, "u_outColorMode");
-    glUniform1i(uid, outColorMode);
-
-    // Cube
-    for (int i = 0; i < Cubes.size(); i++) {
-        glm::mat4 mvpMat = projMat * viewMat * modelMat * acRotMat * Cubes[i].rotMat * Cubes[i].transMat;
-
-        glm::mat4 mvMat = viewMat * modelMat * acRotMat * Cubes[i].rotMat * Cubes[i].transMat;
-        glm::mat4 normMat = glm::transpose(glm::inverse(mvMat));
-        glm::mat4 lightMat = viewMat;
-
-        // Uniform変数の転送
-        GLuint uid;
-        uid = glGetUniformLocation(programId, "u_mvpMat");
-        glUniformMatrix4fv(uid, 1, GL_FALSE, glm::value_ptr(mvpMat));
-
-        uid = glGetUniformLocation(programId, "u_mvMat");
-        glUniformMatrix4fv(uid, 1, GL_FALSE, glm::value_ptr(mvMat));
-        uid = glGetUniformLocation(programId, "u_normMat");
-        glUniformMatrix4fv(uid, 1, GL_FALSE, glm::value_ptr(normMat));
-        uid = glGetUniformLocation(programId, "u_lightMat");
-        glUniformMatrix4fv(uid, 1, GL_FALSE, glm::value_ptr(lightMat));
-
-
-        uid = glGetUniformLocation(programId, "u_cubeType");
-        glUniform1i(uid, selectMode ? Cubes[i].cubeType : -1);
-        uid = glGetUniformLocation(programId, "u_cubeID");
-        glUniform1i(uid, selectMode ? i : -1);
-
-
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, (void*)(36 * sizeof(uint32_t) * cubeIds2vao[i]));
-        //glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+        // 面ごとに、初期位置がその面にあるキューブを並べる (全ての面を描くキューブは除く)
+        int faceCounts[6];
+        partInstances.resize(exteriorBegin[6]);
+        for (int f = 0; f < 6; f++) {
+            int count = 0;
+            for (int k = exteriorBegin[f]; k < exteriorBegin[f + 1]; k++) {
+                const int c = exteriorCubies[k];
+                if (!turnCubieMarks[c]) partInstances[exteriorBegin[f] + count++] = cubeInstances[c];
+            }
+            faceCounts[f] = count;
+        }
+        for (int k = 0; k < turnCubies.size(); k++) {
+            partInstances.push_back(cubeInstances[turnCubies[k]]);
+            turnCubieMarks[turnCubies[k]] = 0;
+        }
+        const int turnCount = (int)turnCubies.size();
+
+        // インスタンスバッファの転送
+        {
+            FrameProfiler::Scope scope(profiler, PHASE_UPLOAD);
+            glBindBuffer(GL_ARRAY_BUFFER, instanceBufferId);
+            glBufferData(GL_ARRAY_BUFFER, sizeof(CubeInstance) * (exteriorBegin[6] + cubeState.numCubies()), NULL, GL_STREAM_DRAW);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(CubeInstance) * partInstances.size(), partInstances.data());
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+        FrameProfiler::Scope drawScope(profiler, PHASE_DRAW);
+
+        // 面ごとに、その面の2つの三角形だけを描画する
+        int faceTotal = 0;
+        for (int f = 0; f < 6; f++) {
+            glBindVertexArray(partVaoIds[f]);
+            glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, (void*)(sizeof(uint16_t) * 6 * f), faceCounts[f]);
+            faceTotal += faceCounts[f];
+        }
+        if (turnCount > 0) {
+            glBindVertexArray(partVaoIds[6]);
+            glDrawElementsInstanced(GL_TRIANGLES, MESH_BLOCK_INDICES, GL_UNSIGNED_SHORT, 0, turnCount);
+        }
+        drawnTriangles = 2LL * faceTotal + (long long)turnCount * MESH_BLOCK_INDICES / 3;
+    } else {
+        // インスタンスバッファの転送
+        {
+            FrameProfiler::Scope scope(profiler, PHASE_UPLOAD);
+            glBindBuffer(GL_ARRAY_BUFFER, instanceBufferId);
+            glBufferData(GL_ARRAY_BUFFER, sizeof(CubeInstance) * cubeInstances.size(), NULL, GL_STREAM_DRAW);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(CubeInstance) * cubeInstances.size(), cubeInstances.data());
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+        FrameProfiler::Scope drawScope(profiler, PHASE_DRAW);
+
+        // 全てのキューブを一回で描画する
+        glDrawElementsInstanced(GL_TRIANGLES, MESH_BLOCK_INDICES, GL_UNSIGNED_SHORT, 0, (GLsizei)cubeInstances.size());
+        drawnTriangles = (long long)cubeInstances.size() * MESH_BLOCK_INDICES / 3;
     }
 
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+
     // VAOの無効化
     glBindVertexArray(0);
 
@@ -692,135 +1036,92 @@ void resizeGL(GLFWwindow *window, int width, int height) {
 
 
 int pressKey = 0;
-CubePlane* selectedCubePlane;
-bool rotating = false;
-int axis = 0;
-bool rotateDir = true;
-
-void updateCubePlane(int axis, bool dir, CubePlane* selectedCubePlane) {
-    int count = 0;
-    for (auto itr = selectedCubePlane->cubeIds.begin(); itr != selectedCubePlane->cubeIds.end(); ++itr) {
-        count++;
-        int xn = Cubes[*itr].pn[0];
-        int yn = Cubes[*itr].pn[1];
-        int zn = Cubes[*itr].pn[2];
-
-        if (dir) {
-            if (axis == 0) {
-                yCubePlanes[yn].cubeIds.erase(*itr);
-                zCubePlanes[zn].cubeIds.erase(*itr);
-                yCubePlanes[N-1-zn].cubeIds.insert(*itr);
-                zCubePlanes[yn].cubeIds.insert(*itr);
-                Cubes[*itr].pn[1] = N-1-zn;
-                Cubes[*itr].pn[2] = yn;
-            } else if (axis == 1) {
-                zCubePlanes[zn].cubeIds.erase(*itr);
-                xCubePlanes[xn].cubeIds.erase(*itr);
-                zCubePlanes[N-1-xn].cubeIds.insert(*itr);
-                xCubePlanes[zn].cubeIds.insert(*itr);
-                Cubes[*itr].pn[2] = N-1-xn;
-                Cubes[*itr].pn[0] = zn;
-            } else {
-                xCubePlanes[xn].cubeIds.erase(*itr);
-                yCubePlanes[yn].cubeIds.erase(*itr);
-                xCubePlanes[N-1-yn].cubeIds.insert(*itr);
-                yCubePlanes[xn].cubeIds.insert(*itr);
-                Cubes[*itr].pn[0] = N-1-yn;
-                Cubes[*itr].pn[1] = xn;
-            }
-        } else {
-            if (axis == 0) {
-                yCubePlanes[yn].cubeIds.erase(*itr);
-                zCubePlanes[zn].cubeIds.erase(*itr);
-                yCubePlanes[zn].cubeIds.insert(*itr);
-                zCubePlanes[N-1-yn].cubeIds.insert(*itr);
-                Cubes[*itr].pn[1] = zn;
-                Cubes[*itr].pn[2] = N-1-yn;
-            } else if (axis == 1) {
-                zCubePlanes[zn].cubeIds.erase(*itr);
-                xCubePlanes[xn].cubeIds.erase(*itr);
-                zCubePlanes[xn].cubeIds.insert(*itr);
-                xCubePlanes[N-1-zn].cubeIds.insert(*itr);
-                Cubes[*itr].pn[2] = xn;
-                Cubes[*itr].pn[0] = N-1-zn;
-            } else {
-                xCubePlanes[xn].cubeIds.erase(*itr);
-                yCubePlanes[yn].cubeIds.erase(*itr);
-                xCubePlanes[yn].cubeIds.insert(*itr);
-                yCubePlanes[N-1-xn].cubeIds.insert(*itr);
-                Cubes[*itr].pn[0] = yn;
-                Cubes[*itr].pn[1] = N-1-xn;
-            }
-        }
+
+// 一回の90度の回転にかける時間 (秒)。順番待ちの操作が多い時は最大MAX_TURN_SPEEDUP倍まで速くする。
+static const double TURN_SECONDS = 0.15;
+static const int MAX_TURN_SPEEDUP = 8;
+
+// 平行な回転面の操作を同時に回すかどうか (Oキーで切り替える)
+bool overlapTurns = true;
+
+// 前回のアニメーションの更新時刻
+double lastAnimateTime = 0.0;
+
+// 操作をアニメーションなしで一度に回す
+void applyMoveInstantly(const CubeMove &move) {
+    cubeState.apply(move);
+    if (stickerRender) facelets.update(cubeState, move);
+}
+
+// アニメーション中の回転を全て終わらせる
+void finishActiveTurns() {
+    for (int i = 0; i < activeTurns.size(); i++) applyMoveInstantly(activeTurns[i].move);
+    activeTurns.clear();
+}
+
+// 今の回転と同時に始められるか (同じ軸の別の層なら、動くキューブが重ならない)
+bool canStartTurn(const CubeMove &move) {
+    if (activeTurns.empty()) return true;
+    if (!overlapTurns) return false;
+    for (int i = 0; i < activeTurns.size(); i++) {
+        if (activeTurns[i].move.axis != move.axis || activeTurns[i].move.layer == move.layer) return false;
     }
+    return true;
+}
+
+// 回転操作のアニメーションを始める
+void startTurn(const CubeMove &move, double start) {
+    ActiveTurn turn;
+    turn.move = move;
+    const int count = cubeState.sliceSize(move.axis, move.layer);
+    for (int k = 0; k < count; k++) turn.cubies.push_back(cubeState.sliceCubie(move.axis, move.layer, k));
+    const int speedup = std::min((int)pendingMoves.size() + 1, MAX_TURN_SPEEDUP);
+    turn.start = start;
+    turn.duration = TURN_SECONDS * (move.turns == 2 ? 1.5 : 1.0) / speedup;
+    turn.angle = 0.0f;
+    activeTurns.push_back(turn);
+    startedTurns++;
 }
 
 void rotateCubeByKey(int pressKey) {
     switch ((char)pressKey) {
         case 'R':
-            selectedCubePlane = &xCubePlanes[N-1];
-            rotating = true;
-            axis = 0;
-            rotateDir = true;
+            pendingMoves.push_back(CubeMove(0, N-1, 1));
             break;
 
         case 'L':
-            selectedCubePlane = &xCubePlanes[0];
-            rotating = true;
-            axis = 0;
-            rotateDir = false;
+            pendingMoves.push_back(CubeMove(0, 0, 3));
             break;
 
         case 'U':
-            selectedCubePlane = &yCubePlanes[N-1];
-            rotating = true;
-            axis = 1;
-            rotateDir = true;
+            pendingMoves.push_back(CubeMove(1, N-1, 1));
             break;
 
         case 'D':
-            selectedCubePlane = &yCubePlanes[0];
-            rotating = true;
-            axis = 1;
-            rotateDir = false;
+            pendingMoves.push_back(CubeMove(1, 0, 3));
             break;
 
         case 'F':
-            selectedCubePlane = &zCubePlanes[N-1];
-            rotating = true;
-            axis = 2;
-            rotateDir = true;
+            pendingMoves.push_back(CubeMove(2, N-1, 1));
             break;
 
         case 'B':
-            selectedCubePlane = &zCubePlanes[0];
-            rotating = true;
-            axis = 2;
-            rotateDir = false;
+            pendingMoves.push_back(CubeMove(2, 0, 3));
             break;
 
         case 'M':
             if (mode == 2) break;
-            selectedCubePlane = &xCubePlanes[N/2];
-            rotating = true;
-            axis = 0;
-            rotateDir = true;
+            pendingMoves.push_back(CubeMove(0, N/2, 1));
             break;
         
         case 'E':
             if (mode == 2) break;
-            selectedCubePlane = &yCubePlanes[N/2];
-            rotating = true;
-            axis = 1;
-            rotateDir = true;
+            pendingMoves.push_back(CubeMove(1, N/2, 1));
             break;
         
         case 'S':
             if (mode == 2) break;
-            selectedCubePlane = &zCubePlanes[N/2];
-            rotating = true;
-            axis = 2;
-            rotateDir = false;
+            pendingMoves.push_back(CubeMove(2, N/2, 3));
             break;
 
         default:
@@ -828,50 +1129,104 @@ void rotateCubeByKey(int pressKey) {
     }
 }
 
-void rotate(int axis, bool rotateDir, CubePlane* selectedCubePlane) {
-    glm::vec3 dir = rotateDir ? glm::vec3(1) : glm::vec3(-1);
-    for (auto itr = selectedCubePlane->cubeIds.begin(); itr != selectedCubePlane->cubeIds.end(); ++itr) {
-        Cubes[*itr].rotMat = glm::rotate((float)(90.0f * PI / 180.0f), selectedCubePlane->nv * dir) * Cubes[*itr].rotMat;
-    }
-    updateCubePlane(axis, rotateDir, selectedCubePlane);
-}
-
 void shuffleCube() {
+    finishActiveTurns();
     for (int i = 0; i < 10; i++) {
         int axis = rand() % 3;
         bool rotateDir = rand() % 2;
-        CubePlane* selectedCubePlane;
         int n = rand() % N;
-        if (axis == 0) {
-            selectedCubePlane = &xCubePlanes[n];
-        } else if (axis == 1) {
-            selectedCubePlane = &yCubePlanes[n];
-        } else {
-            selectedCubePlane = &zCubePlanes[n];
-        }
-
-        rotate(axis, rotateDir, selectedCubePlane);
+        applyMoveInstantly(CubeMove(axis, n, rotateDir ? 1 : 3));
     }
 }
 
 void resetCube() {
-    for (int i = 0; i < N; i++) {
-        xCubePlanes[i].cubeIds.clear();
-        yCubePlanes[i].cubeIds.clear();
-        zCubePlanes[i].cubeIds.clear();
+    cubeState.reset();
+    if (stickerRender) facelets.reset(cubeState);
+    pendingMoves.clear();
+    activeTurns.clear();
+    cubeAdjusts.clear();
+    profiler.cancelInput();
+}
+
+// 別のスレッドで求めた解
+struct SolveResult {
+    bool solved;
+    std::vector<CubeMove> moves;
+    ReductionStats stats;
+    double seconds;
+};
+
+// 求めている途中の解と、解き始めた時の状態 (大きなNでは表を作るのに数秒かかるので、描画を止めない)
+// 解くスレッドは切り離しておき、std::asyncの結果と違って、ウィンドウを閉じた時に解き終わるのを待たない (finishSolveOnExit)。
+std::future<SolveResult> solveTask;
+CubeState solveStart;
+
+// 3x3は二段階法、それ以外は還元法で解き始める (解はcollectSolutionで受け取り、アニメーションで回す)
+void solveCube() {
+    if (!activeTurns.empty() || !pendingMoves.empty()) return;
+    if (solveTask.valid()) {
+        printf("Solve: still solving\n");
+        return;
+    }
+    if (N != 3 && N > REDUCTION_MAX_N) {
+        printf("Solve: N = %d is too large (up to %d)\n", N, REDUCTION_MAX_N);
+        return;
+    }
+    if (mode == 1 && N > 1) {
+        // ソルバは色だけを揃えるので、形で向きが分かるセンターが回ったまま残る
+        printf("Solve: mirror blocks are not supported (centers would stay twisted)\n");
+        return;
     }
 
-    for (int i = 0; i < Cubes.size(); i++) {
-        Cubes[i].rotMat = glm::mat4(1.0);
-        glm::vec3 pn = (Cubes[i].position + glm::vec3(N-1)) * glm::vec3(0.5f);
-        int xn = (int)(pn.x);
-        int yn = (int)(pn.y);
-        int zn = (int)(pn.z);
-        xCubePlanes[xn].cubeIds.insert(i);
-        yCubePlanes[yn].cubeIds.insert(i);
-        zCubePlanes[zn].cubeIds.insert(i);
-        Cubes[i].pn = {xn, yn, zn};
+    solveStart = cubeState;
+    std::shared_ptr<std::promise<SolveResult> > promise = std::make_shared<std::promise<SolveResult> >();
+    solveTask = promise->get_future();
+    std::thread([promise](const CubeState &state) {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        SolveResult result;
+        result.solved = state.size() == 3 ? solveTwoPhase(state, TWO_PHASE_MAX_LENGTH, &result.moves)
+                                          : solveReduction(state, &result.moves, &result.stats);
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        promise->set_value(result);
+    }, cubeState).detach();
+}
+
+// 解いている途中で終わる時は、解くスレッドが使っている表を静的な変数の後片付けで消さないように、そのままプロセスを終える
+void finishSolveOnExit() {
+    if (!solveTask.valid() || solveTask.wait_for(std::chrono::seconds(0)) == std::future_status::ready) return;
+    printf("Solve: cancelled\n");
+    fflush(NULL);
+    _Exit(0);
+}
+
+// 解き終わっていれば、解の手順をアニメーションの待ち行列に入れる (メインループで毎フレーム呼ぶ)
+void collectSolution() {
+    if (!solveTask.valid() || solveTask.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return;
+
+    const SolveResult result = solveTask.get();
+    if (!result.solved) {
+        printf("Solve: failed\n");
+        return;
+    }
+    printf("Solve: %d moves (%.1f ms)\n", (int)result.moves.size(), result.seconds * 1000.0);
+    if (solveStart.size() != 3) {
+        printf("  orient %d, parity %d, centers %d, edges %d, 3x3 %d\n", result.stats.orientMoves, result.stats.parityMoves,
+               result.stats.centerMoves, result.stats.edgeMoves, result.stats.finishMoves);
     }
+
+    // 解いている間にキューブを動かしていたら、その解は使えない
+    if (!(cubeState == solveStart) || cubeState.mode() != solveStart.mode() || !activeTurns.empty() || !pendingMoves.empty()) {
+        printf("Solve: the cube was changed while solving\n");
+        return;
+    }
+    pendingMoves.insert(pendingMoves.end(), result.moves.begin(), result.moves.end());
+}
+
+// ステッカー描画モードの切り替え (切り替えた時に全てのステッカーを計算し直す)
+void changeRenderMode() {
+    stickerRender = !stickerRender;
+    if (stickerRender) facelets.reset(cubeState);
+    printf("Render: %s%s\n", stickerRender ? "stickers" : "cubies", stickerRender && !useStickerRender() ? " (cubies while mode != 0 or moved by hand)" : "");
 }
 
 void changeColorMode() {
@@ -880,11 +1235,10 @@ void changeColorMode() {
 }
 
 void initData() {
-    Cubes.clear();
-    xCubePlanes.clear();
-    yCubePlanes.clear();
-    zCubePlanes.clear();
     cubeIds2vao.clear();
+    pendingMoves.clear();
+    activeTurns.clear();
+    profiler.cancelInput();
 }
 
 void changeMode() {
@@ -892,18 +1246,46 @@ void changeMode() {
     if (mode > 2) mode = 0;
 
     initData();
-    // キューブの初期化
+    // キューブの初期化 (描画の資源は作ったことのある構成なら使い回す)
     initCube(N);
-    // VAOの初期化
-    initVAO();
+    useCubeResources();
 }
 
-void changeN(int pressKey) {
-    N = pressKey - 48;
+void changeN(int newN) {
+    N = newN;
 
     initData();
 
-    initializeGL();
+    // キューブの初期化 (描画の資源は作ったことのある構成なら使い回す)。カメラの距離はNで決まる
+    initCube(N);
+    useCubeResources();
+    resetCamera();
+    printf("N = %d (%d cubies)\n", N, cubeState.numCubies());
+}
+
+// Nの入力中に押されたキー
+void inputN(int key) {
+    if (key >= GLFW_KEY_KP_0 && key <= GLFW_KEY_KP_9) key = GLFW_KEY_0 + (key - GLFW_KEY_KP_0);
+
+    if (key >= GLFW_KEY_0 && key <= GLFW_KEY_9) {
+        if (enteredN.size() < 3) enteredN += (char)key;
+    } else if (key == GLFW_KEY_BACKSPACE) {
+        if (!enteredN.empty()) enteredN.erase(enteredN.size() - 1);
+    } else if (key == GLFW_KEY_ESCAPE) {
+        enteringN = false;
+        printf("N: canceled\n");
+        return;
+    } else if (key == GLFW_KEY_ENTER || key == GLFW_KEY_KP_ENTER) {
+        enteringN = false;
+        const int newN = atoi(enteredN.c_str());
+        if (newN < 1 || newN > MAX_N) {
+            printf("N: %s is out of range (1 - %d)\n", enteredN.c_str(), MAX_N);
+            return;
+        }
+        changeN(newN);
+        return;
+    }
+    printf("N: %s\n", enteredN.c_str());
 }
 
 void keyboardEvent(GLFWwindow *window, int key, int scancode, int action, int mods) {
@@ -914,9 +1296,30 @@ void keyboardEvent(GLFWwindow *window, int key, int scancode, int action, int mo
     if(action == GLFW_PRESS) {
         pressKey = key;
 
-        // 回転操作
-        if (!rotating) {
-            rotateCubeByKey(pressKey);
+        // Nの入力中は数字とEnter, Backspace, Escだけを扱う
+        if (enteringN) {
+            inputN(key);
+            return;
+        }
+
+        if ((char)pressKey == 'N') {
+            enteringN = true;
+            enteredN.clear();
+            printf("N: (type 1 - %d and press Enter)\n", MAX_N);
+            return;
+        }
+
+        // 回転操作 (回転中に押されたものも順番待ちに加える)。画面に出るまでの時間を測る
+        const size_t queuedMoves = pendingMoves.size();
+        rotateCubeByKey(pressKey);
+        if (pendingMoves.size() > queuedMoves && !profiler.waitingInput()) {
+            profiler.markInput(glfwGetTime());
+            inputTurn = startedTurns + (long long)pendingMoves.size();
+        }
+
+        if ((char)pressKey == 'O') {
+            overlapTurns = !overlapTurns;
+            printf("Overlap turns: %s\n", overlapTurns ? "on" : "off");
         }
 
         if ((char)pressKey == ' ') shuffleCube();
@@ -927,6 +1330,22 @@ void keyboardEvent(GLFWwindow *window, int key, int scancode, int action, int mo
 
         if ((char)pressKey == 'P') changeMode();
 
+        if ((char)pressKey == 'G') changeRenderMode();
+
+        if ((char)pressKey == 'H') {
+            hideInnerFaces = !hideInnerFaces;
+            printf("Hide inner faces: %s\n", hideInnerFaces ? "on" : "off");
+        }
+
+        if (pressKey == GLFW_KEY_ENTER) solveCube();
+
+        if ((char)pressKey == 'T') {
+            showProfile = !showProfile;
+            profiler.setEnabled(showProfile || profiler.isWriting());
+            if (!showProfile) glfwSetWindowTitle(window, WIN_TITLE);
+            printf("Frame profile: %s\n", showProfile ? "on" : "off");
+        }
+
     } else if (action == GLFW_RELEASE) {
         pressKey = 0;
     }
@@ -940,12 +1359,32 @@ void keyboardEvent(GLFWwindow *window, int key, int scancode, int action, int mo
         if ((mods & specialKeys[i]) != 0) {
             printf("%s ", specialKeyNames[i]);
 
-            if (i == 3 && pressKey >= 49 && pressKey <= 57) changeN(pressKey);
+            if (i == 3 && pressKey >= GLFW_KEY_1 && pressKey <= GLFW_KEY_9) changeN(pressKey - GLFW_KEY_0);
         }
     }
     printf("\n");
 }
 
+// ウィンドウ上の位置 (cx, cy) を通る視線と一番手前で交わるキューブとその面を求める
+bool pickCube(int cx, int cy, RayHit *hit) {
+    if (cubeState.numCubies() == 0) return false;
+
+    // 視線の近い端と遠い端を、キューブごとの変換の手前の座標 (アークボールの回転まで) に戻す
+    const glm::mat4 invMat = glm::inverse(projMat * viewMat * modelMat * acRotMat);
+    const float x = 2.0f * (cx + 0.5f) / WIN_WIDTH - 1.0f;
+    const float y = 1.0f - 2.0f * (cy + 0.5f) / WIN_HEIGHT;
+    glm::vec4 nearPos = invMat * glm::vec4(x, y, -1.0f, 1.0f);
+    glm::vec4 farPos = invMat * glm::vec4(x, y, 1.0f, 1.0f);
+    nearPos /= nearPos.w;
+    farPos /= farPos.w;
+    const glm::vec3 origin = glm::vec3(nearPos);
+    const glm::vec3 direction = glm::vec3(farPos) - origin;
+
+    updateCubeTransforms();
+    return pickRigidBoxes(glm::value_ptr(origin), glm::value_ptr(direction), cubeTransforms, cubeIds2vao.data(), glm::value_ptr(blockMin[0]),
+                          glm::value_ptr(blockMax[0]), hit);
+}
+
 void mouseEvent(GLFWwindow *window, int button, int action, int mods) {
     // クリックしたボタンで処理を切り替える
     if (button == GLFW_MOUSE_BUTTON_LEFT) {
@@ -977,29 +1416,21 @@ void mouseEvent(GLFWwindow *window, int button, int action, int mods) {
         const int cx = (int)px;
         const int cy = (int)py;  
 
-        // 選択モードでの描画
-        selectMode = true;
-        paintGL();
-        selectMode = false;
-        
-        // ピクセルの大きさの計算 (Macの場合には必要)
-        int renderBufferWidth, renderBufferHeight;
-        glfwGetFramebufferSize(window, &renderBufferWidth, &renderBufferHeight);
-        int pixelSize = std::max(renderBufferWidth / WIN_WIDTH, renderBufferHeight / WIN_HEIGHT);
-
-        // より適切なやり方
-        unsigned char byte[4];
-        glReadPixels(cx * pixelSize, (WIN_HEIGHT - cy - 1) * pixelSize, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, &byte);
+        // 選択の判定 (描画し直してピクセルを読むとGPUを待つので、CPUで光線とキューブの箱の交差を調べる)
+        const auto start = std::chrono::steady_clock::now();
+        RayHit hit;
+        const bool picked = pickCube(cx, cy, &hit);
+        const double micros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+        static const char *faceNames[6] = { "R", "U", "F", "B", "D", "L" };
         printf("Mouse position: %d %d\n", cx, cy);
-        printf("Select cube type %d\n", (int)byte[0]);
-        printf("Select cube id %d\n", (int)byte[1]);
-
-        if ((int)byte[0] == 1) {
-            selectedObj = &Cubes[(int)byte[1]];
-        } else if ((int)byte[0] == 2) {
-            selectedObj = &Cubes[(int)byte[1]];
-        } else if ((int)byte[0] == 3) {
-            selectedObj = &Cubes[(int)byte[1]];
+        if (picked) {
+            printf("Select cube type %d\n", cubeState.cubeType(hit.cubie));
+            printf("Select cube id %d, face %s (sticker %s), %.1f us\n", hit.cubie, faceNames[hit.face], faceNames[hit.sticker], micros);
+            selectedCubie = hit.cubie;
+        } else {
+            printf("Select nothing (%.1f us)\n", micros);
+            selectedCubie = -1;
         }
     }
 }
@@ -1042,13 +1473,20 @@ void updateRotate() {
 
     // 回転行列の更新
     if ((char)pressKey == 'W') {
-        selectedObj->rotMat = glm::rotate((float)(4.0f * angle), rotAxisObjSpace) * selectedObj->rotMat;
+        if (!hasSelectedCubie()) return;
+
+        // 今の向きでの回転をキューブの局所座標での回転に直して足す
+        CubeAdjust &adjust = cubeAdjusts[selectedCubie];
+        const glm::mat3 oriMat = orientationMatrix(cubeState.orientation(selectedCubie));
+        adjust.rotMat = glm::transpose(oriMat) * glm::mat3(glm::rotate((float)(4.0f * angle), rotAxisObjSpace)) * oriMat * adjust.rotMat;
     } else {
         acRotMat = glm::rotate((float)(4.0f * angle), rotAxisObjSpace) * acRotMat;
     }
 }
 
 void updateTranslate() {
+    if (!hasSelectedCubie()) return;
+
     // オブジェクト重心のスクリーン座標を求める
     glm::vec4 gravityScreenSpace = (projMat * viewMat * modelMat) * glm::vec4(gravity.x, gravity.y, gravity.z, 1.0f);
     gravityScreenSpace /= gravityScreenSpace.w;
@@ -1070,12 +1508,10 @@ void updateTranslate() {
     const glm::vec3 transObjSpace = glm::vec3(newPosObjSpace - oldPosObjSpace);
 
     // オブジェクト空間での平行移動
-    // selectedObj->acTransMat = glm::translate(selectedObj->acTransMat, transObjSpace);
-    selectedObj->transMat = glm::translate(selectedObj->transMat, transObjSpace);
+    cubeAdjusts[selectedCubie].offset += transObjSpace;
 }
 
 void updateScale() {
-    //selectedObj->acScaleMat = glm::scale(glm::vec3(acScale, acScale, acScale));
 }
 
 void updateMouse() {
@@ -1118,25 +1554,496 @@ void wheelEvent(GLFWwindow *window, double xpos, double ypos) {
     updateScale();
 }
 
-int rotateCount = 0;
 // 回転のアニメーションのためのアップデート
-void animateRotate() {
-    if (rotating) {
-        if (rotateCount < 9) {
-            glm::vec3 dir = rotateDir ? glm::vec3(1) : glm::vec3(-1);
-            for (auto itr = selectedCubePlane->cubeIds.begin(); itr != selectedCubePlane->cubeIds.end(); ++itr) {
-                Cubes[*itr].rotMat = glm::rotate((float)(10.0f * PI / 180.0f), selectedCubePlane->nv * dir) * Cubes[*itr].rotMat;
+// 前回からの間に終わった回転を順に適用し、続く操作はその終わった時刻から始める (フレームが遅くても手順の速さは変わらない)
+void animateRotate(double now) {
+    double clock = std::min(lastAnimateTime, now);
+    for (;;) {
+        while (!pendingMoves.empty() && canStartTurn(pendingMoves.front())) {
+            const CubeMove move = pendingMoves.front();
+            pendingMoves.pop_front();
+            startTurn(move, clock);
+        }
+
+        // 一番早く終わる回転が今より前に終わっていれば適用する
+        int first = -1;
+        for (int i = 0; i < activeTurns.size(); i++) {
+            if (first < 0 || activeTurns[i].start + activeTurns[i].duration < activeTurns[first].start + activeTurns[first].duration) first = i;
+        }
+        if (first < 0 || activeTurns[first].start + activeTurns[first].duration > now) break;
+
+        const ActiveTurn &turn = activeTurns[first];
+        clock = turn.start + turn.duration;
+        applyMoveInstantly(turn.move);
+        activeTurns.erase(activeTurns.begin() + first);
+    }
+    lastAnimateTime = now;
+
+    // 回転中のキューブは、開始時の整数の向きに経過時間の分の回転を掛けて表示する (updateCubeTransforms)
+    for (int i = 0; i < activeTurns.size(); i++) {
+        ActiveTurn &turn = activeTurns[i];
+        const double progress = std::max(0.0, std::min(1.0, (now - turn.start) / turn.duration));
+        const int quarters = turn.move.turns == 3 ? -1 : turn.move.turns;
+        turn.angle = (float)(quarters * 0.5 * PI * progress);
+    }
+}
+
+/*
+ヘッドレスモード
+ウィンドウを作らずに、1行に1つの崩し手順 (記法はmove_sequence.hのparseMoves) を揃った状態に施して描画し、画像に書き出す。
+-oならディレクトリに行の番号の名前 (000000.png, ...) でPNGを書き、-rなら全ての画像のRGBAを上の行から続けて書く ("-"なら標準出力)。
+読み戻しはPBOのリング (-pで数を指定) で行うので、glReadPixelsで描画を待たない。
+-gならステッカー描画モードで描く。
+使い方: ./main --headless [-n N] [-m モード] [-c 色モード] [-g] [-s 幅x高さ] [-p PBOの数] [-o ディレクトリ | -r ファイル] [ファイル]
+*/
+int runHeadless(int argc, char **argv) {
+    int width = 256, height = 256, ringSize = 3;
+    std::string outDirectory, rawPath, inputPath;
+    bool ok = true;
+    for (int i = 2; i < argc && ok; i++) {
+        const bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "-n") == 0 && hasValue) {
+            N = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-m") == 0 && hasValue) {
+            mode = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-c") == 0 && hasValue) {
+            outColorMode = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-g") == 0) {
+            stickerRender = true;
+        } else if (strcmp(argv[i], "-s") == 0 && hasValue) {
+            ok = sscanf(argv[++i], "%dx%d", &width, &height) == 2;
+        } else if (strcmp(argv[i], "-p") == 0 && hasValue) {
+            ringSize = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-o") == 0 && hasValue) {
+            outDirectory = argv[++i];
+        } else if (strcmp(argv[i], "-r") == 0 && hasValue) {
+            rawPath = argv[++i];
+        } else if (argv[i][0] != '-' && inputPath.empty()) {
+            inputPath = argv[i];
+        } else {
+            ok = false;
+        }
+    }
+    if (!ok || N < 1 || N > MAX_N || mode < 0 || mode > 2 || width < 1 || height < 1 || ringSize < 1 || outDirectory.empty() == rawPath.empty()) {
+        fprintf(stderr, "usage: %s --headless [-n N] [-m mode] [-c color mode] [-g] [-s WxH] [-p PBOs] [-o directory | -r raw file] [file]\n", argv[0]);
+        return 1;
+    }
+
+    std::ifstream file;
+    if (!inputPath.empty()) {
+        file.open(inputPath.c_str());
+        if (!file) {
+            fprintf(stderr, "Failed to open file: %s\n", inputPath.c_str());
+            return 1;
+        }
+    }
+    std::istream &input = inputPath.empty() ? std::cin : file;
+
+    FILE *rawFile = NULL;
+    if (!rawPath.empty()) {
+        rawFile = rawPath == "-" ? stdout : fopen(rawPath.c_str(), "wb");
+        if (rawFile == NULL) {
+            fprintf(stderr, "Failed to open file: %s\n", rawPath.c_str());
+            return 1;
+        }
+    }
+
+    if (!createHeadlessContext()) return 1;
+    // 標準出力は画像に使うかもしれないので、情報は標準エラー出力に出す
+    fprintf(stderr, "Load OpenGL %s (%s)\n", (const char *)glGetString(GL_VERSION), (const char *)glGetString(GL_RENDERER));
+
+    WIN_WIDTH = width;
+    WIN_HEIGHT = height;
+    initializeGL();
+
+    int errors = 0;
+    {
+        OffscreenTarget target(width, height, ringSize);
+        if (!target.isComplete()) {
+            fprintf(stderr, "Failed to create a framebuffer (%dx%d)\n", width, height);
+            destroyHeadlessContext();
+            return 1;
+        }
+        target.bind();
+
+        // 取り出した画像を書き出す (画像は下の行から並んでいる)
+        const size_t stride = (size_t)width * 4;
+        const OffscreenTarget::Callback write = [&](const unsigned char *rgba, long long index) {
+            if (rawFile != NULL) {
+                for (int y = height - 1; y >= 0; y--) fwrite(rgba + stride * y, 1, stride, rawFile);
+                return;
+            }
+            char name[32];
+            snprintf(name, sizeof(name), "/%06lld.png", index);
+            if (!writePNG(outDirectory + name, width, height, rgba, true)) {
+                fprintf(stderr, "Failed to write image: %s%s\n", outDirectory.c_str(), name);
+                errors++;
+            }
+        };
+
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        long long lineCount = 0, imageCount = 0;
+        std::string line;
+        while (std::getline(input, line)) {
+            const long long index = lineCount++;
+            std::vector<CubeMove> moves;
+            std::string error;
+            if (!parseMoves(line, N, &moves, &error)) {
+                fprintf(stderr, "Line %lld: %s\n", index + 1, error.c_str());
+                errors++;
+                continue;
+            }
+
+            resetCube();
+            for (int i = 0; i < moves.size(); i++) applyMoveInstantly(moves[i]);
+            paintGL();
+            target.readback(index, write);
+            imageCount++;
+        }
+        target.finish(write);
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        fprintf(stderr, "Rendered: %lld images (%dx%d) in %.3f s (%.1f images/s, %d PBOs, %d errors)\n", imageCount, width, height, seconds,
+                seconds > 0 ? imageCount / seconds : 0.0, ringSize, errors);
+    }
+
+    if (rawFile != NULL && rawFile != stdout) fclose(rawFile);
+    releaseGL();
+    destroyHeadlessContext();
+    return errors == 0 ? 0 : 1;
+}
+
+/*
+フレーム時間のベンチマーク
+ウィンドウを作らずに、Nを変えながら面を回し続けるアニメーションを描画し、1フレームの時間を測る。
+CPU: paintGLとアニメーションの更新の時間、frame: glFinishでGPUの描画が終わるまで待った時間 (どちらも中央値、p95はframeの95パーセンタイル)
+ソフトウェア描画 (Mesaのllvmpipe) では頂点シェーダが描画命令の中で動くので、CPUの時間にも含まれる。
+gpu: GL_TIME_ELAPSEDのクエリで測ったGPUの時間 (中央値、llvmpipeでは描画がクエリの外で行われるのでほぼ0)。-pならフレームごとの区間の時間をCSVに書き出す (最初の数フレームは除く)。
+-gならステッカー描画モードで描き、-aなら隠れた面も全て描く。triangles: 最後のフレームで描いた三角形の数
+使い方: ./main --bench [-m モード] [-c 色モード] [-g] [-a] [-s 幅x高さ] [-f フレーム数] [-p ファイル] [N ...]
+*/
+int runFrameBenchmark(int argc, char **argv) {
+    int width = 500, height = 500, frames = 120;
+    std::vector<int> sizes;
+    std::string csvPath;
+    bool ok = true;
+    for (int i = 2; i < argc && ok; i++) {
+        const bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "-m") == 0 && hasValue) {
+            mode = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-c") == 0 && hasValue) {
+            outColorMode = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-g") == 0) {
+            stickerRender = true;
+        } else if (strcmp(argv[i], "-a") == 0) {
+            hideInnerFaces = false;
+        } else if (strcmp(argv[i], "-s") == 0 && hasValue) {
+            ok = sscanf(argv[++i], "%dx%d", &width, &height) == 2;
+        } else if (strcmp(argv[i], "-f") == 0 && hasValue) {
+            frames = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-p") == 0 && hasValue) {
+            csvPath = argv[++i];
+        } else if (argv[i][0] != '-') {
+            sizes.push_back(atoi(argv[i]));
+            ok = sizes.back() >= 1 && sizes.back() <= MAX_N;
+        } else {
+            ok = false;
+        }
+    }
+    if (!ok || mode < 0 || mode > 2 || width < 1 || height < 1 || frames < 1) {
+        fprintf(stderr, "usage: %s --bench [-m mode] [-c color mode] [-g] [-a] [-s WxH] [-f frames] [-p csv] [N ...]\n", argv[0]);
+        return 1;
+    }
+    if (sizes.empty()) {
+        const int defaultSizes[] = { 3, 4, 5, 6, 8, 12, 16, 24, 32, 48, 64 };
+        sizes.assign(defaultSizes, defaultSizes + sizeof(defaultSizes) / sizeof(defaultSizes[0]));
+    }
+
+    if (!csvPath.empty() && !profiler.openCsv(csvPath)) return 1;
+    profiler.setEnabled(true);
+
+    if (!createHeadlessContext()) return 1;
+    fprintf(stderr, "Load OpenGL %s (%s)\n", (const char *)glGetString(GL_VERSION), (const char *)glGetString(GL_RENDERER));
+
+    WIN_WIDTH = width;
+    WIN_HEIGHT = height;
+    {
+        OffscreenTarget target(width, height, 1);
+        if (!target.isComplete()) {
+            fprintf(stderr, "Failed to create a framebuffer (%dx%d)\n", width, height);
+            destroyHeadlessContext();
+            return 1;
+        }
+
+        printf("Frame time (%dx%d, mode %d, color mode %d, %s, %d frames)\n", width, height, mode, outColorMode,
+               useStickerRender() ? "stickers" : useHiddenFaceCulling() ? "cubies, outer faces" : "cubies, all faces", frames);
+        printf("%5s %8s %10s %10s %10s %10s %10s %8s\n", "N", "cubies", "triangles", "cpu ms", "gpu ms", "frame ms", "p95 ms", "fps");
+        for (int k = 0; k < sizes.size(); k++) {
+            N = sizes[k];
+            initData();
+            initializeGL();
+            shuffleCube();
+            target.bind();
+
+            // 60fpsの時計で外側の面を順に回し続ける (最初の数フレームは測らない)
+            const int warmup = 5;
+            double clock = 0.0;
+            lastAnimateTime = clock;
+            std::vector<double> cpuTimes, frameTimes;
+            profiler.reset();
+            for (int f = 0; f < warmup + frames; f++) {
+                if (pendingMoves.empty() && activeTurns.empty()) pendingMoves.push_back(CubeMove(f % 3, N - 1, 1));
+                clock += 1.0 / 60.0;
+                if (f >= warmup) profiler.beginFrame();
+
+                const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                profiler.beginGpu();
+                {
+                    FrameProfiler::Scope scope(profiler, PHASE_DRAW);
+                    paintGL();
+                }
+                profiler.endGpu();
+                {
+                    FrameProfiler::Scope scope(profiler, PHASE_ANIMATE);
+                    animateRotate(clock);
+                }
+                const std::chrono::steady_clock::time_point submitted = std::chrono::steady_clock::now();
+                {
+                    FrameProfiler::Scope scope(profiler, PHASE_SWAP);
+                    glFinish();
+                }
+                const std::chrono::steady_clock::time_point finished = std::chrono::steady_clock::now();
+                profiler.endFrame();
+                if (f < warmup) continue;
+                cpuTimes.push_back(std::chrono::duration<double, std::milli>(submitted - start).count());
+                frameTimes.push_back(std::chrono::duration<double, std::milli>(finished - start).count());
             }
-            rotateCount++;
+
+            std::sort(cpuTimes.begin(), cpuTimes.end());
+            std::sort(frameTimes.begin(), frameTimes.end());
+            const double frameMedian = frameTimes[frameTimes.size() / 2];
+            profiler.flush();
+            printf("%5d %8d %10lld %10.3f %10.3f %10.3f %10.3f %8.1f\n", N, cubeState.numCubies(), drawnTriangles, cpuTimes[cpuTimes.size() / 2],
+                   profiler.gpuPercentile(50.0), frameMedian, frameTimes[frameTimes.size() * 95 / 100], 1000.0 / frameMedian);
+            fflush(stdout);
+        }
+    }
+
+    releaseGL();
+    profiler.closeCsv();
+    destroyHeadlessContext();
+    return 0;
+}
+
+/*
+マイクロベンチマーク
+ウィンドウを作らずに、モデルと描画の小さな処理を1つずつ、N = 1 ~ 9とモードごとに測る (時間は1回あたりのナノ秒)。
+apply_move: 外側の面の1回転 (applyMoveInstantly)、shuffle: shuffleCube、init_cube: initCube、
+build_mesh: ブロックのメッシュの生成、init_vao: initVAO (作った資源はその都度消す)、
+transforms: キューブごとの変換行列 (updateCubeTransforms + composeRigidTransforms)、
+paint: paintGLの描画命令の発行まで (GPUの描画はglFinishで待つが、時間に含めない)、paint_stickers: ステッカー描画モードのpaintGL。
+最後にソルバなどの処理 (pick, facelets_update, parse_moves, compiled_apply, cubie_move, two_phase_solve, reduction_solve) を測る。
+処理ごとに-w回捨ててから-r回測り、中央値とMADを表にする。-oならJSONにも書き出す ("-"なら標準出力で、表は標準エラー出力)。
+JSONには日時などを入れないので、ビルドの前後の結果をそのままdiffできる。フィルタを付ければ、名前とパラメータにそれを含む処理だけを測る。
+使い方: ./main --microbench [-w 捨てる回数] [-r 測る回数] [-t 1回の測定の秒数] [-o ファイル] [フィルタ]
+*/
+int runMicroBenchmark(int argc, char **argv) {
+    int warmup = 3, repetitions = 15;
+    double sampleSeconds = 0.01;
+    std::string jsonPath, filter;
+    bool ok = true;
+    for (int i = 2; i < argc && ok; i++) {
+        const bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "-w") == 0 && hasValue) {
+            warmup = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-r") == 0 && hasValue) {
+            repetitions = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-t") == 0 && hasValue) {
+            sampleSeconds = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-o") == 0 && hasValue) {
+            jsonPath = argv[++i];
+        } else if (argv[i][0] != '-' && filter.empty()) {
+            filter = argv[i];
         } else {
-            updateCubePlane(axis, rotateDir, selectedCubePlane);
-            rotateCount = 0;
-            rotating = false;
+            ok = false;
         }
     }
+    if (!ok || warmup < 0 || repetitions < 1 || sampleSeconds <= 0.0) {
+        fprintf(stderr, "usage: %s --microbench [-w warmup] [-r repetitions] [-t sample seconds] [-o json] [filter]\n", argv[0]);
+        return 1;
+    }
+
+    if (!createHeadlessContext()) return 1;
+    fprintf(stderr, "Load OpenGL %s (%s)\n", (const char *)glGetString(GL_VERSION), (const char *)glGetString(GL_RENDERER));
+
+    // 乱数の種を決めて、何度測っても同じ状態を使う
+    srand(1);
+    MicroBenchSuite suite(warmup, repetitions, sampleSeconds, jsonPath == "-" ? stderr : stdout);
+    suite.setFilter(filter);
+    {
+        OffscreenTarget target(WIN_WIDTH, WIN_HEIGHT, 1);
+        if (!target.isComplete()) {
+            fprintf(stderr, "Failed to create a framebuffer (%dx%d)\n", WIN_WIDTH, WIN_HEIGHT);
+            destroyHeadlessContext();
+            return 1;
+        }
+        target.bind();
+        const std::function<void()> waitGpu = []() { glFinish(); };
+
+        for (mode = 0; mode <= 2; mode++) {
+            for (N = 1; N <= 9; N++) {
+                char params[32];
+                snprintf(params, sizeof(params), "N=%d mode=%d", N, mode);
+                initData();
+                initializeGL();
+                shuffleCube();
+
+                int turn = 0;
+                suite.run("apply_move", params, [&]() {
+                    applyMoveInstantly(CubeMove(turn % 3, turn / 3 % 2 == 0 ? 0 : N - 1, 1));
+                    turn++;
+                });
+                suite.run("shuffle", params, []() { shuffleCube(); });
+                suite.run("init_cube", params, []() {
+                    cubeIds2vao.clear();
+                    initCube(N);
+                });
+                suite.run("build_mesh", params, []() {
+                    CubeMesh mesh;
+                    buildCubeMesh(N, mode, glm::value_ptr(colors[0]), &mesh);
+                });
+                suite.run("init_vao", params, []() {
+                    CubeResources res;
+                    initVAO();
+                    storeCubeResources(&res);
+                    deleteCubeResources(res);
+                }, waitGpu);
+                // init_vaoで今の資源を消したので、覚えてある資源に戻す
+                useCubeResources();
+
+                suite.run("transforms", params, []() {
+                    const glm::mat4 prefixMat = viewMat * modelMat * acRotMat;
+                    updateCubeTransforms();
+                    cubeInstances.resize(cubeState.numCubies());
+                    composeRigidTransforms(glm::value_ptr(prefixMat), cubeTransforms, glm::value_ptr(cubeInstances[0].mvMat),
+                                           sizeof(CubeInstance) / sizeof(float));
+                });
+                suite.run("paint", params, []() { paintGL(); }, waitGpu);
+                if (mode == 0) {
+                    stickerRender = true;
+                    facelets.reset(cubeState);
+                    suite.run("paint_stickers", params, []() { paintGL(); }, waitGpu);
+                    stickerRender = false;
+                }
+            }
+        }
+        mode = 0;
+
+        // 光線とキューブの交差 (ウィンドウの中央)
+        for (N = 3; N <= 9; N += 3) {
+            char params[32];
+            snprintf(params, sizeof(params), "N=%d", N);
+            initData();
+            initializeGL();
+            shuffleCube();
+            suite.run("pick", params, []() {
+                RayHit hit;
+                pickCube(WIN_WIDTH / 2, WIN_HEIGHT / 2, &hit);
+            });
+        }
+
+        // ステッカーの色の更新 (1回転ごと)
+        for (N = 3; N <= 9; N += 3) {
+            char params[32];
+            snprintf(params, sizeof(params), "N=%d", N);
+            initData();
+            initCube(N);
+            facelets.reset(cubeState);
+            int turn = 0;
+            suite.run("facelets_update", params, [&]() {
+                const CubeMove move(turn % 3, turn / 3 % 2 == 0 ? 0 : N - 1, 1);
+                cubeState.apply(move);
+                facelets.update(cubeState, move);
+                turn++;
+            });
+        }
+
+        // 手順の記法の読み込み
+        const std::string bigAlgorithm = "3Rw 4Uw' 3R U2 L' 2D B' (3Rw U)3 x y";
+        std::vector<CubeMove> parsed;
+        suite.run("parse_moves", "N=3", [&]() { parseMoves("R U R' U' R' F R2 U' R' U' R U R' F' (M2 U)2 x y' z2", 3, &parsed); });
+        suite.run("parse_moves", "N=9", [&]() { parseMoves(bigAlgorithm, 9, &parsed); });
+
+        // まとめた置換を状態に施す (上の9x9の手順1つ分)
+        parseMoves(bigAlgorithm, 9, &parsed);
+        const CompiledMoves compiled(9, 0, parsed);
+        CubeState compiledState(9, 0);
+        suite.run("compiled_apply", "N=9", [&]() { compiled.applyTo(&compiledState); });
+
+        // 角と辺の表現での面の回転
+        CubieCube cubie;
+        int face = 0;
+        suite.run("cubie_move", "N=3", [&]() {
+            cubie.move(face);
+            face = (face + 1) % 18;
+        });
+
+        // ソルバ (表の作成は測らない。崩した状態は乱数の種で決まる)
+        if (suite.selected("two_phase_solve", "N=3")) {
+            N = 3;
+            initData();
+            initCube(N);
+            shuffleCube();
+            initTwoPhaseTables();
+            const CubeState scrambled = cubeState;
+            std::vector<CubeMove> moves;
+            suite.run("two_phase_solve", "N=3", [&]() { solveTwoPhase(scrambled, TWO_PHASE_MAX_LENGTH, &moves); });
+        }
+        for (N = 4; N <= 5; N++) {
+            char params[32];
+            snprintf(params, sizeof(params), "N=%d", N);
+            if (!suite.selected("reduction_solve", params)) continue;
+            initData();
+            initCube(N);
+            shuffleCube();
+            initReductionTables(N, mode);
+            const CubeState scrambled = cubeState;
+            std::vector<CubeMove> moves;
+            suite.run("reduction_solve", params, [&]() { solveReduction(scrambled, &moves); });
+        }
+    }
+
+    releaseGL();
+    destroyHeadlessContext();
+    return jsonPath.empty() || suite.writeJson(jsonPath) ? 0 : 1;
 }
 
+// 計測した時間の要約をウィンドウのタイトルに出す (0.5秒ごと)
+void updateProfileTitle(GLFWwindow *window) {
+    const double now = glfwGetTime();
+    if (!showProfile || now - lastProfileTitleTime < 0.5) return;
+    lastProfileTitleTime = now;
+
+    const std::string title = std::string(WIN_TITLE) + " | " + profiler.summary();
+    glfwSetWindowTitle(window, title.c_str());
+}
+
+/*
+使い方: ./main [--profile ファイル]
+--profileならフレームごとの区間の時間 (ミリ秒)、GPUの時間、入力の遅延をCSVに書き出す (列はframe_profiler.cppのopenCsv)。
+*/
 int main(int argc, char **argv) {
+    // ウィンドウを作らずに画像を書き出す
+    if (argc > 1 && strcmp(argv[1], "--headless") == 0) return runHeadless(argc, argv);
+    // ウィンドウを作らずにNごとのフレーム時間を測る
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0) return runFrameBenchmark(argc, argv);
+    // ウィンドウを作らずにモデルと描画の小さな処理の時間を測る
+    if (argc > 1 && strcmp(argv[1], "--microbench") == 0) return runMicroBenchmark(argc, argv);
+    // フレームの時間をCSVに書き出す
+    if (argc > 2 && strcmp(argv[1], "--profile") == 0) {
+        if (!profiler.openCsv(argv[2])) return 1;
+        profiler.setEnabled(true);
+    }
 
     srand((unsigned int)time(NULL));
 
@@ -1187,15 +2094,45 @@ int main(int argc, char **argv) {
     // OpenGLを初期化
     initializeGL();
 
-    // メインループ
+    // メインループ (区間ごとの時間を測る。測っていない時は何もしない)
     while (glfwWindowShouldClose(window) == GL_FALSE) {
-        // 描画
-        paintGL();
+        profiler.beginFrame();
+
+        // 描画 (キー入力の回転を始めていれば、このフレームで画面に出る)
+        const bool inputDrawn = profiler.waitingInput() && startedTurns >= inputTurn;
+        profiler.beginGpu();
+        {
+            FrameProfiler::Scope scope(profiler, PHASE_DRAW);
+            paintGL();
+        }
+        profiler.endGpu();
 
-        animateRotate();
+        {
+            FrameProfiler::Scope scope(profiler, PHASE_ANIMATE);
+            collectSolution();
+            animateRotate(glfwGetTime());
+        }
 
         // 描画用バッファの切り替え
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        {
+            FrameProfiler::Scope scope(profiler, PHASE_SWAP);
+            glfwSwapBuffers(window);
+        }
+        if (inputDrawn) profiler.inputShown(glfwGetTime());
+
+        {
+            FrameProfiler::Scope scope(profiler, PHASE_EVENTS);
+            glfwPollEvents();
+        }
+
+        profiler.endFrame();
+        updateProfileTitle(window);
     }
+
+    // OpenGLの資源を消す (保留中の計測も書き出す)
+    releaseGL();
+    profiler.closeCsv();
+    glfwTerminate();
+    finishSolveOnExit();
+    return 0;
 }
@@ -0,0 +1,102 @@
+#include "micro_bench.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+typedef std::chrono::steady_clock Clock;
+
+static double elapsedNs(const Clock::time_point &start) {
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+// 中央値 (valuesは並べ替える)
+static double median(std::vector<double> &values) {
+    std::sort(values.begin(), values.end());
+    const size_t n = values.size();
+    return n % 2 == 1 ? values[n / 2] : 0.5 * (values[n / 2 - 1] + values[n / 2]);
+}
+
+// JSONの文字列 (名前とパラメータには制御文字を使わないので、"と\だけを逃がす)
+static std::string jsonString(const std::string &s) {
+    std::string out = "\"";
+    for (size_t i = 0; i < s.size(); i++) {
+        if (s[i] == '"' || s[i] == '\\') out += '\\';
+        out += s[i];
+    }
+    return out + "\"";
+}
+
+MicroBenchSuite::MicroBenchSuite(int warmup_, int repetitions_, double sampleSeconds_, FILE *log_)
+    : warmup(warmup_)
+    , repetitions(std::max(1, repetitions_))
+    , sampleSeconds(sampleSeconds_)
+    , log(log_) {
+    fprintf(log, "%-20s %-16s %8s %14s %12s %7s\n", "name", "params", "batch", "median ns", "MAD ns", "MAD %");
+}
+
+bool MicroBenchSuite::selected(const std::string &name, const std::string &params) const {
+    return filter.empty() || (name + " " + params).find(filter) != std::string::npos;
+}
+
+void MicroBenchSuite::run(const std::string &name, const std::string &params, const std::function<void()> &fn,
+                          const std::function<void()> &setup) {
+    if (!selected(name, params)) return;
+
+    for (int i = 0; i < warmup; i++) {
+        if (setup) setup();
+        fn();
+    }
+
+    // 1回の時間からbatchを決める
+    if (setup) setup();
+    Clock::time_point start = Clock::now();
+    fn();
+    const double onceNs = std::max(1.0, elapsedNs(start));
+    const long long batch = std::max(1LL, std::min(1LL << 20, (long long)(sampleSeconds * 1e9 / onceNs)));
+
+    std::vector<double> samples;
+    for (int r = 0; r < repetitions; r++) {
+        if (setup) setup();
+        start = Clock::now();
+        for (long long b = 0; b < batch; b++) fn();
+        samples.push_back(elapsedNs(start) / batch);
+    }
+
+    MicroBenchResult result;
+    result.name = name;
+    result.params = params;
+    result.repetitions = repetitions;
+    result.batch = batch;
+    result.minNs = *std::min_element(samples.begin(), samples.end());
+    result.medianNs = median(samples);
+    std::vector<double> deviations;
+    for (size_t i = 0; i < samples.size(); i++) deviations.push_back(std::fabs(samples[i] - result.medianNs));
+    result.madNs = median(deviations);
+    resultList.push_back(result);
+
+    fprintf(log, "%-20s %-16s %8lld %14.1f %12.1f %6.1f%%\n", name.c_str(), params.c_str(), batch, result.medianNs, result.madNs,
+            100.0 * result.madNs / result.medianNs);
+    fflush(log);
+}
+
+bool MicroBenchSuite::writeJson(const std::string &path) const {
+    FILE *fp = path == "-" ? stdout : fopen(path.c_str(), "w");
+    if (fp == NULL) {
+        fprintf(stderr, "Failed to open file: %s\n", path.c_str());
+        return false;
+    }
+
+    fprintf(fp, "{\n  \"warmup\": %d,\n  \"repetitions\": %d,\n  \"sample_seconds\": %g,\n  \"results\": [\n", warmup, repetitions, sampleSeconds);
+    for (size_t i = 0; i < resultList.size(); i++) {
+        const MicroBenchResult &r = resultList[i];
+        fprintf(fp, "    {\"name\": %s, \"params\": %s, \"batch\": %lld, \"median_ns\": %.1f, \"mad_ns\": %.1f, \"min_ns\": %.1f}%s\n",
+                jsonString(r.name).c_str(), jsonString(r.params).c_str(), r.batch, r.medianNs, r.madNs, r.minNs,
+                i + 1 < resultList.size() ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+
+    const bool ok = fp == stdout ? fflush(fp) == 0 : fclose(fp) == 0;
+    if (!ok) fprintf(stderr, "Failed to write file: %s\n", path.c_str());
+    return ok;
+}
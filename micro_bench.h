@@ -0,0 +1,54 @@
+#ifndef _MICRO_BENCH_H_
+#define _MICRO_BENCH_H_
+
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+// 1つの処理の測定結果 (時間は1回あたりのナノ秒)
+struct MicroBenchResult {
+    std::string name;
+    std::string params;
+    int repetitions;
+    long long batch;
+    double medianNs;
+    double madNs;
+    double minNs;
+};
+
+/*
+MicroBenchSuite
+小さな処理の時間を安定して測る。
+処理ごとに、まずwarmup回動かして捨て (キャッシュや遅延初期化の影響を除く)、その後repetitions回測って
+1回あたりの時間の中央値と中央絶対偏差 (MAD、|x - 中央値| の中央値) を求める。外れ値に強いので、ビルドの間の比較に使える。
+1回が短すぎる処理は、1つの測定の中でbatch回くり返して平均する (batchは1つの測定が約sampleSeconds秒になるように最初に決める)。
+結果は表としてlogに出し、writeJsonでJSONに書き出す (同じ名前とパラメータの行どうしをdiffすればよい)。
+*/
+class MicroBenchSuite {
+public:
+    MicroBenchSuite(int warmup_, int repetitions_, double sampleSeconds_, FILE *log_);
+
+    // 名前とパラメータ ("名前 パラメータ") にfilterを含む処理だけを測る (空なら全て)
+    void setFilter(const std::string &filter_) { filter = filter_; }
+    bool selected(const std::string &name, const std::string &params) const;
+
+    // fnの時間を測る。setupは測定 (batch回) の前に毎回呼び、時間に含めない
+    void run(const std::string &name, const std::string &params, const std::function<void()> &fn,
+             const std::function<void()> &setup = std::function<void()>());
+
+    const std::vector<MicroBenchResult> &results() const { return resultList; }
+
+    // 結果をJSONで書き出す ("-"なら標準出力)
+    bool writeJson(const std::string &path) const;
+
+private:
+    int warmup;
+    int repetitions;
+    double sampleSeconds;
+    FILE *log;
+    std::string filter;
+    std::vector<MicroBenchResult> resultList;
+};
+
+#endif  // _MICRO_BENCH_H_
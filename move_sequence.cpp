@@ -0,0 +1,244 @@
+#include "move_sequence.h"
+
+#include <cctype>
+#include <cstdio>
+
+// 面の文字 -> (軸, 軸の正の側か)。正の側の面は時計回りが軸周りの-90度になる。
+static bool faceAxis(char c, int *axis, bool *positive) {
+    switch (c) {
+        case 'R': *axis = 0; *positive = true; return true;
+        case 'L': *axis = 0; *positive = false; return true;
+        case 'U': *axis = 1; *positive = true; return true;
+        case 'D': *axis = 1; *positive = false; return true;
+        case 'F': *axis = 2; *positive = true; return true;
+        case 'B': *axis = 2; *positive = false; return true;
+        default: return false;
+    }
+}
+
+static bool setError(std::string *error, size_t pos, const char *message) {
+    if (error != NULL) {
+        char buf[128];
+        snprintf(buf, sizeof(buf), "%s at column %d", message, (int)pos + 1);
+        *error = buf;
+    }
+    return false;
+}
+
+// 数字の並びを全て読む (MAX_NUMBERを超える場合は-1を返す)
+static const int MAX_NUMBER = 1000000;
+
+static int parseNumber(const std::string &text, size_t *i, int defaultValue) {
+    if (*i >= text.size() || !isdigit((unsigned char)text[*i])) return defaultValue;
+    int n = 0;
+    for (; *i < text.size() && isdigit((unsigned char)text[*i]); (*i)++) {
+        if (n >= 0) n = n * 10 + (text[*i] - '0');
+        if (n > MAX_NUMBER) n = -1;
+    }
+    return n;
+}
+
+static void appendInverse(const std::vector<CubeMove> &moves, std::vector<CubeMove> *out) {
+    for (int i = (int)moves.size() - 1; i >= 0; i--) out->push_back(CubeMove(moves[i].axis, moves[i].layer, 4 - moves[i].turns));
+}
+
+// 一つの操作を読む
+static bool parseMove(const std::string &text, size_t *i, int N, std::vector<CubeMove> *moves, std::string *error) {
+    const size_t start = *i;
+    const int prefix = parseNumber(text, i, 0);
+    if (prefix < 0) return setError(error, start, "layer out of range");
+    if (*i >= text.size()) return setError(error, start, "missing move");
+
+    const char c = text[*i];
+    int axis = 0;
+    bool positive = true;
+    int first = 0, last = 0;  // 外側から数えた層の範囲 (0始まり)
+    if (faceAxis(c, &axis, &positive) || faceAxis((char)toupper((unsigned char)c), &axis, &positive)) {
+        (*i)++;
+        bool wide = islower((unsigned char)c) != 0;
+        if (!wide && *i < text.size() && text[*i] == 'w') {
+            wide = true;
+            (*i)++;
+        }
+        const int n = prefix > 0 ? prefix : wide ? 2 : 1;
+        if (n > N) return setError(error, start, "layer out of range");
+        first = wide ? 0 : n - 1;
+        last = n - 1;
+    } else if (c == 'M' || c == 'E' || c == 'S') {
+        (*i)++;
+        if (prefix > 0) return setError(error, start, "unexpected layer number");
+        if (N % 2 == 0) return setError(error, start, "no middle layer");
+        // MはL、EはD、SはFと同じ向き
+        axis = c == 'M' ? 0 : c == 'E' ? 1 : 2;
+        positive = c == 'S';
+        first = last = N / 2;
+    } else if (c == 'x' || c == 'y' || c == 'z') {
+        (*i)++;
+        if (prefix > 0) return setError(error, start, "unexpected layer number");
+        axis = c - 'x';
+        positive = true;
+        first = 0;
+        last = N - 1;
+    } else {
+        return setError(error, start, "unknown move");
+    }
+
+    const size_t countStart = *i;
+    int amount = parseNumber(text, i, 1);
+    if (amount < 0) return setError(error, countStart, "repeat count too large");
+    amount %= 4;
+    if (*i < text.size() && text[*i] == '\'') {
+        amount = (4 - amount) % 4;
+        (*i)++;
+    }
+    if (amount == 0) return true;
+
+    // 正の側の面から数えたk番目の層は N - 1 - k になる
+    for (int k = first; k <= last; k++) {
+        moves->push_back(CubeMove(axis, positive ? N - 1 - k : k, positive ? 4 - amount : amount));
+    }
+    return true;
+}
+
+// 括弧の中身 (depth = 0なら全体) を読む
+static bool parseSequence(const std::string &text, size_t *i, int N, int depth, std::vector<CubeMove> *moves, std::string *error) {
+    for (;;) {
+        while (*i < text.size() && isspace((unsigned char)text[*i])) (*i)++;
+        if (*i >= text.size()) {
+            if (depth > 0) return setError(error, *i, "missing ')'");
+            return true;
+        }
+
+        if (text[*i] == ')') {
+            if (depth == 0) return setError(error, *i, "unexpected ')'");
+            (*i)++;
+            return true;
+        }
+
+        if (text[*i] != '(') {
+            const size_t start = *i;
+            if (!parseMove(text, i, N, moves, error)) return false;
+            if (moves->size() > MAX_SEQUENCE_MOVES) return setError(error, start, "sequence too long");
+            continue;
+        }
+
+        const size_t start = (*i)++;
+        std::vector<CubeMove> group;
+        if (!parseSequence(text, i, N, depth + 1, &group, error)) return false;
+        const size_t countStart = *i;
+        const int count = parseNumber(text, i, 1);
+        if (count < 0) return setError(error, countStart, "repeat count too large");
+        const bool inverted = *i < text.size() && text[*i] == '\'';
+        if (inverted) (*i)++;
+        // 括弧を入れ子にすると回数が掛け合わさるので、展開する前に長さを確かめる
+        if ((uint64_t)moves->size() + (uint64_t)group.size() * count > MAX_SEQUENCE_MOVES) return setError(error, start, "sequence too long");
+        for (int k = 0; k < count; k++) {
+            if (inverted) {
+                appendInverse(group, moves);
+            } else {
+                moves->insert(moves->end(), group.begin(), group.end());
+            }
+        }
+    }
+}
+
+bool parseMoves(const std::string &text, int N, std::vector<CubeMove> *moves, std::string *error) {
+    moves->clear();
+    size_t i = 0;
+    return parseSequence(text, &i, N, 0, moves, error);
+}
+
+CompiledMoves::CompiledMoves(int N_, int mode_)
+    : N(N_)
+    , mode(mode_)
+    , src(N_ * N_ * N_)
+    , rot(N_ * N_ * N_, 0) {
+    for (size_t q = 0; q < src.size(); q++) src[q] = (int)q;
+}
+
+CompiledMoves::CompiledMoves(int N_, int mode_, const std::vector<CubeMove> &moves)
+    : N(N_)
+    , mode(mode_)
+    , src(N_ * N_ * N_)
+    , rot(N_ * N_ * N_, 0) {
+    for (size_t q = 0; q < src.size(); q++) src[q] = (int)q;
+
+    // 揃った状態に施して、各キューブの元の位置と向きを読む
+    CubeState state(N, mode);
+    state.apply(moves);
+    const CubeTopology &topo = state.topology();
+    for (int c = 0; c < topo.numCubies; c++) {
+        const int q = state.position(c);
+        src[q] = topo.homePos[c];
+        rot[q] = (uint8_t)state.orientation(c);
+    }
+}
+
+void CompiledMoves::append(const CubeMove &move) {
+    append(CompiledMoves(N, mode, std::vector<CubeMove>(1, move)));
+}
+
+void CompiledMoves::append(const std::vector<CubeMove> &moves) {
+    append(CompiledMoves(N, mode, moves));
+}
+
+void CompiledMoves::append(const CompiledMoves &next) {
+    const std::vector<int> s = src;
+    const std::vector<uint8_t> r = rot;
+    for (size_t q = 0; q < src.size(); q++) {
+        src[q] = s[next.src[q]];
+        rot[q] = (uint8_t)composeRotation(next.rot[q], r[next.src[q]]);
+    }
+}
+
+CompiledMoves CompiledMoves::inverse() const {
+    CompiledMoves inv(N, mode);
+    for (size_t q = 0; q < src.size(); q++) {
+        inv.src[src[q]] = (int)q;
+        inv.rot[src[q]] = (uint8_t)inverseRotation(rot[q]);
+    }
+    return inv;
+}
+
+void CompiledMoves::applyTo(CubeState *state) const {
+    state->permute(src.data(), rot.data());
+}
+
+static uint64_t gcd64(uint64_t a, uint64_t b) {
+    while (b != 0) {
+        const uint64_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+uint64_t CompiledMoves::order() const {
+    const CubeState solved(N, mode);
+    std::vector<bool> visited(src.size(), false);
+    uint64_t result = 1;
+    for (size_t q0 = 0; q0 < src.size(); q0++) {
+        if (visited[q0] || solved.cubeAt((int)q0) < 0) continue;
+
+        // 巡回置換を逆向きにたどり、一周したときに掛かる回転を求める
+        uint64_t length = 0;
+        int r = 0;
+        for (int q = (int)q0; !visited[q]; q = src[q]) {
+            visited[q] = true;
+            r = composeRotation(r, rot[q]);
+            length++;
+        }
+
+        // 回転が元に戻るまでの回数 (その場で回るセンターは数えない)
+        int spin = 1;
+        if (!(solved.cubeType(solved.cubeAt((int)q0)) == 3 && mode != 1)) {
+            for (int k = r; k != 0; k = composeRotation(r, k)) spin++;
+        }
+        length *= spin;
+
+        const uint64_t g = gcd64(result, length);
+        if (result / g > UINT64_MAX / length) return UINT64_MAX;
+        result = result / g * length;
+    }
+    return result;
+}
@@ -0,0 +1,60 @@
+#ifndef _MOVE_SEQUENCE_H_
+#define _MOVE_SEQUENCE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "cube_state.h"
+
+/*
+回転操作の記法を読む (N x N用のSingmaster記法)
+R, L, U, D, F, B: 外側の層を、その面から見て時計回りに90度回す
+Rw, r: 外側から2つの層をまとめて回す (nRwはn層、小文字のnrも同じ)
+nR: 外側からn番目の層だけを回す (2Rは3x3以上の内側の層)
+M, E, S: 中央の層 (Nが奇数の場合のみ)。MはL、EはD、SはFと同じ向き
+x, y, z: キューブ全体の持ち替え。xはR、yはU、zはFと同じ向き
+回数の後に「'」を付けると逆回り (R2, R', R2' など)。(R U R' U')6 のように括弧で括って繰り返せる。
+読めない場合と、展開した層の回転がMAX_SEQUENCE_MOVESを超える場合はfalseを返し、errorがNULLでなければ理由を入れる。
+*/
+static const size_t MAX_SEQUENCE_MOVES = 1000000;
+
+bool parseMoves(const std::string &text, int N, std::vector<CubeMove> *moves, std::string *error = NULL);
+
+/*
+CompiledMoves
+回転操作の列をまとめた一つの置換。位置qには位置src[q]のキューブが移り、その向きにrot[q]の回転が掛かる。
+何手の列でも、CubeStateに施すのは全ての位置を一度なぞるだけで済む。
+*/
+class CompiledMoves {
+public:
+    // 何もしない置換
+    explicit CompiledMoves(int N = 3, int mode = 0);
+    CompiledMoves(int N, int mode, const std::vector<CubeMove> &moves);
+
+    int size() const { return N; }
+
+    // 後ろにつなげる (thisを施した後にnextを施す置換にする)
+    void append(const CubeMove &move);
+    void append(const std::vector<CubeMove> &moves);
+    void append(const CompiledMoves &next);
+
+    CompiledMoves inverse() const;
+
+    void applyTo(CubeState *state) const;
+
+    /*
+    何回繰り返すと元に戻るか (位置の巡回置換の長さと、一周したときの向きから求める)
+    その場で回るだけのセンターは見た目が変わらないので数えない (ミラーブロックスのmode = 1を除く)。
+    64bitに収まらない場合はUINT64_MAXを返す。
+    */
+    uint64_t order() const;
+
+private:
+    int N;
+    int mode;
+    std::vector<int> src;
+    std::vector<uint8_t> rot;
+};
+
+#endif  // _MOVE_SEQUENCE_H_
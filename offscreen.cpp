@@ -0,0 +1,173 @@
+#include "offscreen.h"
+
+#include <cstdio>
+
+#if defined(__APPLE__)
+#include <GLFW/glfw3.h>
+#else
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#if defined(__APPLE__)
+
+static GLFWwindow *hiddenWindow = NULL;
+
+bool createHeadlessContext() {
+    if (glfwInit() == GL_FALSE) return false;
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    hiddenWindow = glfwCreateWindow(16, 16, "", NULL, NULL);
+    if (hiddenWindow == NULL) {
+        glfwTerminate();
+        return false;
+    }
+    glfwMakeContextCurrent(hiddenWindow);
+    return gladLoadGL(glfwGetProcAddress) != 0;
+}
+
+void destroyHeadlessContext() {
+    if (hiddenWindow != NULL) glfwDestroyWindow(hiddenWindow);
+    hiddenWindow = NULL;
+    glfwTerminate();
+}
+
+#else
+
+static EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+static EGLContext eglContext = EGL_NO_CONTEXT;
+
+static GLADapiproc loadEGLProc(const char *name) {
+    return (GLADapiproc)eglGetProcAddress(name);
+}
+
+bool createHeadlessContext() {
+    // ディスプレイの無いサーバでも使えるように、まずMesaのsurfacelessを試す
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay != NULL) eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    if (eglDisplay == EGL_NO_DISPLAY) eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+    EGLint major, minor;
+    if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, &major, &minor)) {
+        fprintf(stderr, "Failed to initialize EGL\n");
+        return false;
+    }
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        fprintf(stderr, "EGL does not support OpenGL\n");
+        return false;
+    }
+
+    // 描画先は自前のFBOなので、サーフェスも設定も要らない
+    const EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    eglContext = eglCreateContext(eglDisplay, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, contextAttribs);
+    if (eglContext == EGL_NO_CONTEXT || !eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglContext)) {
+        fprintf(stderr, "Failed to create a surfaceless OpenGL 3.3 context\n");
+        return false;
+    }
+    return gladLoadGL(loadEGLProc) != 0;
+}
+
+void destroyHeadlessContext() {
+    if (eglDisplay == EGL_NO_DISPLAY) return;
+    eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (eglContext != EGL_NO_CONTEXT) eglDestroyContext(eglDisplay, eglContext);
+    eglTerminate(eglDisplay);
+    eglContext = EGL_NO_CONTEXT;
+    eglDisplay = EGL_NO_DISPLAY;
+}
+
+#endif
+
+OffscreenTarget::OffscreenTarget(int width_, int height_, int ringSize)
+    : w(width_)
+    , h(height_)
+    , complete(false)
+    , fboId(0)
+    , colorBufferId(0)
+    , depthBufferId(0)
+    , pboIds(ringSize < 1 ? 1 : ringSize, 0)
+    , fences(pboIds.size(), (GLsync)0)
+    , indices(pboIds.size(), -1)
+    , next(0) {
+    glGenRenderbuffers(1, &colorBufferId);
+    glBindRenderbuffer(GL_RENDERBUFFER, colorBufferId);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, w, h);
+    glGenRenderbuffers(1, &depthBufferId);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBufferId);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, w, h);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &fboId);
+    glBindFramebuffer(GL_FRAMEBUFFER, fboId);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBufferId);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBufferId);
+    complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // 読み戻し用のPBO (GPUからの読み込み専用)
+    glGenBuffers((GLsizei)pboIds.size(), pboIds.data());
+    for (size_t i = 0; i < pboIds.size(); i++) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pboIds[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)w * h * 4, NULL, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+OffscreenTarget::~OffscreenTarget() {
+    for (size_t i = 0; i < fences.size(); i++) {
+        if (fences[i] != 0) glDeleteSync(fences[i]);
+    }
+    glDeleteBuffers((GLsizei)pboIds.size(), pboIds.data());
+    glDeleteFramebuffers(1, &fboId);
+    glDeleteRenderbuffers(1, &colorBufferId);
+    glDeleteRenderbuffers(1, &depthBufferId);
+}
+
+void OffscreenTarget::bind() {
+    glBindFramebuffer(GL_FRAMEBUFFER, fboId);
+    glViewport(0, 0, w, h);
+}
+
+void OffscreenTarget::readback(long long index, const Callback &callback) {
+    // 同じPBOに前の画像が残っていれば先に取り出す
+    if (fences[next] != 0) deliver(next, callback);
+
+    // PBOを結び付けたglReadPixelsは読み込みを命令するだけで、結果を待たずに戻る
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fboId);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pboIds[next]);
+    glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    fences[next] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    indices[next] = index;
+    next = (next + 1) % (int)pboIds.size();
+}
+
+void OffscreenTarget::finish(const Callback &callback) {
+    // 古いものから順に取り出す
+    for (size_t k = 0; k < pboIds.size(); k++) {
+        const int slot = (next + (int)k) % (int)pboIds.size();
+        if (fences[slot] != 0) deliver(slot, callback);
+    }
+}
+
+void OffscreenTarget::deliver(int slot, const Callback &callback) {
+    glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+    glDeleteSync(fences[slot]);
+    fences[slot] = 0;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pboIds[slot]);
+    const unsigned char *pixels = (const unsigned char *)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)w * h * 4, GL_MAP_READ_BIT);
+    if (pixels != NULL) {
+        callback(pixels, indices[slot]);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
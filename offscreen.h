@@ -0,0 +1,62 @@
+#ifndef _OFFSCREEN_H_
+#define _OFFSCREEN_H_
+
+#include <functional>
+#include <vector>
+
+#include <glad/gl.h>
+
+/*
+ウィンドウを作らずにOpenGLのコンテキストを作り、カレントにする (glad の読み込みまで行う)。
+LinuxではEGLのsurfaceless (MesaのllvmpipeならディスプレイもGPUも要らない)、
+Macでは見えないGLFWのウィンドウを使う。
+*/
+bool createHeadlessContext();
+void destroyHeadlessContext();
+
+/*
+OffscreenTarget
+描画先のFBO (RGBA8の色と24bitの深度) と、読み戻しのためのPBOのリング。
+readback() は今の描画結果を空いているPBOに非同期で読み込むだけで待たない。
+リングが一周して同じPBOを使う時に初めて、そのPBOの画像を取り出してcallbackに渡す。
+画像は1画素4バイト (RGBA) で、下の行から順に並んでいる (glReadPixelsと同じ)。
+*/
+class OffscreenTarget {
+public:
+    typedef std::function<void(const unsigned char *rgba, long long index)> Callback;
+
+    OffscreenTarget(int width, int height, int ringSize = 3);
+    ~OffscreenTarget();
+
+    bool isComplete() const { return complete; }
+    int width() const { return w; }
+    int height() const { return h; }
+
+    // FBOを描画先にしてビューポートを合わせる
+    void bind();
+
+    // 今の描画結果を読み込む (indexはcallbackにそのまま渡す番号)
+    void readback(long long index, const Callback &callback);
+
+    // 読み込み中の画像を全て取り出す
+    void finish(const Callback &callback);
+
+private:
+    OffscreenTarget(const OffscreenTarget &) = delete;
+    OffscreenTarget &operator=(const OffscreenTarget &) = delete;
+
+    // slot番目のPBOの読み込みを待って画像を渡す
+    void deliver(int slot, const Callback &callback);
+
+    int w, h;
+    bool complete;
+    GLuint fboId;
+    GLuint colorBufferId;
+    GLuint depthBufferId;
+    std::vector<GLuint> pboIds;
+    std::vector<GLsync> fences;
+    std::vector<long long> indices;
+    int next;
+};
+
+#endif  // _OFFSCREEN_H_
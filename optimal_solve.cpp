@@ -0,0 +1,59 @@
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "cubie_cube.h"
+#include "optimal_solver.h"
+
+/*
+最短手数のソルバ
+データのディレクトリ (既定はoptimal_solver.hのdefaultDataDirectory) のパターンデータベースを使う (無ければ最初に一度だけ作る)。
+ランダムに崩した状態を解いて、解と探索した節点の数を表示する。
+使い方: ./optimal_solve [状態の数] [崩す手数] [乱数の種] [データのディレクトリ]
+*/
+
+typedef std::chrono::steady_clock Clock;
+
+int main(int argc, char **argv) {
+    const int count = argc > 1 ? atoi(argv[1]) : 10;
+    const int scrambleLength = argc > 2 ? atoi(argv[2]) : 14;
+    const unsigned int seed = argc > 3 ? (unsigned int)atoi(argv[3]) : 1;
+    const std::string dataDirectory = argc > 4 ? argv[4] : defaultDataDirectory();
+
+    Clock::time_point start = Clock::now();
+    if (!initOptimalSolver(dataDirectory, true)) {
+        fprintf(stderr, "Failed to open pattern databases in %s\n", dataDirectory.c_str());
+        return 1;
+    }
+    printf("Tables: %.2f s\n", std::chrono::duration<double>(Clock::now() - start).count());
+
+    std::mt19937 rng(seed);
+    int failed = 0;
+    for (int i = 0; i < count; i++) {
+        CubieCube cube;
+        std::vector<int> scramble;
+        for (int k = 0; k < scrambleLength; k++) {
+            scramble.push_back(rng() % NUM_FACE_TURNS);
+            cube.move(scramble.back());
+        }
+
+        std::vector<int> solution;
+        uint64_t nodes = 0;
+        start = Clock::now();
+        const bool ok = solveOptimal(cube, 20, &solution, &nodes);
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        // 解を施して揃うかを確かめる
+        for (int k = 0; k < (int)solution.size(); k++) cube.move(solution[k]);
+        if (!ok || cube != CubieCube()) failed++;
+
+        printf("Scramble: %s\n", faceTurnsToString(scramble).c_str());
+        printf("Solution: %s (%d moves, %llu nodes, %.3f s)\n", ok ? faceTurnsToString(solution).c_str() : "-", (int)solution.size(),
+               (unsigned long long)nodes, seconds);
+    }
+
+    return failed == 0 ? 0 : 1;
+}
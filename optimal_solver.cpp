@@ -0,0 +1,296 @@
+#include "optimal_solver.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "pattern_database.h"
+#include "pattern_generator.h"
+
+// 座標の大きさ
+static const int N_TWIST = 2187;
+static const int N_CORNER_PERM = 40320;
+static const int N_EDGE_POS = 665280;   // 12! / 6!
+static const int EDGE_SUBSET = 6;
+
+// 辺の組の最初の辺
+static const int edgeSubsetBegin[NUM_PATTERN_KINDS] = { 0, UR, DL };
+
+/*
+6つの辺の位置の番号 (12個の位置から6個を順番に選ぶ並べ方)
+pos[i]は組のi番目の辺がある位置。
+*/
+static int edgePosRank(const int *pos) {
+    int rank = 0, used = 0;
+    for (int i = 0; i < EDGE_SUBSET; i++) {
+        const int c = pos[i] - __builtin_popcount(used & ((1 << pos[i]) - 1));
+        rank = rank * (12 - i) + c;
+        used |= 1 << pos[i];
+    }
+    return rank;
+}
+
+static void edgePosUnrank(int rank, int *pos) {
+    int digits[EDGE_SUBSET];
+    for (int i = EDGE_SUBSET - 1; i >= 0; i--) {
+        digits[i] = rank % (12 - i);
+        rank /= 12 - i;
+    }
+    int used = 0;
+    for (int i = 0; i < EDGE_SUBSET; i++) {
+        int c = digits[i];
+        for (int p = 0; p < 12; p++) {
+            if (used & (1 << p)) continue;
+            if (c-- == 0) {
+                pos[i] = p;
+                used |= 1 << p;
+                break;
+            }
+        }
+    }
+}
+
+/*
+OptimalMoveTables
+面の回転による座標の移動表
+edgeMove: 下位20bitが回転後の位置の番号、その上の6bitが向きの反転 (組のi番目の辺がbit i)
+位置だけで決まるので、2つの辺の組で同じ表を使う。
+*/
+struct OptimalMoveTables {
+    OptimalMoveTables();
+
+    std::vector<uint16_t> cornerPermMove;
+    std::vector<uint16_t> twistMove;
+    std::vector<uint32_t> edgeMove;
+};
+
+OptimalMoveTables::OptimalMoveTables() {
+    cornerPermMove.resize(N_CORNER_PERM * NUM_FACE_TURNS);
+    for (int i = 0; i < N_CORNER_PERM; i++) {
+        for (int m = 0; m < NUM_FACE_TURNS; m++) {
+            CubieCube a;
+            a.setCornerPerm(i);
+            a.cornerMultiply(faceTurnCube(m));
+            cornerPermMove[i * NUM_FACE_TURNS + m] = a.cornerPerm();
+        }
+    }
+    twistMove.resize(N_TWIST * NUM_FACE_TURNS);
+    for (int i = 0; i < N_TWIST; i++) {
+        for (int m = 0; m < NUM_FACE_TURNS; m++) {
+            CubieCube a;
+            a.setTwist(i);
+            a.cornerMultiply(faceTurnCube(m));
+            twistMove[i * NUM_FACE_TURNS + m] = a.twist();
+        }
+    }
+
+    // 回転で位置jの辺が移る先の位置と、そのときの向きの反転
+    int dest[NUM_FACE_TURNS][12], flip[NUM_FACE_TURNS][12];
+    for (int m = 0; m < NUM_FACE_TURNS; m++) {
+        const CubieCube &c = faceTurnCube(m);
+        for (int i = 0; i < 12; i++) {
+            dest[m][c.ep[i]] = i;
+            flip[m][c.ep[i]] = c.eo[i];
+        }
+    }
+    edgeMove.resize((size_t)N_EDGE_POS * NUM_FACE_TURNS);
+    for (int r = 0; r < N_EDGE_POS; r++) {
+        int pos[EDGE_SUBSET];
+        edgePosUnrank(r, pos);
+        for (int m = 0; m < NUM_FACE_TURNS; m++) {
+            int next[EDGE_SUBSET];
+            uint32_t mask = 0;
+            for (int k = 0; k < EDGE_SUBSET; k++) {
+                next[k] = dest[m][pos[k]];
+                mask |= (uint32_t)flip[m][pos[k]] << k;
+            }
+            edgeMove[(size_t)r * NUM_FACE_TURNS + m] = (uint32_t)edgePosRank(next) | (mask << 20);
+        }
+    }
+}
+
+static const OptimalMoveTables &getMoveTables() {
+    static const OptimalMoveTables tables;
+    return tables;
+}
+
+static inline uint32_t moveEdges(const OptimalMoveTables &tables, uint32_t index, int turn) {
+    const uint32_t v = tables.edgeMove[(size_t)(index >> 6) * NUM_FACE_TURNS + turn];
+    return ((v & 0xFFFFF) << 6) | ((index & 63) ^ (v >> 20));
+}
+
+uint64_t patternSize(int kind) {
+    return kind == PATTERN_CORNERS ? (uint64_t)N_CORNER_PERM * N_TWIST : (uint64_t)N_EDGE_POS << EDGE_SUBSET;
+}
+
+uint64_t patternIndex(int kind, const CubieCube &cube) {
+    if (kind == PATTERN_CORNERS) return (uint64_t)cube.cornerPerm() * N_TWIST + cube.twist();
+
+    int pos[EDGE_SUBSET];
+    uint32_t ori = 0;
+    for (int p = 0; p < 12; p++) {
+        const int k = cube.ep[p] - edgeSubsetBegin[kind];
+        if (k < 0 || k >= EDGE_SUBSET) continue;
+        pos[k] = p;
+        ori |= (uint32_t)cube.eo[p] << k;
+    }
+    return ((uint64_t)edgePosRank(pos) << EDGE_SUBSET) | ori;
+}
+
+uint64_t patternMove(int kind, uint64_t index, int turn) {
+    const OptimalMoveTables &tables = getMoveTables();
+    if (kind == PATTERN_CORNERS) {
+        const int perm = (int)(index / N_TWIST);
+        const int twist = (int)(index % N_TWIST);
+        return (uint64_t)tables.cornerPermMove[perm * NUM_FACE_TURNS + turn] * N_TWIST + tables.twistMove[twist * NUM_FACE_TURNS + turn];
+    }
+    return moveEdges(tables, (uint32_t)index, turn);
+}
+
+std::string patternFileName(int kind) {
+    static const char *names[NUM_PATTERN_KINDS] = { "corners.pdb", "edges_low.pdb", "edges_high.pdb" };
+    return names[kind];
+}
+
+std::string defaultDataDirectory() {
+    std::string directory;
+    const char *env = getenv("CUBE_DATA_DIRECTORY");
+    if (env != NULL) {
+        directory = env;
+    } else if ((env = getenv("XDG_DATA_HOME")) != NULL && env[0] == '/') {
+        directory = std::string(env) + "/rubiks-cube/";
+    } else if ((env = getenv("HOME")) != NULL && env[0] != '\0') {
+        directory = std::string(env) + "/.local/share/rubiks-cube/";
+    }
+    if (!directory.empty() && directory[directory.size() - 1] != '/') directory += '/';
+    return directory;
+}
+
+bool prepareDataDirectory(const std::string &dataDirectory) {
+    std::string dir = dataDirectory.empty() ? "." : dataDirectory;
+    if (dir[dir.size() - 1] != '/') dir += "/";
+
+    // 途中のディレクトリも順に作る (既にあれば失敗するだけなので、結果は最後に確かめる)
+    for (size_t slash = dir.find('/', 1); slash != std::string::npos; slash = dir.find('/', slash + 1)) {
+        mkdir(dir.substr(0, slash).c_str(), 0755);
+    }
+    if (access(dir.c_str(), W_OK | X_OK) != 0) {
+        fprintf(stderr, "Cannot write to data directory %s\n", dir.c_str());
+        return false;
+    }
+    return true;
+}
+
+static PatternDatabase databases[NUM_PATTERN_KINDS];
+static std::mutex databaseMutex;
+static std::atomic<bool> databasesReady(false);
+
+bool initOptimalSolver(const std::string &dataDirectory, bool generate) {
+    std::lock_guard<std::mutex> lock(databaseMutex);
+    if (databasesReady) return true;
+
+    std::string dir = dataDirectory;
+    if (!dir.empty() && dir[dir.size() - 1] != '/') dir += "/";
+
+    getMoveTables();
+    bool prepared = false;
+    for (int kind = 0; kind < NUM_PATTERN_KINDS; kind++) {
+        const std::string path = dir + patternFileName(kind);
+        if (databases[kind].open(path, kind, patternSize(kind))) continue;
+        if (!generate) {
+            fprintf(stderr, "Pattern database not found: %s\n", path.c_str());
+            return false;
+        }
+
+        // 書けないディレクトリに何十秒も探索してから失敗しないように、先に確かめる
+        if (!prepared && !prepareDataDirectory(dir)) return false;
+        prepared = true;
+        if (!generatePatternDatabase(kind, path) || !databases[kind].open(path, kind, patternSize(kind))) return false;
+    }
+    databasesReady = true;
+    return true;
+}
+
+/*
+OptimalSearch
+一回の探索の状態。手数の下限は3つのパターンデータベースの最大値。
+*/
+struct OptimalSearch {
+    OptimalSearch(const OptimalMoveTables &tables_)
+        : tables(tables_), nodes(0) {
+    }
+
+    int heuristic(int perm, int twist, uint32_t low, uint32_t high) const {
+        int h = databases[PATTERN_CORNERS].get((uint64_t)perm * N_TWIST + twist);
+        h = std::max(h, databases[PATTERN_EDGES_LOW].get(low));
+        return std::max(h, databases[PATTERN_EDGES_HIGH].get(high));
+    }
+    bool search(int perm, int twist, uint32_t low, uint32_t high, int depth, int togo, int lastFace);
+
+    const OptimalMoveTables &tables;
+    uint64_t nodes;
+    int path[32];
+};
+
+bool OptimalSearch::search(int perm, int twist, uint32_t low, uint32_t high, int depth, int togo, int lastFace) {
+    nodes++;
+    // 手数の下限が0になるのは揃った状態だけ
+    if (togo == 0) return true;
+
+    for (int m = 0; m < NUM_FACE_TURNS; m++) {
+        const int face = m / 3;
+        if (face == lastFace || face + 3 == lastFace) continue;
+
+        const int p = tables.cornerPermMove[perm * NUM_FACE_TURNS + m];
+        const int t = tables.twistMove[twist * NUM_FACE_TURNS + m];
+        if (databases[PATTERN_CORNERS].get((uint64_t)p * N_TWIST + t) >= togo) continue;
+        const uint32_t l = moveEdges(tables, low, m);
+        if (databases[PATTERN_EDGES_LOW].get(l) >= togo) continue;
+        const uint32_t h = moveEdges(tables, high, m);
+        if (databases[PATTERN_EDGES_HIGH].get(h) >= togo) continue;
+
+        path[depth] = m;
+        if (search(p, t, l, h, depth + 1, togo - 1, face)) return true;
+    }
+    return false;
+}
+
+bool solveOptimal(const CubieCube &cube, int maxLength, std::vector<int> *solution, uint64_t *nodes) {
+    if (!databasesReady || !cube.isValid()) return false;
+    if (maxLength > 30) maxLength = 30;
+
+    OptimalSearch search(getMoveTables());
+    const int perm = cube.cornerPerm();
+    const int twist = cube.twist();
+    const uint32_t low = (uint32_t)patternIndex(PATTERN_EDGES_LOW, cube);
+    const uint32_t high = (uint32_t)patternIndex(PATTERN_EDGES_HIGH, cube);
+
+    bool found = false;
+    for (int length = search.heuristic(perm, twist, low, high); length <= maxLength && !found; length++) {
+        if (search.search(perm, twist, low, high, 0, length, -1)) {
+            solution->assign(search.path, search.path + length);
+            found = true;
+        }
+    }
+    if (nodes != NULL) *nodes = search.nodes;
+    return found;
+}
+
+bool solveOptimal(const CubeState &state, int maxLength, std::vector<CubeMove> *moves) {
+    CubieCube cube;
+    if (state.size() != 3 || !cubieCubeFromState(state, &cube)) return false;
+
+    std::vector<int> turns;
+    if (!solveOptimal(cube, maxLength, &turns)) return false;
+
+    moves->clear();
+    for (size_t i = 0; i < turns.size(); i++) {
+        moves->push_back(faceTurnToCubeMove(turns[i], 3));
+    }
+    return true;
+}
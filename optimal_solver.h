@@ -0,0 +1,59 @@
+#ifndef _OPTIMAL_SOLVER_H_
+#define _OPTIMAL_SOLVER_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "cube_state.h"
+#include "cubie_cube.h"
+
+/*
+パターンデータベースの座標 (Korfの方法)
+PATTERN_CORNERS: 8つの角の置換と向き (8! * 3^7 = 88179840)
+PATTERN_EDGES_LOW: 辺UR ~ DFの6つの位置と向き (12! / 6! * 2^6 = 42577920)
+PATTERN_EDGES_HIGH: 辺DL ~ BRの6つの位置と向き
+*/
+enum PatternKind {
+    PATTERN_CORNERS,
+    PATTERN_EDGES_LOW,
+    PATTERN_EDGES_HIGH,
+    NUM_PATTERN_KINDS
+};
+
+uint64_t patternSize(int kind);
+uint64_t patternIndex(int kind, const CubieCube &cube);
+
+// 座標に面の回転を施す (CubeStateの回転と同じ向き)
+uint64_t patternMove(int kind, uint64_t index, int turn);
+
+// データのディレクトリの下に置くファイルの名前
+std::string patternFileName(int kind);
+
+/*
+パターンデータベースを置くディレクトリの既定値
+環境変数CUBE_DATA_DIRECTORY、$XDG_DATA_HOME/rubiks-cube/、~/.local/share/rubiks-cube/ の順に使う。
+*/
+std::string defaultDataDirectory();
+
+// dataDirectoryを親のディレクトリも含めて作る。書き込めなければメッセージを出してfalseを返す。
+bool prepareDataDirectory(const std::string &dataDirectory);
+
+/*
+dataDirectoryのパターンデータベースをmmapで開く
+generateがtrueのときは、無いファイルをその場で作る (pattern_generator.h)。全て開ければtrueを返す。
+事前に作る場合はpdb_generatorを使う。
+*/
+bool initOptimalSolver(const std::string &dataDirectory, bool generate);
+
+/*
+IDA*で最短手数 (face turn metric) の解を探す
+initOptimalSolverが成功している必要がある。maxLength手以内に解が無ければfalseを返す。
+nodesがNULLでなければ、調べた節点の数を返す。
+*/
+bool solveOptimal(const CubieCube &cube, int maxLength, std::vector<int> *solution, uint64_t *nodes = NULL);
+
+// N = 3のCubeStateを揃える最短の回転操作の列を探す
+bool solveOptimal(const CubeState &state, int maxLength, std::vector<CubeMove> *moves);
+
+#endif  // _OPTIMAL_SOLVER_H_
@@ -0,0 +1,112 @@
+#include "pattern_database.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+PatternDatabase::PatternDatabase()
+    : mapped(NULL)
+    , mappedSize(0)
+    , data(NULL)
+    , entries(0) {
+}
+
+PatternDatabase::~PatternDatabase() {
+    close();
+}
+
+bool PatternDatabase::open(const std::string &path, uint32_t kind, uint64_t entries_) {
+    close();
+
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    const uint64_t dataSize = (entries_ + 1) / 2;
+    if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < PDB_DATA_OFFSET + dataSize) {
+        ::close(fd);
+        return false;
+    }
+
+    void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) return false;
+
+    // ヘッダを確かめる
+    const PatternDatabaseHeader *header = (const PatternDatabaseHeader *)p;
+    if (memcmp(header->magic, PDB_MAGIC, sizeof(PDB_MAGIC)) != 0 || header->version != PDB_VERSION ||
+        header->kind != kind || header->entries != entries_ || header->dataOffset != PDB_DATA_OFFSET) {
+        munmap(p, (size_t)st.st_size);
+        return false;
+    }
+
+    // 探索では飛び飛びに引くので、先読みはしない
+    madvise(p, (size_t)st.st_size, MADV_RANDOM);
+
+    mapped = p;
+    mappedSize = (size_t)st.st_size;
+    data = (const uint8_t *)p + PDB_DATA_OFFSET;
+    entries = entries_;
+    return true;
+}
+
+void PatternDatabase::close() {
+    if (mapped != NULL) munmap(mapped, mappedSize);
+    mapped = NULL;
+    mappedSize = 0;
+    data = NULL;
+    entries = 0;
+}
+
+bool writePatternDatabase(const std::string &path, uint32_t kind, const uint8_t *nibbles, uint64_t entries) {
+    // 同じファイルを作る他のプロセスと一時ファイルを分ける
+    const std::string tmpPath = path + ".tmp." + std::to_string(getpid());
+    FILE *fp = fopen(tmpPath.c_str(), "wb");
+    if (fp == NULL) {
+        fprintf(stderr, "Failed to open file: %s\n", tmpPath.c_str());
+        return false;
+    }
+
+    char page[PDB_DATA_OFFSET];
+    memset(page, 0, sizeof(page));
+    PatternDatabaseHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PDB_MAGIC, sizeof(PDB_MAGIC));
+    header.version = PDB_VERSION;
+    header.kind = kind;
+    header.entries = entries;
+    header.dataOffset = PDB_DATA_OFFSET;
+    memcpy(page, &header, sizeof(header));
+
+    const uint64_t dataSize = (entries + 1) / 2;
+    bool ok = fwrite(page, 1, sizeof(page), fp) == sizeof(page);
+    ok = ok && fwrite(nibbles, 1, (size_t)dataSize, fp) == dataSize;
+    ok = fclose(fp) == 0 && ok;
+    if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0) {
+        fprintf(stderr, "Failed to write file: %s\n", path.c_str());
+        remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool readPatternDatabase(const std::string &path, uint32_t kind, uint64_t entries, std::vector<uint8_t> *nibbles) {
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (fp == NULL) return false;
+
+    PatternDatabaseHeader header;
+    bool ok = fread(&header, 1, sizeof(header), fp) == sizeof(header);
+    ok = ok && memcmp(header.magic, PDB_MAGIC, sizeof(PDB_MAGIC)) == 0 && header.version == PDB_VERSION && header.kind == kind &&
+         header.entries == entries && header.dataOffset == PDB_DATA_OFFSET;
+    if (ok) {
+        nibbles->resize((size_t)((entries + 1) / 2));
+        ok = fseek(fp, (long)PDB_DATA_OFFSET, SEEK_SET) == 0 && fread(nibbles->data(), 1, nibbles->size(), fp) == nibbles->size();
+    }
+    fclose(fp);
+    return ok;
+}
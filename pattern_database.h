@@ -0,0 +1,76 @@
+#ifndef _PATTERN_DATABASE_H_
+#define _PATTERN_DATABASE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+パターンデータベースのファイル
+揃った状態からの手数を1状態4bit (nibble) で詰めたもの。偶数番目の状態が下位4bitに入る。
+ファイルの先頭にヘッダを置き、データはページ境界 (PDB_DATA_OFFSET) から始める。
+*/
+static const char PDB_MAGIC[8] = { 'C', 'U', 'B', 'E', 'P', 'D', 'B', '\0' };
+static const uint32_t PDB_VERSION = 1;
+static const uint64_t PDB_DATA_OFFSET = 4096;
+
+// まだ手数の分からない状態
+static const int PDB_UNKNOWN = 15;
+
+struct PatternDatabaseHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t kind;       // 座標の種類 (optimal_solver.hのPatternKind)
+    uint64_t entries;    // 状態の数
+    uint64_t dataOffset;
+};
+
+inline int getNibble(const uint8_t *table, uint64_t index) {
+    return (table[index >> 1] >> ((index & 1) << 2)) & 15;
+}
+
+inline void setNibble(uint8_t *table, uint64_t index, int value) {
+    uint8_t &b = table[index >> 1];
+    const int shift = (int)(index & 1) << 2;
+    b = (uint8_t)((b & ~(15 << shift)) | (value << shift));
+}
+
+/*
+PatternDatabase
+ファイルを読み込み専用でmmapして引く。ページキャッシュを共有するので、
+同じファイルを開いた複数のプロセスでメモリを使い回せる。コピーはできない。
+*/
+class PatternDatabase {
+public:
+    PatternDatabase();
+    ~PatternDatabase();
+
+    // ヘッダの種類と状態の数が合わなければfalseを返す
+    bool open(const std::string &path, uint32_t kind, uint64_t entries);
+    void close();
+
+    bool isOpen() const { return data != NULL; }
+    uint64_t size() const { return entries; }
+    int get(uint64_t index) const { return getNibble(data, index); }
+
+private:
+    PatternDatabase(const PatternDatabase &) = delete;
+    PatternDatabase &operator=(const PatternDatabase &) = delete;
+
+    void *mapped;
+    size_t mappedSize;
+    const uint8_t *data;
+    uint64_t entries;
+};
+
+/*
+nibbleで詰めた表をファイルに書き出す
+一時ファイルに書いてから名前を変えるので、途中で止まっても壊れたファイルは残らない。
+*/
+bool writePatternDatabase(const std::string &path, uint32_t kind, const uint8_t *nibbles, uint64_t entries);
+
+// ファイルの表を (書き換えられるように) メモリに読み込む
+bool readPatternDatabase(const std::string &path, uint32_t kind, uint64_t entries, std::vector<uint8_t> *nibbles);
+
+#endif  // _PATTERN_DATABASE_H_
@@ -0,0 +1,183 @@
+#include "pattern_generator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "optimal_solver.h"
+#include "pattern_database.h"
+
+typedef std::chrono::steady_clock Clock;
+
+// スレッドが一度に受け持つ状態の数 (偶数にして、1バイトを2つのスレッドで分けないようにする)
+static const uint64_t CHUNK_SIZE = 1 << 16;
+
+/*
+NibbleTable
+nibbleで詰めた表をスレッド間で共有する。書き込みは未知の状態にだけ行うので、比較交換で十分。
+*/
+class NibbleTable {
+public:
+    explicit NibbleTable(uint64_t entries)
+        : bytes((size_t)((entries + 1) / 2)) {
+        for (size_t i = 0; i < bytes.size(); i++) bytes[i].store(0xFF, std::memory_order_relaxed);
+    }
+
+    size_t byteSize() const { return bytes.size(); }
+    uint8_t byte(size_t i) const { return bytes[i].load(std::memory_order_relaxed); }
+    void setByte(size_t i, uint8_t b) { bytes[i].store(b, std::memory_order_relaxed); }
+
+    int get(uint64_t index) const {
+        return (bytes[index >> 1].load(std::memory_order_relaxed) >> ((index & 1) << 2)) & 15;
+    }
+
+    // 未知ならvalueにしてtrueを返す
+    bool setIfUnknown(uint64_t index, int value) {
+        std::atomic<uint8_t> &b = bytes[index >> 1];
+        const int shift = (int)(index & 1) << 2;
+        uint8_t old = b.load(std::memory_order_relaxed);
+        while (((old >> shift) & 15) == PDB_UNKNOWN) {
+            const uint8_t next = (uint8_t)((old & ~(15 << shift)) | (value << shift));
+            if (b.compare_exchange_weak(old, next, std::memory_order_relaxed)) return true;
+        }
+        return false;
+    }
+
+private:
+    std::vector<std::atomic<uint8_t> > bytes;
+};
+
+// チェックポイントから表を読み込み、最後に終わった手数とその状態の数を求める
+static bool loadCheckpoint(const std::string &path, int kind, uint64_t n, NibbleTable &table, int *depth, uint64_t *count, uint64_t *frontier) {
+    std::vector<uint8_t> nibbles;
+    if (!readPatternDatabase(path, kind, n, &nibbles)) return false;
+
+    uint64_t perDepth[PDB_UNKNOWN] = { 0 };
+    for (uint64_t i = 0; i < n; i++) {
+        const int d = getNibble(nibbles.data(), i);
+        if (d != PDB_UNKNOWN) perDepth[d]++;
+    }
+    for (size_t i = 0; i < nibbles.size(); i++) table.setByte(i, nibbles[i]);
+
+    *depth = 0;
+    *count = 0;
+    for (int d = 0; d < PDB_UNKNOWN; d++) {
+        if (perDepth[d] == 0) continue;
+        *depth = d;
+        *count += perDepth[d];
+    }
+    *frontier = perDepth[*depth];
+    return *count > 0;
+}
+
+// 手数depthの状態から、手数depth + 1の状態を求める (範囲は[begin, end))
+static uint64_t expandForward(int kind, NibbleTable &table, int depth, uint64_t begin, uint64_t end) {
+    uint64_t found = 0;
+    for (uint64_t i = begin; i < end; i++) {
+        if (table.get(i) != depth) continue;
+        for (int m = 0; m < NUM_FACE_TURNS; m++) {
+            if (table.setIfUnknown(patternMove(kind, i, m), depth + 1)) found++;
+        }
+    }
+    return found;
+}
+
+// 未知の状態のうち、1手で手数depthの状態に行けるものを手数depth + 1にする
+static uint64_t expandBackward(int kind, NibbleTable &table, int depth, uint64_t begin, uint64_t end) {
+    uint64_t found = 0;
+    for (uint64_t i = begin; i < end; i++) {
+        if (table.get(i) != PDB_UNKNOWN) continue;
+        for (int m = 0; m < NUM_FACE_TURNS; m++) {
+            if (table.get(patternMove(kind, i, m)) == depth) {
+                table.setIfUnknown(i, depth + 1);
+                found++;
+                break;
+            }
+        }
+    }
+    return found;
+}
+
+// 書き出すファイルを作れるかを探索の前に確かめる (writePatternDatabaseと同じ一時ファイルの名前を使う)
+static bool checkWritable(const std::string &path) {
+    const std::string tmpPath = path + ".tmp." + std::to_string(getpid());
+    FILE *fp = fopen(tmpPath.c_str(), "wb");
+    if (fp == NULL) {
+        fprintf(stderr, "Failed to open file: %s\n", tmpPath.c_str());
+        return false;
+    }
+    fclose(fp);
+    remove(tmpPath.c_str());
+    return true;
+}
+
+bool generatePatternDatabase(int kind, const std::string &path, const PatternGeneratorOptions &options) {
+    const uint64_t n = patternSize(kind);
+    const std::string name = patternFileName(kind);
+    const std::string checkpointPath = path + ".checkpoint";
+    int threads = options.threads > 0 ? options.threads : (int)std::thread::hardware_concurrency();
+    if (threads < 1) threads = 1;
+
+    if (!checkWritable(path) || (options.checkpoint && !checkWritable(checkpointPath))) return false;
+
+    NibbleTable table(n);
+    int depth = 0;
+    uint64_t count = 1, frontier = 1;
+    if (options.checkpoint && loadCheckpoint(checkpointPath, kind, n, table, &depth, &count, &frontier)) {
+        if (options.verbose) fprintf(stderr, "%s: resume from depth %d (%llu states)\n", name.c_str(), depth, (unsigned long long)count);
+    } else {
+        table.setIfUnknown(patternIndex(kind, CubieCube()), 0);
+    }
+
+    for (; count < n; depth++) {
+        const Clock::time_point start = Clock::now();
+
+        // 残りの状態の方が少なければ後ろ向きに調べる
+        const bool backward = frontier >= n - count;
+        std::atomic<uint64_t> next(0);
+        std::vector<uint64_t> found(threads, 0);
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; t++) {
+            workers.push_back(std::thread([&, t]() {
+                for (;;) {
+                    const uint64_t begin = next.fetch_add(CHUNK_SIZE);
+                    if (begin >= n) break;
+                    const uint64_t end = std::min(begin + CHUNK_SIZE, n);
+                    found[t] += backward ? expandBackward(kind, table, depth, begin, end) : expandForward(kind, table, depth, begin, end);
+                }
+            }));
+        }
+        for (int t = 0; t < threads; t++) workers[t].join();
+
+        uint64_t total = 0;
+        for (int t = 0; t < threads; t++) total += found[t];
+        if (total == 0) break;
+        count += total;
+        frontier = total;
+
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        if (options.verbose) {
+            fprintf(stderr, "%s: depth %d, %llu states, %.1f s (%.2f M states/s, %s, %d threads)\n", name.c_str(), depth + 1, (unsigned long long)total,
+                   seconds, total / seconds / 1e6, backward ? "backward" : "forward", threads);
+        }
+
+        // 途中で止めても、ここから再開できるようにする (書けなければ、その手数で止める)
+        if (options.checkpoint && count < n) {
+            std::vector<uint8_t> nibbles(table.byteSize());
+            for (size_t i = 0; i < nibbles.size(); i++) nibbles[i] = table.byte(i);
+            if (!writePatternDatabase(checkpointPath, kind, nibbles.data(), n)) return false;
+        }
+    }
+
+    std::vector<uint8_t> nibbles(table.byteSize());
+    for (size_t i = 0; i < nibbles.size(); i++) nibbles[i] = table.byte(i);
+    if (!writePatternDatabase(path, kind, nibbles.data(), n)) return false;
+    if (options.checkpoint) remove(checkpointPath.c_str());
+    return true;
+}
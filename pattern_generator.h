@@ -0,0 +1,27 @@
+#ifndef _PATTERN_GENERATOR_H_
+#define _PATTERN_GENERATOR_H_
+
+#include <string>
+
+/*
+パターンデータベースを作る幅優先探索
+手数ごとに全状態を走査して次の手数の状態を求める (level-synchronous)。
+走査する範囲をスレッドで分け、nibbleの書き込みはバイト単位のatomicな比較交換で行う。
+座標の移動はoptimal_solver.hのpatternMoveを使うので、CubeStateの回転と同じ向きになる。
+*/
+struct PatternGeneratorOptions {
+    PatternGeneratorOptions()
+        : threads(0)
+        , checkpoint(true)
+        , verbose(true) {
+    }
+
+    int threads;      // 0ならハードウェアのスレッド数
+    bool checkpoint;  // 手数ごとに path + ".checkpoint" に途中経過を書き、あれば続きから再開する
+    bool verbose;     // 手数ごとの状態の数と速度を標準エラーに表示する (標準出力は呼び出し側の結果に使う)
+};
+
+// 書き出すファイルやチェックポイントが書けなければ、その時点でfalseを返す
+bool generatePatternDatabase(int kind, const std::string &path, const PatternGeneratorOptions &options = PatternGeneratorOptions());
+
+#endif  // _PATTERN_GENERATOR_H_
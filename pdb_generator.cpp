@@ -0,0 +1,78 @@
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <random>
+#include <string>
+
+#include "cube_state.h"
+#include "cubie_cube.h"
+#include "optimal_solver.h"
+#include "pattern_database.h"
+#include "pattern_generator.h"
+
+/*
+パターンデータベースを作るツール
+データのディレクトリ (既定はoptimal_solver.hのdefaultDataDirectory) に無い (または壊れた) ファイルだけを作る。途中で止めた場合は、
+もう一度実行するとチェックポイントの手数から再開する。
+使い方: ./pdb_generator [データのディレクトリ] [スレッド数]
+*/
+
+typedef std::chrono::steady_clock Clock;
+
+// 座標の移動が、アプリと同じCubeStateの回転 (updateCubePlane) と一致するかを確かめる
+static bool checkMoveSemantics() {
+    std::mt19937 rng(1);
+    for (int trial = 0; trial < 100; trial++) {
+        CubeState state(3, 0);
+        uint64_t index[NUM_PATTERN_KINDS];
+        for (int kind = 0; kind < NUM_PATTERN_KINDS; kind++) index[kind] = patternIndex(kind, CubieCube());
+
+        for (int k = 0; k < 30; k++) {
+            const int turn = rng() % NUM_FACE_TURNS;
+            state.apply(faceTurnToCubeMove(turn, 3));
+            for (int kind = 0; kind < NUM_PATTERN_KINDS; kind++) index[kind] = patternMove(kind, index[kind], turn);
+        }
+
+        CubieCube cube;
+        if (!cubieCubeFromState(state, &cube)) return false;
+        for (int kind = 0; kind < NUM_PATTERN_KINDS; kind++) {
+            if (patternIndex(kind, cube) != index[kind]) return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    std::string dir = argc > 1 ? argv[1] : defaultDataDirectory();
+    if (!dir.empty() && dir[dir.size() - 1] != '/') dir += "/";
+
+    PatternGeneratorOptions options;
+    options.threads = argc > 2 ? atoi(argv[2]) : 0;
+
+    if (!checkMoveSemantics()) {
+        fprintf(stderr, "Pattern moves do not match CubeState\n");
+        return 1;
+    }
+
+    if (!prepareDataDirectory(dir)) return 1;
+    for (int kind = 0; kind < NUM_PATTERN_KINDS; kind++) {
+        const std::string path = dir + patternFileName(kind);
+
+        PatternDatabase db;
+        if (db.open(path, kind, patternSize(kind))) {
+            printf("%s: already exists\n", path.c_str());
+            continue;
+        }
+
+        const Clock::time_point start = Clock::now();
+        if (!generatePatternDatabase(kind, path, options)) {
+            fprintf(stderr, "Failed to generate %s\n", path.c_str());
+            return 1;
+        }
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        printf("%s: %llu states in %.1f s (%.2f M states/s)\n", path.c_str(), (unsigned long long)patternSize(kind), seconds,
+               patternSize(kind) / seconds / 1e6);
+    }
+
+    return 0;
+}
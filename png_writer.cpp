@@ -0,0 +1,56 @@
+#include "png_writer.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <zlib.h>
+
+static void putBigEndian(std::vector<unsigned char> *out, uint32_t v) {
+    out->push_back((unsigned char)(v >> 24));
+    out->push_back((unsigned char)(v >> 16));
+    out->push_back((unsigned char)(v >> 8));
+    out->push_back((unsigned char)v);
+}
+
+// チャンク: 長さ、種類、データ、種類とデータのCRC
+static void putChunk(std::vector<unsigned char> *out, const char *type, const unsigned char *data, size_t size) {
+    putBigEndian(out, (uint32_t)size);
+    const size_t start = out->size();
+    out->insert(out->end(), type, type + 4);
+    out->insert(out->end(), data, data + size);
+    putBigEndian(out, (uint32_t)crc32(0, &(*out)[start], (uInt)(size + 4)));
+}
+
+bool writePNG(const std::string &path, int width, int height, const unsigned char *rgba, bool flipY) {
+    // 各行の先頭にフィルタの種類 (0: なし) を付けて圧縮する
+    const size_t stride = (size_t)width * 4;
+    std::vector<unsigned char> raw((stride + 1) * height);
+    for (int y = 0; y < height; y++) {
+        const unsigned char *row = rgba + stride * (flipY ? height - 1 - y : y);
+        raw[(stride + 1) * y] = 0;
+        memcpy(&raw[(stride + 1) * y + 1], row, stride);
+    }
+    uLongf compressedSize = compressBound((uLong)raw.size());
+    std::vector<unsigned char> compressed(compressedSize);
+    if (compress2(compressed.data(), &compressedSize, raw.data(), (uLong)raw.size(), Z_BEST_SPEED) != Z_OK) return false;
+
+    // IHDR: 幅、高さ、8bit、RGBA、圧縮・フィルタ・インターレースは標準
+    std::vector<unsigned char> header;
+    putBigEndian(&header, (uint32_t)width);
+    putBigEndian(&header, (uint32_t)height);
+    const unsigned char format[5] = { 8, 6, 0, 0, 0 };
+    header.insert(header.end(), format, format + 5);
+
+    static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    std::vector<unsigned char> png(signature, signature + 8);
+    putChunk(&png, "IHDR", header.data(), header.size());
+    putChunk(&png, "IDAT", compressed.data(), compressedSize);
+    putChunk(&png, "IEND", NULL, 0);
+
+    FILE *fp = fopen(path.c_str(), "wb");
+    if (fp == NULL) return false;
+    const bool ok = fwrite(png.data(), 1, png.size(), fp) == png.size();
+    return fclose(fp) == 0 && ok;
+}
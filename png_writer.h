@@ -0,0 +1,12 @@
+#ifndef _PNG_WRITER_H_
+#define _PNG_WRITER_H_
+
+#include <string>
+
+/*
+RGBA (1画素4バイト) の画像をPNGで書き出す (圧縮はzlib)。
+flipYなら下の行から順に並んだ画像 (glReadPixelsの結果) として上下を反転する。
+*/
+bool writePNG(const std::string &path, int width, int height, const unsigned char *rgba, bool flipY);
+
+#endif  // _PNG_WRITER_H_
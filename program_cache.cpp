@@ -0,0 +1,141 @@
+#include "program_cache.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char PROGRAM_CACHE_MAGIC[8] = { 'C', 'U', 'B', 'E', 'P', 'R', 'G', '\0' };
+static const uint32_t PROGRAM_CACHE_VERSION = 1;
+
+// ファイルの先頭
+struct ProgramCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t format;
+    uint32_t length;
+    uint32_t reserved;
+};
+
+// FNV-1a (終端の0も混ぜて、文字列の区切りを区別する)
+static uint64_t hashString(uint64_t h, const char *s) {
+    if (s == NULL) s = "";
+    do {
+        h ^= (uint8_t)*s;
+        h *= 1099511628211ull;
+    } while (*s++ != '\0');
+    return h;
+}
+
+// ドライバがバイナリの形式formatを受け付けるか
+static bool supportsFormat(GLenum format) {
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &count);
+    if (count <= 0) return false;
+
+    std::vector<GLint> formats(count);
+    glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, formats.data());
+    for (int i = 0; i < count; i++) {
+        if ((GLenum)formats[i] == format) return true;
+    }
+    return false;
+}
+
+// pathの途中のディレクトリを全て作る (最後の/より後はファイル名)
+static void makeParentDirectories(const std::string &path) {
+    for (size_t slash = path.find('/', 1); slash != std::string::npos; slash = path.find('/', slash + 1)) {
+        mkdir(path.substr(0, slash).c_str(), 0755);
+    }
+}
+
+std::string programCacheDirectory() {
+    std::string directory;
+    const char *env = getenv("CUBE_SHADER_CACHE");
+    if (env != NULL) {
+        directory = env;
+    } else if ((env = getenv("XDG_CACHE_HOME")) != NULL && env[0] == '/') {
+        directory = std::string(env) + "/rubiks-cube/shader_cache/";
+    } else if ((env = getenv("HOME")) != NULL && env[0] != '\0') {
+        directory = std::string(env) + "/.cache/rubiks-cube/shader_cache/";
+    }
+    if (!directory.empty() && directory[directory.size() - 1] != '/') directory += '/';
+    return directory;
+}
+
+std::string programCachePath(const std::string &directory, const std::string &defines, const char *vertSource, const char *fragSource) {
+    uint64_t h = 14695981039346656037ull;
+    h = hashString(h, (const char *)glGetString(GL_VENDOR));
+    h = hashString(h, (const char *)glGetString(GL_RENDERER));
+    h = hashString(h, (const char *)glGetString(GL_VERSION));
+    h = hashString(h, defines.c_str());
+    h = hashString(h, vertSource);
+    h = hashString(h, fragSource);
+
+    char name[64];
+    snprintf(name, sizeof(name), "program_%016llx.bin", (unsigned long long)h);
+    return directory + name;
+}
+
+bool loadProgramBinary(GLuint program, const std::string &path) {
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (fp == NULL) return false;
+
+    ProgramCacheHeader header;
+    std::vector<char> binary;
+    bool ok = fread(&header, 1, sizeof(header), fp) == sizeof(header);
+    ok = ok && memcmp(header.magic, PROGRAM_CACHE_MAGIC, sizeof(PROGRAM_CACHE_MAGIC)) == 0 &&
+         header.version == PROGRAM_CACHE_VERSION && header.length > 0;
+    if (ok) {
+        binary.resize(header.length);
+        ok = fread(binary.data(), 1, binary.size(), fp) == binary.size();
+    }
+    fclose(fp);
+
+    // 形式を受け付けないドライバに渡すとGLのエラーになるので、先に確かめる
+    if (!ok || !supportsFormat(header.format)) return false;
+
+    glProgramBinary(program, header.format, binary.data(), (GLsizei)binary.size());
+    GLint linkState = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linkState);
+    return linkState == GL_TRUE;
+}
+
+bool saveProgramBinary(GLuint program, const std::string &path) {
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &count);
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (count <= 0 || length <= 0) return false;
+
+    ProgramCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PROGRAM_CACHE_MAGIC, sizeof(PROGRAM_CACHE_MAGIC));
+    header.version = PROGRAM_CACHE_VERSION;
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &length, &format, binary.data());
+    header.format = format;
+    header.length = (uint32_t)length;
+
+    // 置き場所が無ければ作る
+    makeParentDirectories(path);
+
+    // 途中で止まっても壊れたファイルが残らないように、別の名前で書いてから置き換える
+    // (一時ファイルの名前はプロセスごとに変え、同時に書く他のプロセスと混ざらないようにする)
+    const std::string tmpPath = path + ".tmp." + std::to_string(getpid());
+    FILE *fp = fopen(tmpPath.c_str(), "wb");
+    if (fp == NULL) return false;
+    bool ok = fwrite(&header, 1, sizeof(header), fp) == sizeof(header);
+    ok = ok && fwrite(binary.data(), 1, (size_t)length, fp) == (size_t)length;
+    ok = fclose(fp) == 0 && ok;
+    if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0) {
+        remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,32 @@
+#ifndef _PROGRAM_CACHE_H_
+#define _PROGRAM_CACHE_H_
+
+#include <string>
+
+#include <glad/gl.h>
+
+/*
+シェーダプログラムのバイナリのキャッシュ。
+リンクしたプログラムをglGetProgramBinaryでファイルに保存しておき、次の起動ではglProgramBinaryで読み込んで
+コンパイルとリンクを省く (ソフトウェアのOpenGLでは、最初の画面が出るまでの時間の大半がコンパイルとリンク)。
+ファイル名はドライバ (GL_VENDOR, GL_RENDERER, GL_VERSION) とシェーダのソースのハッシュで決めるので、
+どちらかが変わると別のファイルになる。読み込めない時やドライバが受け付けない時はソースから作り直せばよい。
+*/
+
+// キャッシュを置くディレクトリ (/で終わる。空ならキャッシュを使わない)
+// 環境変数CUBE_SHADER_CACHEがあればそれ (空ならキャッシュを使わない)、無ければ$XDG_CACHE_HOME/rubiks-cube/shader_cache/、
+// それも無ければ$HOME/.cache/rubiks-cube/shader_cache/
+std::string programCacheDirectory();
+
+// キャッシュのファイルのパス (directory/program_ハッシュ.bin、directoryは/で終わる)
+// definesはソースの先頭に足した#define (同じソースでも#defineが違えば別のプログラム)
+std::string programCachePath(const std::string &directory, const std::string &defines, const char *vertSource, const char *fragSource);
+
+// pathのバイナリをprogramに読み込む (リンクが成功した時だけtrue)
+bool loadProgramBinary(GLuint program, const std::string &path);
+
+// リンク済みのprogramのバイナリをpathに保存する (リンクの前にGL_PROGRAM_BINARY_RETRIEVABLE_HINTを付けておく)
+// 途中のディレクトリが無ければ作る。書けない時は何も言わずにfalseを返す (キャッシュが無くても動くので)
+bool saveProgramBinary(GLuint program, const std::string &path);
+
+#endif  // _PROGRAM_CACHE_H_
@@ -0,0 +1,84 @@
+#include "ray_pick.h"
+
+#include <cmath>
+#include <limits>
+#include <utility>
+
+// 軸と向きから面の番号 (R, U, F, B, D, L)
+static int faceOfAxis(int axis, bool positive) {
+    static const int positiveFaces[3] = { 0, 1, 2 };
+    static const int negativeFaces[3] = { 5, 4, 3 };
+    return positive ? positiveFaces[axis] : negativeFaces[axis];
+}
+
+// 一番大きい成分の軸と向きから面の番号
+static int faceOfDirection(const float *v) {
+    int axis = 0;
+    for (int k = 1; k < 3; k++) {
+        if (std::fabs(v[k]) > std::fabs(v[axis])) axis = k;
+    }
+    return faceOfAxis(axis, v[axis] > 0.0f);
+}
+
+bool pickRigidBoxes(const float *origin, const float *direction, const RigidTransformsSoA &transforms, const int *boxIds,
+                    const float *boxMin, const float *boxMax, RayHit *hit) {
+    const float length = std::sqrt(direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2]);
+    if (length <= 0.0f) return false;
+    const float d[3] = { direction[0] / length, direction[1] / length, direction[2] / length };
+
+    float best = std::numeric_limits<float>::infinity();
+    int bestCubie = -1, bestAxis = 0;
+    bool bestPositive = false;
+    for (int i = 0; i < transforms.count; i++) {
+        // 光線をキューブの局所座標に移す (回転の転置を掛けてから初期位置を引く)
+        float o[3], dl[3];
+        for (int col = 0; col < 3; col++) {
+            const float r0 = transforms.r[3 * col + 0][i], r1 = transforms.r[3 * col + 1][i], r2 = transforms.r[3 * col + 2][i];
+            o[col] = r0 * origin[0] + r1 * origin[1] + r2 * origin[2] - transforms.p[col][i];
+            dl[col] = r0 * d[0] + r1 * d[1] + r2 * d[2];
+        }
+
+        // スラブ法: 3軸の区間の共通部分が光線と箱の交わり
+        const float *lo = boxMin + 3 * boxIds[i];
+        const float *hi = boxMax + 3 * boxIds[i];
+        float tNear = -std::numeric_limits<float>::infinity(), tFar = std::numeric_limits<float>::infinity();
+        int nearAxis = 0;
+        bool nearPositive = false;
+        bool missed = false;
+        for (int k = 0; k < 3 && !missed; k++) {
+            if (dl[k] == 0.0f) {
+                missed = o[k] < lo[k] || o[k] > hi[k];
+                continue;
+            }
+            float t0 = (lo[k] - o[k]) / dl[k], t1 = (hi[k] - o[k]) / dl[k];
+            // 入る面は、光線が正の向きに進むなら最小の側、負の向きなら最大の側
+            const bool positive = dl[k] < 0.0f;
+            if (t0 > t1) std::swap(t0, t1);
+            if (t0 > tNear) {
+                tNear = t0;
+                nearAxis = k;
+                nearPositive = positive;
+            }
+            if (t1 < tFar) tFar = t1;
+            missed = tNear > tFar;
+        }
+        if (missed || tFar < 0.0f || tNear < 0.0f || tNear >= best) continue;
+
+        best = tNear;
+        bestCubie = i;
+        bestAxis = nearAxis;
+        bestPositive = nearPositive;
+    }
+    if (bestCubie < 0) return false;
+
+    // 局所座標の面の法線を今の向きに回して、どちらを向いているかを求める
+    const float sign = bestPositive ? 1.0f : -1.0f;
+    float normal[3];
+    for (int row = 0; row < 3; row++) normal[row] = transforms.r[3 * bestAxis + row][bestCubie] * sign;
+
+    hit->cubie = bestCubie;
+    hit->face = faceOfDirection(normal);
+    hit->sticker = faceOfAxis(bestAxis, bestPositive);
+    hit->t = best;
+    return true;
+}
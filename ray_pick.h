@@ -0,0 +1,35 @@
+#ifndef _RAY_PICK_H_
+#define _RAY_PICK_H_
+
+#include "transform_batch.h"
+
+/*
+RayHit
+cubie: 当たったキューブの番号
+face: 当たった面の、今の向きでの方向 (CubeStateの面の番号 R, U, F, B, D, L)
+sticker: 当たった面の、キューブの初期の向きでの方向 (= ステッカーの色)
+t: 光線の始点からの距離 (方向ベクトルの長さを1とする)
+*/
+struct RayHit {
+    RayHit()
+        : cubie(-1)
+        , face(-1)
+        , sticker(-1)
+        , t(0.0f) {
+    }
+
+    int cubie;
+    int face;
+    int sticker;
+    float t;
+};
+
+/*
+光線と全キューブの箱 (キューブの局所座標での軸に平行な箱) の交差を調べ、一番手前のものを返す。
+光線はcomposeRigidTransformsのprefixを掛ける前の座標で与える (キューブiの点vは R_i * (v + p_i) にある)。
+boxIds[i]: キューブiの箱の番号、boxMin/boxMax: 箱ごとの最小・最大の座標 (3つずつ)
+*/
+bool pickRigidBoxes(const float *origin, const float *direction, const RigidTransformsSoA &transforms, const int *boxIds,
+                    const float *boxMin, const float *boxMax, RayHit *hit);
+
+#endif  // _RAY_PICK_H_
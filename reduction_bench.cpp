@@ -0,0 +1,97 @@
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "reduction_solver.h"
+
+/*
+還元法のソルバのベンチマーク
+N x Nのキューブをランダムな回転操作で崩して解き、1秒あたりの解の数と段階ごとの手数を表示する。
+使い方: ./reduction_bench [N] [状態の数] [崩す手数] [乱数の種] [モード]
+*/
+
+typedef std::chrono::steady_clock Clock;
+
+static double elapsedSeconds(const Clock::time_point &start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// 揃ったか (ミラーブロックスでは形でセンターの向きも見えるので、全てのキューブの向きが0であることも確かめる)
+static bool isSolvedState(const CubeState &s) {
+    if (!s.isSolved()) return false;
+    if (s.mode() != 1) return true;
+    for (int c = 0; c < s.numCubies(); c++) {
+        if (s.orientation(c) != 0) return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    const int N = argc > 1 ? atoi(argv[1]) : 9;
+    const int count = argc > 2 ? atoi(argv[2]) : 100;
+    const int scrambleLength = argc > 3 ? atoi(argv[3]) : 20 * N;
+    const unsigned int seed = argc > 4 ? (unsigned int)atoi(argv[4]) : 1;
+    const int mode = argc > 5 ? atoi(argv[5]) : 0;
+    if (N < 1 || N > REDUCTION_MAX_N || count < 1) {
+        fprintf(stderr, "usage: %s [N (1 ~ %d)] [count] [scramble length] [seed] [mode]\n", argv[0], REDUCTION_MAX_N);
+        return 1;
+    }
+
+    // 表を作る時間は別に測る
+    Clock::time_point start = Clock::now();
+    initReductionTables(N, mode);
+    printf("Tables: %.2f s (N = %d)\n", elapsedSeconds(start), N);
+
+    std::mt19937 rng(seed);
+    std::vector<CubeState> states;
+    for (int i = 0; i < count; i++) {
+        CubeState s(N, mode);
+        for (int k = 0; k < scrambleLength; k++) {
+            s.apply(CubeMove((int)(rng() % 3), (int)(rng() % N), (int)(rng() % 3) + 1));
+        }
+        states.push_back(s);
+    }
+
+    std::vector<std::vector<CubeMove> > solutions(count);
+    std::vector<ReductionStats> stats(count);
+    int failed = 0;
+    start = Clock::now();
+    double maxSeconds = 0.0;
+    for (int i = 0; i < count; i++) {
+        const Clock::time_point t = Clock::now();
+        if (!solveReduction(states[i], &solutions[i], &stats[i])) failed++;
+        maxSeconds = std::max(maxSeconds, elapsedSeconds(t));
+    }
+    const double seconds = elapsedSeconds(start);
+
+    // 解を施して揃うかを確かめる
+    int wrong = 0, maxFound = 0;
+    double total = 0, orient = 0, parity = 0, centers = 0, edges = 0, finish = 0;
+    for (int i = 0; i < count; i++) {
+        // 解けなかった状態はfailedに数えてある
+        if (solutions[i].empty() && !isSolvedState(states[i])) continue;
+
+        CubeState s = states[i];
+        s.apply(solutions[i]);
+        if (!isSolvedState(s)) wrong++;
+
+        total += (double)solutions[i].size();
+        maxFound = std::max(maxFound, (int)solutions[i].size());
+        orient += stats[i].orientMoves;
+        parity += stats[i].parityMoves;
+        centers += stats[i].centerMoves;
+        edges += stats[i].edgeMoves;
+        finish += stats[i].finishMoves;
+    }
+
+    printf("Solved: %d / %d (scramble %d moves, wrong %d)\n", count - failed - wrong, count, scrambleLength, wrong);
+    printf("Moves: %.1f average, %d max (orient %.1f, parity %.1f, centers %.1f, edges %.1f, 3x3 %.1f)\n", total / count, maxFound,
+           orient / count, parity / count, centers / count, edges / count, finish / count);
+    printf("Time: %.3f s, %.3f ms/solve (max %.3f ms), %.1f solves/s\n", seconds, seconds * 1000.0 / count, maxSeconds * 1000.0,
+           count / seconds);
+
+    return failed == 0 && wrong == 0 ? 0 : 1;
+}
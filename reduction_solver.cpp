@@ -0,0 +1,547 @@
+#include "reduction_solver.h"
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+#include "cubie_cube.h"
+#include "two_phase.h"
+
+// 3-cycleで揃える軌道の大きさ (センターとウイングはどちらも24個)
+static const int ORBIT_SIZE = 24;
+
+// 3-cycle (a -> b -> c) の番号。一番小さい番号が先頭になるように回してから番号にする。
+static int cycleKey(int a, int b, int c) {
+    if (b < a && b < c) return (b * ORBIT_SIZE + c) * ORBIT_SIZE + a;
+    if (c < a && c < b) return (c * ORBIT_SIZE + a) * ORBIT_SIZE + b;
+    return (a * ORBIT_SIZE + b) * ORBIT_SIZE + c;
+}
+
+/*
+Commutator
+[A, B] = A B A' B' (B = X Y X')。invertedなら逆の [B, A] を表す。
+Aは内側の層の90度の回転で、Aで動く位置とBで動く位置の共通部分が一つだけなので、
+A'(p) -> p -> B'(p) の3つの位置だけが入れ替わる。xが-1ならB = Y。
+*/
+struct Commutator {
+    int a;
+    int x;
+    int y;
+    bool inverted;
+};
+
+/*
+CycleEntry
+軌道の中の3-cycleを作る手順。準備の手setupで挟んだ (setup, parentの手順, setup') か、
+基本の交換子baseのどちらか。costは全体の手数 (-1なら作れない)。
+*/
+struct CycleEntry {
+    CycleEntry()
+        : cost(-1)
+        , base(-1)
+        , parent(-1)
+        , setup(-1) {
+    }
+
+    int cost;
+    int base;
+    int parent;
+    int setup;
+};
+
+/*
+PieceOrbit
+回転操作で互いに移り合う位置の集まり (センターの軌道か、ウイングの軌道)。
+cyclesは cycleKey() で引く。
+*/
+struct PieceOrbit {
+    int type;
+    std::vector<int> positions;
+    std::vector<CycleEntry> cycles;
+};
+
+/*
+ReductionTables
+moves: 全ての回転操作 (番号は (axis * N + layer) * 3 + turns - 1)
+sliceSlot: 位置pが軸axisの回転面で動く4つ組の中の何番目か (topology().slicePosの番号、回転軸上や空の位置は-1)。
+回転操作ごとの置換をN^3の表で持つと9N * N^3になるので、回転面の4つ組から movePos で求める。
+orbitOf / localIndex: 位置 -> 軌道の番号と軌道の中の番号 (3-cycleで揃えない位置は-1)
+*/
+struct ReductionTables {
+    ReductionTables(int N, int mode);
+
+    // 回転操作mで位置pのキューブが移る位置
+    int movePos(int m, int p) const;
+    // 位置pが回転面 (axis, layer) の回転で動くか (その回転面の番号を返す、動かなければ-1)
+    int movingSlice(int axis, int p) const { return sliceSlot[axis * N * N * N + p] >= 0 ? axis * N + coord(p, axis) : -1; }
+
+    int coord(int p, int axis) const { return axis == 0 ? p / (N * N) : axis == 1 ? p / N % N : p % N; }
+
+    int N;
+    int mode;
+    std::shared_ptr<const CubeTopology> topo;
+    std::vector<CubeMove> moves;
+    std::vector<int> inverse;
+    std::vector<int> sliceSlot;
+    std::vector<int> orbitOf;
+    std::vector<int> localIndex;
+    std::vector<PieceOrbit> orbits;
+    std::vector<Commutator> commutators;
+};
+
+static int findRoot(std::vector<int> &parent, int p) {
+    while (parent[p] != p) {
+        parent[p] = parent[parent[p]];
+        p = parent[p];
+    }
+    return p;
+}
+
+int ReductionTables::movePos(int m, int p) const {
+    const CubeMove &move = moves[m];
+    const int k = sliceSlot[move.axis * N * N * N + p];
+    if (k < 0 || coord(p, move.axis) != move.layer) return p;
+    const int begin = topo->sliceBegin[move.axis * N + move.layer];
+    const int base = k - (k - begin) % 4;
+    return topo->slicePos[base + ((k - base + move.turns) & 3)];
+}
+
+ReductionTables::ReductionTables(int N_, int mode_)
+    : N(N_)
+    , mode(mode_)
+    , topo(getCubeTopology(N_, mode_)) {
+    const CubeState solved(N, mode);
+    const int numPos = N * N * N;
+
+    sliceSlot.assign(3 * numPos, -1);
+    for (int axis = 0; axis < 3; axis++) {
+        for (int layer = 0; layer < N; layer++) {
+            const int s = axis * N + layer;
+            for (int k = topo->sliceBegin[s]; k < topo->sliceFixed[s]; k++) sliceSlot[axis * numPos + topo->slicePos[k]] = k;
+            for (int turns = 1; turns <= 3; turns++) {
+                moves.push_back(CubeMove(axis, layer, turns));
+                inverse.push_back(s * 3 + 3 - turns);
+            }
+        }
+    }
+    const int numMoves = (int)moves.size();
+    const int numSlices = 3 * N;
+
+    // 回転操作で移り合う位置をまとめて軌道にする (回転面の4つ組をつなぐだけでよい)
+    std::vector<int> parent(numPos);
+    for (int i = 0; i < numPos; i++) parent[i] = i;
+    for (int s = 0; s < numSlices; s++) {
+        for (int k = topo->sliceBegin[s]; k < topo->sliceFixed[s]; k++) {
+            const int next = (k - topo->sliceBegin[s]) % 4 == 3 ? k - 3 : k + 1;
+            const int a = findRoot(parent, topo->slicePos[k]), b = findRoot(parent, topo->slicePos[next]);
+            if (a != b) parent[a] = b;
+        }
+    }
+    // 軌道の番号は一番小さい位置の順 (根の選び方によらない)
+    std::map<int, std::vector<int> > roots;
+    for (int i = 0; i < numPos; i++) {
+        if (solved.cubeAt(i) >= 0) roots[findRoot(parent, i)].push_back(i);
+    }
+    std::map<int, std::vector<int> > groups;
+    for (std::map<int, std::vector<int> >::iterator it = roots.begin(); it != roots.end(); ++it) groups[it->second[0]].swap(it->second);
+
+    orbitOf.assign(numPos, -1);
+    localIndex.assign(numPos, -1);
+    for (std::map<int, std::vector<int> >::const_iterator it = groups.begin(); it != groups.end(); ++it) {
+        // 角、中央の辺、真ん中のセンターは3x3の段階で揃える
+        const int type = solved.cubeType(solved.cubeAt(it->second[0]));
+        if ((int)it->second.size() != ORBIT_SIZE || (type != 2 && type != 3)) continue;
+
+        PieceOrbit orbit;
+        orbit.type = type;
+        orbit.positions = it->second;
+        orbit.cycles.resize(ORBIT_SIZE * ORBIT_SIZE * ORBIT_SIZE);
+        for (int i = 0; i < ORBIT_SIZE; i++) {
+            orbitOf[orbit.positions[i]] = (int)orbits.size();
+            localIndex[orbit.positions[i]] = i;
+        }
+        orbits.push_back(orbit);
+    }
+    if (orbits.empty()) return;
+
+    /*
+    動く位置の共通部分が一つだけになる交換子を探す
+    Aで動く位置をXで移した先を回転面ごとに数えておけば (hitCount)、Yの回転面の数が1のものだけが候補になる。
+    */
+    std::vector<int> hitCount((numMoves + 1) * numSlices), hitPos((numMoves + 1) * numSlices);
+    for (int a = 0; a < numMoves; a++) {
+        if (moves[a].layer == 0 || moves[a].layer == N - 1 || moves[a].turns == 2) continue;
+        const int sa = moves[a].axis * N + moves[a].layer;
+
+        std::fill(hitCount.begin(), hitCount.end(), 0);
+        for (int x = -1; x < numMoves; x++) {
+            int *count = &hitCount[(x + 1) * numSlices];
+            int *last = &hitPos[(x + 1) * numSlices];
+            for (int k = topo->sliceBegin[sa]; k < topo->sliceFixed[sa]; k++) {
+                const int q = topo->slicePos[k];
+                const int r = x < 0 ? q : movePos(x, q);
+                for (int axis = 0; axis < 3; axis++) {
+                    const int s = movingSlice(axis, r);
+                    if (s < 0) continue;
+                    count[s]++;
+                    last[s] = q;
+                }
+            }
+        }
+
+        for (int y = 0; y < numMoves; y++) {
+            const int sy = moves[y].axis * N + moves[y].layer;
+            for (int x = -1; x < numMoves; x++) {
+                if (x >= 0 && moves[x].axis == moves[y].axis) continue;
+                if (hitCount[(x + 1) * numSlices + sy] != 1) continue;
+                const int p = hitPos[(x + 1) * numSlices + sy];
+                if (orbitOf[p] < 0) continue;
+
+                // A'(p) -> p -> B'(p)
+                int bp = x < 0 ? p : movePos(x, p);
+                bp = movePos(inverse[y], bp);
+                if (x >= 0) bp = movePos(inverse[x], bp);
+                const int c[3] = { localIndex[movePos(inverse[a], p)], localIndex[p], localIndex[bp] };
+                const int cost = x < 0 ? 4 : 8;
+
+                PieceOrbit &orbit = orbits[orbitOf[p]];
+                for (int inv = 0; inv < 2; inv++) {
+                    const int key = inv ? cycleKey(c[0], c[2], c[1]) : cycleKey(c[0], c[1], c[2]);
+                    CycleEntry &e = orbit.cycles[key];
+                    if (e.cost >= 0 && e.cost <= cost) continue;
+                    Commutator comm = { a, x, y, inv == 1 };
+                    e.cost = cost;
+                    e.base = (int)commutators.size();
+                    commutators.push_back(comm);
+                }
+            }
+        }
+    }
+
+    // 準備の手で挟んで、軌道の中の全ての3-cycleを手数の短い順に作る
+    for (size_t o = 0; o < orbits.size(); o++) {
+        std::vector<CycleEntry> &cycles = orbits[o].cycles;
+        const std::vector<int> &positions = orbits[o].positions;
+
+        // 軌道の位置を動かす回転操作だけを準備の手にする (他の手では3つ組が変わらない)
+        std::vector<int> setups;
+        for (int m = 0; m < numMoves; m++) {
+            for (int i = 0; i < ORBIT_SIZE; i++) {
+                if (movePos(m, positions[i]) != positions[i]) {
+                    setups.push_back(m);
+                    break;
+                }
+            }
+        }
+
+        std::vector<std::vector<int> > buckets;
+        for (int key = 0; key < (int)cycles.size(); key++) {
+            if (cycles[key].cost < 0) continue;
+            if ((int)buckets.size() <= cycles[key].cost) buckets.resize(cycles[key].cost + 1);
+            buckets[cycles[key].cost].push_back(key);
+        }
+        for (int cost = 0; cost < (int)buckets.size(); cost++) {
+            for (size_t i = 0; i < buckets[cost].size(); i++) {
+                const int key = buckets[cost][i];
+                if (cycles[key].cost != cost) continue;
+
+                const int c[3] = { key / (ORBIT_SIZE * ORBIT_SIZE), key / ORBIT_SIZE % ORBIT_SIZE, key % ORBIT_SIZE };
+                for (size_t j = 0; j < setups.size(); j++) {
+                    // 準備の手mを先に施すと、mで移った先の位置が入れ替わる
+                    const int m = setups[j], back = inverse[m];
+                    const int next = cycleKey(localIndex[movePos(back, positions[c[0]])], localIndex[movePos(back, positions[c[1]])],
+                                              localIndex[movePos(back, positions[c[2]])]);
+                    CycleEntry &e = cycles[next];
+                    if (e.cost >= 0 && e.cost <= cost + 2) continue;
+                    e.cost = cost + 2;
+                    e.base = -1;
+                    e.parent = key;
+                    e.setup = m;
+                    if ((int)buckets.size() <= cost + 2) buckets.resize(cost + 3);
+                    buckets[cost + 2].push_back(next);
+                }
+            }
+        }
+    }
+}
+
+static const ReductionTables &reductionTables(int N, int mode) {
+    static std::mutex mutex;
+    static std::map<std::pair<int, bool>, std::shared_ptr<const ReductionTables> > cache;
+
+    const bool voidCube = (mode == 2 && N > 1);
+    std::lock_guard<std::mutex> lock(mutex);
+    std::shared_ptr<const ReductionTables> &t = cache[std::make_pair(N, voidCube)];
+    if (!t) t = std::make_shared<ReductionTables>(N, mode);
+    return *t;
+}
+
+void initReductionTables(int N, int mode) {
+    if (N <= REDUCTION_MAX_N) reductionTables(N, mode);
+    initTwoPhaseTables();
+}
+
+/*
+回転操作を追加する
+同じ軸の回転は互いに可換なので、末尾に並ぶ同じ軸の回転の中に同じ層があればまとめる。
+*/
+static void appendMove(std::vector<CubeMove> *moves, const CubeMove &move) {
+    for (int i = (int)moves->size() - 1; i >= 0 && (*moves)[i].axis == move.axis; i--) {
+        CubeMove &m = (*moves)[i];
+        if (m.layer != move.layer) continue;
+        m.turns = (m.turns + move.turns) & 3;
+        if (m.turns == 0) moves->erase(moves->begin() + i);
+        return;
+    }
+    moves->push_back(move);
+}
+
+static void appendCommutator(const ReductionTables &t, const Commutator &c, std::vector<CubeMove> *out) {
+    // B = X Y X'
+    std::vector<CubeMove> b, bInv;
+    if (c.x >= 0) b.push_back(t.moves[c.x]);
+    b.push_back(t.moves[c.y]);
+    if (c.x >= 0) b.push_back(t.moves[t.inverse[c.x]]);
+    for (int i = (int)b.size() - 1; i >= 0; i--) bInv.push_back(CubeMove(b[i].axis, b[i].layer, 4 - b[i].turns));
+
+    const CubeMove a = t.moves[c.a], aInv = t.moves[t.inverse[c.a]];
+    if (c.inverted) {
+        out->insert(out->end(), b.begin(), b.end());
+        out->push_back(a);
+        out->insert(out->end(), bInv.begin(), bInv.end());
+        out->push_back(aInv);
+    } else {
+        out->push_back(a);
+        out->insert(out->end(), b.begin(), b.end());
+        out->push_back(aInv);
+        out->insert(out->end(), bInv.begin(), bInv.end());
+    }
+}
+
+static void appendCycle(const ReductionTables &t, const PieceOrbit &orbit, int key, std::vector<CubeMove> *out) {
+    const CycleEntry &e = orbit.cycles[key];
+    if (e.base >= 0) {
+        appendCommutator(t, t.commutators[e.base], out);
+        return;
+    }
+    out->push_back(t.moves[e.setup]);
+    appendCycle(t, orbit, e.parent, out);
+    out->push_back(t.moves[t.inverse[e.setup]]);
+}
+
+/*
+軌道の中の位置iにwant[i]を揃える (have[i]は今の位置iのもの)
+揃っていない位置を1つ以上揃える3-cycleのうち、1手あたりに揃う数が一番多いものを繰り返し施す。
+*/
+static bool solveOrbit(const ReductionTables &t, const PieceOrbit &orbit, const int *want, int *have, CubeState *work, std::vector<CubeMove> *moves) {
+    for (;;) {
+        int bestKey = -1, bestGain = 0, bestCost = 0;
+        for (int x = 0; x < ORBIT_SIZE; x++) {
+            if (have[x] == want[x]) continue;
+            for (int y = 0; y < ORBIT_SIZE; y++) {
+                if (y == x || have[y] == want[y] || have[x] != want[y]) continue;
+                for (int z = 0; z < ORBIT_SIZE; z++) {
+                    if (z == x || z == y) continue;
+                    const int key = cycleKey(x, y, z);
+                    const int cost = orbit.cycles[key].cost;
+                    if (cost < 0) continue;
+
+                    // x -> y -> z -> x と動かした後に揃う数の増え方
+                    const int gain = 1 + (have[y] == want[z]) + (have[z] == want[x]) - (have[z] == want[z]);
+                    if (gain <= 0) continue;
+                    if (bestKey < 0 || gain * bestCost > bestGain * cost || (gain * bestCost == bestGain * cost && cost < bestCost)) {
+                        bestKey = key;
+                        bestGain = gain;
+                        bestCost = cost;
+                    }
+                }
+            }
+        }
+        if (bestKey < 0) break;
+
+        std::vector<CubeMove> seq;
+        appendCycle(t, orbit, bestKey, &seq);
+        for (size_t i = 0; i < seq.size(); i++) {
+            work->apply(seq[i]);
+            appendMove(moves, seq[i]);
+        }
+
+        const int a = bestKey / (ORBIT_SIZE * ORBIT_SIZE), b = bestKey / ORBIT_SIZE % ORBIT_SIZE, c = bestKey % ORBIT_SIZE;
+        const int h = have[c];
+        have[c] = have[b];
+        have[b] = have[a];
+        have[a] = h;
+    }
+
+    for (int i = 0; i < ORBIT_SIZE; i++) {
+        if (have[i] != want[i]) return false;
+    }
+    return true;
+}
+
+// センターの位置が乗っている面
+static int centerFace(const CubeState &state, int pos) {
+    const int N = state.size();
+    int x, y, z;
+    state.posCoord(pos, &x, &y, &z);
+    if (x == N - 1) return FACE_R;
+    if (x == 0) return FACE_L;
+    if (y == N - 1) return FACE_U;
+    if (y == 0) return FACE_D;
+    return z == N - 1 ? FACE_F : FACE_B;
+}
+
+static void applyMoves(const std::vector<CubeMove> &seq, CubeState *work, std::vector<CubeMove> *moves) {
+    for (size_t i = 0; i < seq.size(); i++) {
+        work->apply(seq[i]);
+        appendMove(moves, seq[i]);
+    }
+}
+
+/*
+Nが奇数の場合、中央の層を回して向きを決める
+真ん中のセンターが元の面に戻り、色をそのまま読んだ3x3の状態が揃えられるものを幅優先で探す
+(ボイドキューブにはセンターが無いので、3x3の状態だけで決める)。
+*/
+static bool orientCube(CubeState *work, std::vector<CubeMove> *moves) {
+    const int N = work->size();
+    CubieCube cube;
+    if (N % 2 == 0) return cubieCubeFromStateAsIs(*work, &cube);
+
+    const int mid = N / 2;
+    std::vector<std::vector<CubeMove> > queue(1);
+    std::vector<bool> visited(24, false);
+    visited[0] = true;
+    std::vector<int> rotations(1, 0);
+    for (size_t i = 0; i < queue.size(); i++) {
+        CubeState s = *work;
+        s.apply(queue[i]);
+
+        bool home = true;
+        if (s.cubeAt(N - 1, mid, mid) >= 0) {
+            for (int f = 0; f < 6 && home; f++) {
+                const int axis = f == FACE_R || f == FACE_L ? 0 : f == FACE_U || f == FACE_D ? 1 : 2;
+                int g[3] = { mid, mid, mid };
+                g[axis] = f < 3 ? N - 1 : 0;
+                home = s.stickerAt(f, g[0], g[1], g[2]) == f;
+            }
+        }
+        if (home && cubieCubeFromStateAsIs(s, &cube)) {
+            applyMoves(queue[i], work, moves);
+            return true;
+        }
+
+        for (int axis = 0; axis < 3; axis++) {
+            for (int turns = 1; turns <= 3; turns++) {
+                const int r = composeRotation(quarterTurnRotation(axis, turns), rotations[i]);
+                if (visited[r]) continue;
+                visited[r] = true;
+                std::vector<CubeMove> next = queue[i];
+                next.push_back(CubeMove(axis, mid, turns));
+                queue.push_back(next);
+                rotations.push_back(r);
+            }
+        }
+    }
+    return false;
+}
+
+// 置換 (位置i -> perm[i]) の偶奇
+static int permutationParity(const int *perm, int n) {
+    std::vector<bool> visited(n, false);
+    int parity = 0;
+    for (int i = 0; i < n; i++) {
+        if (visited[i]) continue;
+        for (int j = perm[i]; j != i; j = perm[j]) {
+            visited[j] = true;
+            parity ^= 1;
+        }
+        visited[i] = true;
+    }
+    return parity;
+}
+
+bool solveReduction(const CubeState &state, std::vector<CubeMove> *moves, ReductionStats *stats) {
+    moves->clear();
+    const int N = state.size();
+    if (N < 2) return true;
+    if (N > REDUCTION_MAX_N || state.mode() == 1) return false;
+
+    const ReductionTables &t = reductionTables(N, state.mode());
+    const CubeTopology &topo = state.topology();
+    CubeState work = state;
+
+    std::vector<CubeMove> orientMoves;
+    if (!orientCube(&work, &orientMoves)) return false;
+
+    // ウイングの置換が奇数の軌道は、その軌道のウイングを4つ含む内側の層を90度回す
+    std::vector<CubeMove> parityMoves;
+    for (size_t o = 0; o < t.orbits.size(); o++) {
+        const PieceOrbit &orbit = t.orbits[o];
+        if (orbit.type != 2) continue;
+
+        int home[ORBIT_SIZE];
+        for (int i = 0; i < ORBIT_SIZE; i++) home[i] = t.localIndex[topo.homePos[work.cubeAt(orbit.positions[i])]];
+        if (permutationParity(home, ORBIT_SIZE) == 0) continue;
+
+        // ウイングの辺に沿った軸の座標がそのまま層の番号になる
+        int g[3];
+        work.posCoord(orbit.positions[0], &g[0], &g[1], &g[2]);
+        int axis = 0;
+        while (g[axis] == 0 || g[axis] == N - 1) axis++;
+        const std::vector<CubeMove> seq(1, CubeMove(axis, g[axis], 1));
+        applyMoves(seq, &work, &parityMoves);
+    }
+
+    // 3x3の段階の解 (角と中央の辺は3-cycleでは動かないので、先に求めておける)
+    CubieCube cube;
+    std::vector<int> turns;
+    if (!cubieCubeFromStateAsIs(work, &cube) || !solveTwoPhase(cube, TWO_PHASE_MAX_LENGTH, &turns)) return false;
+    std::vector<CubeMove> finishMoves;
+    for (size_t i = 0; i < turns.size(); i++) appendMove(&finishMoves, faceTurnToCubeMove(turns[i], N));
+
+    // 揃った状態から解を逆に施すと、ウイングを置くべき位置が分かる
+    CubeState target(N, state.mode());
+    for (int i = (int)finishMoves.size() - 1; i >= 0; i--) {
+        target.apply(CubeMove(finishMoves[i].axis, finishMoves[i].layer, 4 - finishMoves[i].turns));
+    }
+
+    std::vector<CubeMove> centerMoves, edgeMoves;
+    for (int type = 3; type >= 2; type--) {
+        for (size_t o = 0; o < t.orbits.size(); o++) {
+            const PieceOrbit &orbit = t.orbits[o];
+            if (orbit.type != type) continue;
+
+            int want[ORBIT_SIZE], have[ORBIT_SIZE];
+            for (int i = 0; i < ORBIT_SIZE; i++) {
+                const int pos = orbit.positions[i];
+                if (type == 3) {
+                    // センターは同じ色のものを区別しない
+                    want[i] = centerFace(work, pos);
+                    have[i] = centerFace(work, topo.homePos[work.cubeAt(pos)]);
+                } else {
+                    want[i] = target.cubeAt(pos);
+                    have[i] = work.cubeAt(pos);
+                }
+            }
+            if (!solveOrbit(t, orbit, want, have, &work, type == 3 ? &centerMoves : &edgeMoves)) return false;
+        }
+    }
+
+    moves->insert(moves->end(), orientMoves.begin(), orientMoves.end());
+    moves->insert(moves->end(), parityMoves.begin(), parityMoves.end());
+    moves->insert(moves->end(), centerMoves.begin(), centerMoves.end());
+    moves->insert(moves->end(), edgeMoves.begin(), edgeMoves.end());
+    moves->insert(moves->end(), finishMoves.begin(), finishMoves.end());
+
+    if (stats != NULL) {
+        stats->orientMoves = (int)orientMoves.size();
+        stats->parityMoves = (int)parityMoves.size();
+        stats->centerMoves = (int)centerMoves.size();
+        stats->edgeMoves = (int)edgeMoves.size();
+        stats->finishMoves = (int)finishMoves.size();
+    }
+    return true;
+}
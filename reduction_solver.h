@@ -0,0 +1,60 @@
+#ifndef _REDUCTION_SOLVER_H_
+#define _REDUCTION_SOLVER_H_
+
+#include <vector>
+
+#include "cube_state.h"
+
+/*
+還元法 (reduction) によるN x Nのソルバ
+1. 向き: Nが奇数の場合は中央の層を回して、真ん中のセンターを元の面に戻す
+2. パリティ: ウイング (中央以外の辺のキューブ) の軌道ごとに置換の偶奇を調べ、奇数なら内側の層を90度回す
+3. センター: 軌道 (面の上の同じ位置にある24個) ごとに3-cycleで揃える
+4. エッジ: ウイングを3-cycleで、3x3の段階の解を逆に施した位置に揃える (辺がペアになる)
+5. 3x3: 角と (Nが奇数なら) 中央の辺を二段階法で解き、外側の層だけを回す
+
+3-cycleは [内側の層, X Y X'] の形の交換子のうち、動く位置が3つだけのものを探し、
+準備の手で挟んで軌道の中の全ての3つ組を作っておく。他のキューブは一切動かさないので、
+段階の順番を入れ替えても揃えたものは崩れない。
+ウイングの置換の偶奇は外側の層の回転でも3-cycleでも変わらないので、最初に直しておけば
+3x3の段階でOLLパリティやPLLパリティは起きない (Nが偶数の場合、PLLパリティは辺の組み合わせ方で避ける)。
+
+出力するCubeMoveのlayerはxCubePlanes[layer]等と同じ番号。
+表はNとボイドかどうかごとに最初に使うときに一度だけ作り、スレッド間で共有する (スレッドセーフ)。
+*/
+
+// 段階ごとの手数
+struct ReductionStats {
+    ReductionStats()
+        : orientMoves(0)
+        , parityMoves(0)
+        , centerMoves(0)
+        , edgeMoves(0)
+        , finishMoves(0) {
+    }
+
+    int orientMoves;
+    int parityMoves;
+    int centerMoves;
+    int edgeMoves;
+    int finishMoves;
+};
+
+/*
+解けるNの上限
+表の大きさと作る時間は軌道の数 (N^2に比例) で増える (N = 32で約6秒、70MB。N = 64では20秒以上、250MB以上)。
+これより大きいNではsolveReductionはfalseを返し、initReductionTablesは何もしない。
+*/
+static const int REDUCTION_MAX_N = 32;
+
+// NとモードのCubeStateを解くための表を作る (二段階法の表も作る)
+void initReductionTables(int N, int mode);
+
+/*
+N x NのCubeStateを揃える回転操作の列を求める
+揃えられない状態の場合 (NがREDUCTION_MAX_Nより大きい場合も) はfalseを返す。statsがNULLでなければ段階ごとの手数を返す。
+色を揃えるだけでセンターの向きは揃えないので、センターの向きが見えるミラーブロックス (モード1) でもfalseを返す。
+*/
+bool solveReduction(const CubeState &state, std::vector<CubeMove> *moves, ReductionStats *stats = NULL);
+
+#endif  // _REDUCTION_SOLVER_H_
@@ -1,9 +1,14 @@
 #version 330
 
-// Attribute変数
-layout(location = 0) in vec3 in_position;
-layout(location = 1) in vec3 in_color;
-layout(location = 2) in vec3 in_normal;
+// メッシュ (ブロックの形ごとに24頂点) はテクスチャバッファから読む
+// 1頂点あたりRG32UIの1テクセル (位置の半精度浮動小数点数x3と、法線のoctahedral表現 8bit x2)
+uniform usamplerBuffer u_meshBuffer;
+// 面の色 (ブロックの種類ごとに6面、RGBA8)
+uniform samplerBuffer u_faceColors;
+
+// インスタンスごとのAttribute変数
+layout(location = 0) in mat4 in_mvMat;      // 剛体変換 (左上3x3が法線の変換になる)
+layout(location = 4) in ivec4 in_cubeInfo;  // ブロックの種類, ブロックの形の番号, キューブの種類, キューブのID
 
 // Varying変数
 out vec3 f_fragColor;
@@ -12,25 +17,48 @@ out vec3 f_positionCameraSpace;
 out vec3 f_normalCameraSpace;
 out vec3 f_lightPosCameraSpace;
 
-// 光源の情報
-uniform vec3 u_lightPos;
+// フレームごとの情報 (カメラと光源)
+layout(std140) uniform FrameBlock {
+    mat4 u_viewMat;
+    mat4 u_projMat;
+    mat4 u_lightMat;
+    vec4 u_lightPos;
+};
 
-// 各種変換行列
-uniform mat4 u_mvMat;
-uniform mat4 u_mvpMat;
-uniform mat4 u_normMat;
-uniform mat4 u_lightMat;
+// 半精度浮動小数点数 (下位16bit) をfloatに戻す (GLSL 3.30にはunpackHalf2x16が無い)
+float halfToFloat(uint h) {
+    float e = float((h >> 10) & 31u);
+    float m = float(h & 1023u);
+    float v = e == 0.0 ? m * exp2(-24.0) : (m + 1024.0) * exp2(e - 25.0);
+    return (h & 32768u) != 0u ? -v : v;
+}
+
+// 8bitの符号付き正規化x2 (下位16bit) のoctahedral表現を法線に戻す
+vec3 octDecode(uint bits) {
+    vec2 p = vec2(float(int(bits << 24) >> 24), float(int(bits << 16) >> 24)) / 127.0;
+    vec3 n = vec3(p, 1.0 - abs(p.x) - abs(p.y));
+    if (n.z < 0.0) {
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(n);
+}
 
 void main() {
+    // 頂点データの読み込み (gl_VertexIDはブロック内の頂点番号、面fの頂点は4f ~ 4f+3)
+    uvec2 texel = texelFetch(u_meshBuffer, in_cubeInfo.y * 24 + gl_VertexID).xy;
+    vec3 position = vec3(halfToFloat(texel.x), halfToFloat(texel.x >> 16), halfToFloat(texel.y));
+    vec3 normal = octDecode(texel.y >> 16);
+    vec3 color = texelFetch(u_faceColors, in_cubeInfo.x * 6 + gl_VertexID / 4).rgb;
+
     // gl_Positionは頂点シェーダの組み込み変数
     // 指定を忘れるとエラーになるので注意
-    gl_Position = u_mvpMat * vec4(in_position, 1.0);
+    gl_Position = u_projMat * in_mvMat * vec4(position, 1.0);
 
     // Varying変数への代入
-    f_fragColor = in_color;
+    f_fragColor = color;
 
     // カメラ座標系への変換
-    f_positionCameraSpace = (u_mvMat * vec4(in_position, 1.0)).xyz;
-    f_normalCameraSpace = (u_normMat * vec4(in_normal, 0.0)).xyz;
-    f_lightPosCameraSpace = (u_lightMat * vec4(u_lightPos, 1.0)).xyz;
+    f_positionCameraSpace = (in_mvMat * vec4(position, 1.0)).xyz;
+    f_normalCameraSpace = mat3(in_mvMat) * normal;
+    f_lightPosCameraSpace = (u_lightMat * u_lightPos).xyz;
 }
@@ -0,0 +1,117 @@
+#version 330
+
+// ステッカーの色 (面 * N^2 + i * N + j、値は元の面の番号、キューブが無い所は255)
+// 並びはfacelet_colors.hと同じ
+uniform usamplerBuffer u_faceletBuffer;
+// 面ごとの色
+uniform vec3 u_palette[6];
+uniform int u_N;
+// 全キューブ共通の変換 (カメラ * モデル * アークボール)
+uniform mat4 u_mvMat;
+// 回転中の軸 (回転していなければ-1) と層ごとの角度 (大きさはmain.cppのMAX_N)
+uniform int u_turnAxis;
+uniform float u_layerAngles[128];
+
+// Varying変数
+out vec3 f_fragColor;
+
+out vec3 f_positionCameraSpace;
+out vec3 f_normalCameraSpace;
+out vec3 f_lightPosCameraSpace;
+
+// フレームごとの情報 (カメラと光源)
+layout(std140) uniform FrameBlock {
+    mat4 u_viewMat;
+    mat4 u_projMat;
+    mat4 u_lightMat;
+    vec4 u_lightPos;
+};
+
+// 面の法線の軸と向き (R, U, F, B, D, L)
+const int faceAxis[6] = int[6](0, 1, 2, 2, 1, 0);
+const float faceSign[6] = float[6](1.0, 1.0, 1.0, -1.0, -1.0, -1.0);
+// 四角形の2つの三角形の角
+const vec2 quadCorners[6] = vec2[6](vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(1.0, 1.0),
+                                    vec2(-1.0, -1.0), vec2(1.0, 1.0), vec2(-1.0, 1.0));
+
+// 軸の周りの回転 (glm::rotateと同じ向き)
+mat3 axisRotation(int axis, float angle) {
+    float c = cos(angle);
+    float s = sin(angle);
+    if (axis == 0) return mat3(1.0, 0.0, 0.0, 0.0, c, s, 0.0, -s, c);
+    if (axis == 1) return mat3(c, 0.0, -s, 0.0, 1.0, 0.0, s, 0.0, c);
+    return mat3(c, s, 0.0, -s, c, 0.0, 0.0, 0.0, 1.0);
+}
+
+void main() {
+    // 頂点の番号から、四角形 (ステッカーか、回転中の層の境目の黒い蓋) とその角を決める
+    int quad = gl_VertexID / 6;
+    vec2 corner = quadCorners[gl_VertexID % 6];
+    int faceCount = u_N * u_N;
+
+    vec3 position;
+    vec3 normal;
+    vec3 color = vec3(0.0);
+    int layer = 0;
+    bool hidden = false;
+    if (quad < 6 * faceCount) {
+        // ステッカーはキューブの面と同じ大きさ (キューブの間隔は2で、全体の中心が原点)
+        int face = quad / faceCount;
+        int a = faceAxis[face];
+        int b = (a + 1) % 3;
+        int c = (a + 2) % 3;
+        vec3 coord;
+        coord[a] = faceSign[face] > 0.0 ? float(u_N - 1) : 0.0;
+        coord[b] = float((quad % faceCount) / u_N);
+        coord[c] = float(quad % u_N);
+        vec3 local;
+        local[a] = faceSign[face];
+        local[b] = corner.x;
+        local[c] = corner.y;
+
+        position = 2.0 * coord - float(u_N - 1) + local;
+        // 法線はキューブのメッシュと同じく角の方向
+        normal = normalize(local);
+
+        uint value = texelFetch(u_faceletBuffer, quad).r;
+        hidden = value > 5u;
+        color = u_palette[min(value, 5u)];
+        if (u_turnAxis >= 0) layer = int(coord[u_turnAxis]);
+    } else {
+        // 境目k (1 ~ N-1) ごとに、k-1層側 (+向き) とk層側 (-向き) の2枚の蓋でN×Nの切り口を覆う
+        int cap = quad - 6 * faceCount;
+        int boundary = cap / 2 + 1;
+        int side = cap % 2;
+        int a = u_turnAxis;
+        layer = boundary - 1 + side;
+
+        position[a] = float(2 * boundary - u_N);
+        position[(a + 1) % 3] = corner.x * float(u_N);
+        position[(a + 2) % 3] = corner.y * float(u_N);
+        normal = vec3(0.0);
+        normal[a] = side == 0 ? 1.0 : -1.0;
+
+        // 両側の層が同じ角度なら切り口は見えない
+        hidden = u_layerAngles[boundary - 1] == u_layerAngles[boundary];
+    }
+
+    // 回転中の層は、その層の角度だけ回す
+    if (u_turnAxis >= 0) {
+        mat3 turnMat = axisRotation(u_turnAxis, u_layerAngles[layer]);
+        position = turnMat * position;
+        normal = turnMat * normal;
+    }
+    // 描かない四角形は全ての角を同じ点に潰す
+    if (hidden) position = vec3(0.0);
+
+    // gl_Positionは頂点シェーダの組み込み変数
+    gl_Position = u_projMat * u_mvMat * vec4(position, 1.0);
+
+    // Varying変数への代入
+    f_fragColor = color;
+
+    // カメラ座標系への変換
+    f_positionCameraSpace = (u_mvMat * vec4(position, 1.0)).xyz;
+    f_normalCameraSpace = mat3(u_mvMat) * normal;
+    f_lightPosCameraSpace = (u_lightMat * u_lightPos).xyz;
+}
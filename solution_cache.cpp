@@ -0,0 +1,202 @@
+#include "solution_cache.h"
+
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+// 1レコードの手数の部分より前の大きさ
+static const size_t RECORD_HEADER_SIZE = 8 + 40 + 1 + 1;
+
+struct SolutionCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+};
+
+SolutionCache::SolutionCache(bool useInverse_)
+    : useInverse(useInverse_)
+    , fp(NULL)
+    , hitCount(0)
+    , missCount(0) {
+}
+
+SolutionCache::~SolutionCache() {
+    close();
+}
+
+static void packCube(const CubieCube &c, uint8_t *bytes) {
+    for (int i = 0; i < 8; i++) bytes[i] = (uint8_t)c.cp[i];
+    for (int i = 0; i < 8; i++) bytes[8 + i] = (uint8_t)c.co[i];
+    for (int i = 0; i < 12; i++) bytes[16 + i] = (uint8_t)c.ep[i];
+    for (int i = 0; i < 12; i++) bytes[28 + i] = (uint8_t)c.eo[i];
+}
+
+static void unpackCube(const uint8_t *bytes, CubieCube *c) {
+    for (int i = 0; i < 8; i++) c->cp[i] = bytes[i];
+    for (int i = 0; i < 8; i++) c->co[i] = bytes[8 + i];
+    for (int i = 0; i < 12; i++) c->ep[i] = bytes[16 + i];
+    for (int i = 0; i < 12; i++) c->eo[i] = bytes[28 + i];
+}
+
+// 読み込んだレコードが正しいか (面の回転の番号、揃えられる代表の状態か、ハッシュ、解で揃うか)
+static bool isValidRecord(uint64_t hash, const CubieCube &cube, const std::vector<int> &turns, bool useInverse) {
+    if (!cube.isValid()) return false;
+    for (size_t i = 0; i < turns.size(); i++) {
+        if (turns[i] < 0 || turns[i] >= NUM_FACE_TURNS) return false;
+    }
+
+    const CanonicalCube canonical = canonicalize(cube, useInverse);
+    if (canonical.hash != hash || canonical.cube != cube) return false;
+
+    CubieCube c = cube;
+    for (size_t i = 0; i < turns.size(); i++) c.move(turns[i]);
+    return c == CubieCube();
+}
+
+// ヘッダを確かめて (空のファイルには書いて)、確かめられたレコードを読み込み、残りを切り捨てる
+bool SolutionCache::load(const std::string &path) {
+    SolutionCacheHeader header;
+    if (fread(&header, 1, sizeof(header), fp) != sizeof(header)) {
+        // 空のファイルにはヘッダを書く
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, SOLUTION_CACHE_MAGIC, sizeof(SOLUTION_CACHE_MAGIC));
+        header.version = SOLUTION_CACHE_VERSION;
+        if (fseek(fp, 0, SEEK_SET) != 0 || fwrite(&header, 1, sizeof(header), fp) != sizeof(header) || fflush(fp) != 0) {
+            fprintf(stderr, "Failed to write file: %s\n", path.c_str());
+            return false;
+        }
+    } else if (memcmp(header.magic, SOLUTION_CACHE_MAGIC, sizeof(SOLUTION_CACHE_MAGIC)) != 0 || header.version != SOLUTION_CACHE_VERSION) {
+        fprintf(stderr, "Not a solution cache: %s\n", path.c_str());
+        return false;
+    }
+
+    // 最後まで読めて、確かめられたレコードだけを使う (壊れたレコードから後は切り捨てる)
+    long valid = (long)sizeof(header);
+    for (;;) {
+        uint8_t record[RECORD_HEADER_SIZE + 255];
+        if (fread(record, 1, RECORD_HEADER_SIZE, fp) != RECORD_HEADER_SIZE) break;
+        const int length = record[RECORD_HEADER_SIZE - 1];
+        if (fread(record + RECORD_HEADER_SIZE, 1, length, fp) != (size_t)length) break;
+
+        uint64_t hash;
+        memcpy(&hash, record, 8);
+        Entry e;
+        unpackCube(record + 8, &e.cube);
+        e.optimal = record[RECORD_HEADER_SIZE - 2] != 0;
+        for (int i = 0; i < length; i++) e.turns.push_back(record[RECORD_HEADER_SIZE + i]);
+        if (!isValidRecord(hash, e.cube, e.turns, useInverse)) {
+            fprintf(stderr, "Dropping invalid solution cache records from offset %ld: %s\n", valid, path.c_str());
+            break;
+        }
+        entries[hash] = e;
+        valid += (long)(RECORD_HEADER_SIZE + length);
+    }
+    if (fseek(fp, valid, SEEK_SET) != 0 || ftruncate(fileno(fp), (off_t)valid) != 0) {
+        fprintf(stderr, "Failed to truncate file: %s\n", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool SolutionCache::open(const std::string &path) {
+    close();
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // "w+b"で作り直すと、同時に開いた他のプロセスが書いたものを消してしまう
+    const int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd >= 0) fp = fdopen(fd, "r+b");
+    if (fp == NULL) {
+        if (fd >= 0) ::close(fd);
+        fprintf(stderr, "Failed to open file: %s\n", path.c_str());
+        return false;
+    }
+
+    // 読み込みと切り捨ての間に他のプロセスが追記しないようにする
+    if (flock(fileno(fp), LOCK_EX) != 0) {
+        fprintf(stderr, "Failed to lock file: %s\n", path.c_str());
+        fclose(fp);
+        fp = NULL;
+        return false;
+    }
+    const bool loaded = load(path);
+    flock(fileno(fp), LOCK_UN);
+    if (!loaded) {
+        fclose(fp);
+        fp = NULL;
+        entries.clear();
+        return false;
+    }
+    return true;
+}
+
+void SolutionCache::close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (fp != NULL) fclose(fp);
+    fp = NULL;
+    entries.clear();
+}
+
+bool SolutionCache::lookup(const CubieCube &cube, std::vector<int> *solution, bool optimalOnly) {
+    const CanonicalCube canonical = canonicalize(cube, useInverse);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::unordered_map<uint64_t, Entry>::const_iterator it = entries.find(canonical.hash);
+        if (it != entries.end() && it->second.cube == canonical.cube && (it->second.optimal || !optimalOnly)) {
+            *solution = fromCanonicalSolution(canonical, it->second.turns);
+            hitCount++;
+            return true;
+        }
+    }
+    missCount++;
+    return false;
+}
+
+void SolutionCache::store(const CubieCube &cube, const std::vector<int> &solution, bool optimal) {
+    if (solution.size() > 255) return;
+
+    const CanonicalCube canonical = canonicalize(cube, useInverse);
+    Entry e;
+    e.cube = canonical.cube;
+    e.turns = toCanonicalSolution(canonical, solution);
+    e.optimal = optimal;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::pair<std::unordered_map<uint64_t, Entry>::iterator, bool> inserted = entries.insert(std::make_pair(canonical.hash, e));
+    if (!inserted.second) {
+        // ハッシュが同じ別の状態は置き換えない
+        Entry &old = inserted.first->second;
+        if (old.cube != e.cube) return;
+        if (e.turns.size() >= old.turns.size() && (old.optimal || !optimal)) return;
+        old = e;
+    }
+    if (fp == NULL) return;
+
+    uint8_t record[RECORD_HEADER_SIZE + 255];
+    memcpy(record, &canonical.hash, 8);
+    packCube(e.cube, record + 8);
+    record[RECORD_HEADER_SIZE - 2] = e.optimal ? 1 : 0;
+    record[RECORD_HEADER_SIZE - 1] = (uint8_t)e.turns.size();
+    for (size_t i = 0; i < e.turns.size(); i++) record[RECORD_HEADER_SIZE + i] = (uint8_t)e.turns[i];
+
+    // 一件ずつ書き出しておけば、途中で止まっても今までの解は残る
+    // (他のプロセスも同じファイルに追記するので、ロックしてから今の末尾に書く)
+    const size_t size = RECORD_HEADER_SIZE + e.turns.size();
+    bool written = false;
+    if (flock(fileno(fp), LOCK_EX) == 0) {
+        written = fseek(fp, 0, SEEK_END) == 0 && fwrite(record, 1, size, fp) == size && fflush(fp) == 0;
+        flock(fileno(fp), LOCK_UN);
+    }
+    if (!written) {
+        fprintf(stderr, "Failed to write solution cache\n");
+        fclose(fp);
+        fp = NULL;
+    }
+}
+
+size_t SolutionCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.size();
+}
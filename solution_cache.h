@@ -0,0 +1,71 @@
+#ifndef _SOLUTION_CACHE_H_
+#define _SOLUTION_CACHE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "cube_symmetry.h"
+#include "cubie_cube.h"
+
+/*
+解のキャッシュのファイル
+ヘッダの後に、代表の状態 (cube_symmetry.hのcanonicalize) ごとのレコードを追記していく。
+レコード: ハッシュ (8バイト)、cp, co, ep, eo (40バイト)、最短手数か (1バイト)、手数 (1バイト)、面の回転 (手数バイト)
+同じ状態のレコードが複数あれば後のものを使う (より良い解を見つけた時は追記で置き換える)。
+途中で止まって書きかけのレコードや、確かめられない (壊れた) レコードが残っていても、開くときにそこから後を切り捨てる。
+複数のプロセスで同じファイルを使えるように、読み込みと追記の間はflockでファイル全体をロックする。
+*/
+static const char SOLUTION_CACHE_MAGIC[8] = { 'C', 'U', 'B', 'E', 'S', 'O', 'L', '\0' };
+static const uint32_t SOLUTION_CACHE_VERSION = 2;
+
+/*
+SolutionCache
+対称性 (と逆の状態) で同じになる状態の解を一つにまとめて覚える。
+引くときは代表の状態の解を対称性で元の状態の解に直す。複数のスレッドから使える。
+*/
+class SolutionCache {
+public:
+    // useInverseなら逆の状態も同じものとみなす
+    explicit SolutionCache(bool useInverse = true);
+    ~SolutionCache();
+
+    // ファイルを開いて今までの解を読み込む (無ければ作る)。開かなければメモリの上だけで使う。
+    bool open(const std::string &path);
+    void close();
+
+    // optimalOnlyなら最短手数と分かっている解だけを返す
+    bool lookup(const CubieCube &cube, std::vector<int> *solution, bool optimalOnly = false);
+    // optimal: 最短手数の解か。覚えている解より短いか、覚えている解が最短と分かっていない時に最短の解なら置き換える
+    void store(const CubieCube &cube, const std::vector<int> &solution, bool optimal);
+
+    size_t size() const;
+    uint64_t hits() const { return hitCount; }
+    uint64_t misses() const { return missCount; }
+
+private:
+    SolutionCache(const SolutionCache &) = delete;
+    SolutionCache &operator=(const SolutionCache &) = delete;
+
+    struct Entry {
+        CubieCube cube;
+        std::vector<int> turns;
+        bool optimal;
+    };
+
+    // 開いたファイルから解を読み込む (ファイルをロックしてから呼ぶ)
+    bool load(const std::string &path);
+
+    bool useInverse;
+    mutable std::mutex mutex;
+    std::unordered_map<uint64_t, Entry> entries;
+    FILE *fp;
+    std::atomic<uint64_t> hitCount;
+    std::atomic<uint64_t> missCount;
+};
+
+#endif  // _SOLUTION_CACHE_H_
@@ -0,0 +1,126 @@
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "cubie_cube.h"
+#include "two_phase.h"
+
+/*
+二段階法のソルバのベンチマーク
+一様にランダムな3x3の状態を解いて、1秒あたりの解の数と手数を表示する。
+モードを指定すると、そのモードのCubeStateをランダムな面の回転で崩して (main.cppと同じ入口で) 解く。
+使い方: ./solver_bench [状態の数] [手数の上限] [乱数の種] [モード]
+*/
+
+typedef std::chrono::steady_clock Clock;
+
+static double elapsedSeconds(const Clock::time_point &start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// 一様にランダムな (揃えられる) 状態を作る
+static CubieCube randomCubieCube(std::mt19937 &rng) {
+    CubieCube c;
+    std::shuffle(c.cp, c.cp + 8, rng);
+    std::shuffle(c.ep, c.ep + 12, rng);
+    if (c.cornerParity() != c.edgeParity()) std::swap(c.ep[0], c.ep[1]);
+    c.setTwist(std::uniform_int_distribution<int>(0, 2186)(rng));
+    c.setFlip(std::uniform_int_distribution<int>(0, 2047)(rng));
+    return c;
+}
+
+// 揃ったか (ミラーブロックスでは形でセンターの向きも見えるので、全てのキューブの向きが0であることも確かめる)
+static bool isSolvedState(const CubeState &s) {
+    if (!s.isSolved()) return false;
+    if (s.mode() != 1) return true;
+    for (int c = 0; c < s.numCubies(); c++) {
+        if (s.orientation(c) != 0) return false;
+    }
+    return true;
+}
+
+// モードを指定した場合: CubeStateを崩して解き、揃うかを確かめる
+static int benchStates(int count, int maxLength, std::mt19937 &rng, int mode) {
+    std::vector<CubeState> states;
+    for (int i = 0; i < count; i++) {
+        CubeState s(3, mode);
+        for (int k = 0; k < 40; k++) s.apply(faceTurnToCubeMove((int)(rng() % NUM_FACE_TURNS), 3));
+        states.push_back(s);
+    }
+
+    std::vector<std::vector<CubeMove> > solutions(count);
+    int failed = 0;
+    const Clock::time_point start = Clock::now();
+    for (int i = 0; i < count; i++) {
+        if (!solveTwoPhase(states[i], maxLength, &solutions[i])) failed++;
+    }
+    const double seconds = elapsedSeconds(start);
+
+    int wrong = 0, totalLength = 0, maxFound = 0;
+    for (int i = 0; i < count; i++) {
+        if (solutions[i].empty() && !isSolvedState(states[i])) continue;
+
+        CubeState s = states[i];
+        s.apply(solutions[i]);
+        if (!isSolvedState(s)) wrong++;
+
+        totalLength += (int)solutions[i].size();
+        maxFound = std::max(maxFound, (int)solutions[i].size());
+    }
+
+    const int solved = count - failed;
+    printf("Solved: %d / %d (mode %d, max length %d, wrong %d)\n", solved, count, mode, maxLength, wrong);
+    printf("Length: %.2f average, %d max\n", solved > 0 ? (double)totalLength / solved : 0.0, maxFound);
+    printf("Time: %.3f s, %.3f ms/solve, %.1f solves/s\n", seconds, seconds * 1000.0 / count, count / seconds);
+
+    return failed == 0 && wrong == 0 ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+    const int count = argc > 1 ? atoi(argv[1]) : 1000;
+    const int maxLength = argc > 2 ? atoi(argv[2]) : TWO_PHASE_MAX_LENGTH;
+    const unsigned int seed = argc > 3 ? (unsigned int)atoi(argv[3]) : 1;
+    const int mode = argc > 4 ? atoi(argv[4]) : -1;
+
+    // 表を作る時間は別に測る
+    Clock::time_point start = Clock::now();
+    initTwoPhaseTables();
+    printf("Tables: %.2f s\n", elapsedSeconds(start));
+
+    std::mt19937 rng(seed);
+    if (mode >= 0) return benchStates(count, maxLength, rng, mode);
+
+    std::vector<CubieCube> cubes;
+    for (int i = 0; i < count; i++) cubes.push_back(randomCubieCube(rng));
+
+    std::vector<std::vector<int> > solutions(count);
+    int failed = 0;
+    start = Clock::now();
+    for (int i = 0; i < count; i++) {
+        if (!solveTwoPhase(cubes[i], maxLength, &solutions[i])) failed++;
+    }
+    const double seconds = elapsedSeconds(start);
+
+    // 解を施して揃うかを確かめる
+    int wrong = 0, totalLength = 0, maxFound = 0;
+    for (int i = 0; i < count; i++) {
+        if (solutions[i].empty() && cubes[i] != CubieCube()) continue;
+
+        CubieCube c = cubes[i];
+        for (int k = 0; k < (int)solutions[i].size(); k++) c.move(solutions[i][k]);
+        if (c != CubieCube()) wrong++;
+
+        totalLength += (int)solutions[i].size();
+        maxFound = std::max(maxFound, (int)solutions[i].size());
+    }
+
+    const int solved = count - failed;
+    printf("Solved: %d / %d (max length %d, wrong %d)\n", solved, count, maxLength, wrong);
+    printf("Length: %.2f average, %d max\n", solved > 0 ? (double)totalLength / solved : 0.0, maxFound);
+    printf("Time: %.3f s, %.3f ms/solve, %.1f solves/s\n", seconds, seconds * 1000.0 / count, count / seconds);
+
+    return failed == 0 && wrong == 0 ? 0 : 1;
+}
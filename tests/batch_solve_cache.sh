@@ -0,0 +1,73 @@
+#!/bin/bash
+# batch_solveの解のキャッシュのテスト
+# 二段階法で解いて覚えた状態を、同じキャッシュのファイルで-oを付けて解き直すと、最短手数の解に置き換わることを確かめる。
+# 標準出力は入力1行に解1行で、それぞれの解が崩し手順を元に戻すこと (alg_infoで位数が1) も確かめる。
+# 壊れたレコードを読み捨てることも確かめる。
+# パターンデータベースのディレクトリを指定しなければ、一時ディレクトリに作る (1分ほどかかる)。
+# 使い方: bash tests/batch_solve_cache.sh [batch_solveのパス] [パターンデータベースのディレクトリ]
+set -u -o pipefail
+
+BATCH_SOLVE=${1:-./batch_solve}
+ALG_INFO=${ALG_INFO:-$(dirname "$BATCH_SOLVE")/alg_info}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+PDB_DIR=${2:-$WORK/}
+
+# 対称性で同じにならない崩し手順 (最短は4, 4, 3手)。1行目は二段階法では10手になる
+printf "R U R' U'\nU2 L' D B\nR U F\n" > "$WORK/input.txt"
+CACHE="$WORK/cache.bin"
+FAILED=0
+
+# 手数を数える
+countMoves() {
+    awk '{ print NF }'
+}
+
+check() {
+    if [ "$2" != "$3" ]; then
+        echo "FAIL: $1 (expected: $3, actual: $2)"
+        FAILED=1
+    fi
+}
+
+# 出力が入力と同じ行数で、各行の解が同じ行の崩し手順を元に戻すことを確かめる
+checkSolutions() {
+    check "$1: line count" "$(wc -l < "$2" | tr -d ' ')" "$(wc -l < "$WORK/input.txt" | tr -d ' ')"
+    while IFS=$'\t' read -r scramble solution; do
+        check "$1: '$solution' solves '$scramble'" "$("$ALG_INFO" -r 1 "$scramble $solution" | grep '^Order:')" "Order: 1"
+    done < <(paste "$WORK/input.txt" "$2")
+}
+
+# 1回目: 二段階法で解いてキャッシュに覚える
+"$BATCH_SOLVE" -c "$CACHE" "$WORK/input.txt" > "$WORK/two_phase.txt" 2> "$WORK/log1.txt" || { cat "$WORK/log1.txt"; exit 1; }
+checkSolutions "two-phase" "$WORK/two_phase.txt"
+check "two-phase solution is longer than optimal" "$(head -n 1 "$WORK/two_phase.txt" | countMoves)" 10
+
+# 2回目: -oでは二段階法の解を使わずに最短の解を求め、キャッシュを置き換える
+# (パターンデータベースを作る時の経過は標準エラーに出るので、標準出力は解だけになる)
+"$BATCH_SOLVE" -o -d "$PDB_DIR" -c "$CACHE" "$WORK/input.txt" > "$WORK/optimal.txt" 2> "$WORK/log2.txt" || { cat "$WORK/log2.txt"; exit 1; }
+checkSolutions "optimal" "$WORK/optimal.txt"
+check "optimal solutions" "$(countMoves < "$WORK/optimal.txt" | tr '\n' ' ')" "4 4 3 "
+check "optimal run ignores two-phase entries" "$(grep -c '0 hits, 3 misses' "$WORK/log2.txt")" 1
+
+# 3回目: 置き換えた最短の解をファイルから読み、-oでもそのまま使う
+"$BATCH_SOLVE" -o -d "$PDB_DIR" -c "$CACHE" "$WORK/input.txt" > "$WORK/cached.txt" 2> "$WORK/log3.txt" || { cat "$WORK/log3.txt"; exit 1; }
+check "cached optimal solutions" "$(cat "$WORK/cached.txt")" "$(cat "$WORK/optimal.txt")"
+check "cache size after replacement" "$(grep -c 'Cache: 3 solutions in' "$WORK/log3.txt")" 1
+check "optimal run uses optimal entries" "$(grep -c '3 hits, 0 misses' "$WORK/log3.txt")" 1
+
+# 4回目: -oなしでも、覚えている最短の解を使う
+"$BATCH_SOLVE" -c "$CACHE" "$WORK/input.txt" > "$WORK/reuse.txt" 2> "$WORK/log4.txt" || { cat "$WORK/log4.txt"; exit 1; }
+check "two-phase run reuses optimal entries" "$(cat "$WORK/reuse.txt")" "$(cat "$WORK/optimal.txt")"
+
+# 5回目: 1件目のレコードの面の回転を壊すと、そこから後を読み捨てて解き直す
+# (ヘッダ16バイト、レコードの手数より前が50バイト)
+printf '\377' | dd of="$CACHE" bs=1 seek=66 conv=notrunc 2> /dev/null
+"$BATCH_SOLVE" -c "$CACHE" "$WORK/input.txt" > "$WORK/damaged.txt" 2> "$WORK/log5.txt" || { cat "$WORK/log5.txt"; exit 1; }
+checkSolutions "damaged cache" "$WORK/damaged.txt"
+check "damaged records are dropped" "$(grep -c 'Cache: 0 solutions in' "$WORK/log5.txt")" 1
+
+if [ $FAILED -ne 0 ]; then
+    exit 1
+fi
+echo "batch_solve cache: OK"
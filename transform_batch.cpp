@@ -0,0 +1,139 @@
+#include "transform_batch.h"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define TRANSFORM_BATCH_SSE
+#endif
+
+// 一度に計算するキューブの数 (配列はこの倍数に切り上げる)
+static const int LANES = 8;
+
+void RigidTransformsSoA::resize(int count_) {
+    count = count_;
+    const int padded = (count_ + LANES - 1) / LANES * LANES;
+    for (int k = 0; k < 9; k++) {
+        r[k].resize(padded);
+        for (int i = count_; i < padded; i++) r[k][i] = 0.0f;
+    }
+    for (int k = 0; k < 3; k++) {
+        p[k].resize(padded);
+        for (int i = count_; i < padded; i++) p[k][i] = 0.0f;
+    }
+}
+
+// 1キューブ分の計算 (SIMDが使えない場合と端数の処理)
+static inline void composeOne(const float *P, const RigidTransformsSoA &in, int i, float *o) {
+    float R[9];
+    for (int k = 0; k < 9; k++) R[k] = in.r[k][i];
+
+    // 回転した後の平行移動
+    float t[3];
+    for (int row = 0; row < 3; row++) {
+        t[row] = R[row] * in.p[0][i] + R[3 + row] * in.p[1][i] + R[6 + row] * in.p[2][i];
+    }
+
+    for (int col = 0; col < 3; col++) {
+        for (int row = 0; row < 3; row++) {
+            o[4 * col + row] = P[row] * R[3 * col + 0] + P[4 + row] * R[3 * col + 1] + P[8 + row] * R[3 * col + 2];
+        }
+        o[4 * col + 3] = 0.0f;
+    }
+    for (int row = 0; row < 3; row++) {
+        o[12 + row] = P[row] * t[0] + P[4 + row] * t[1] + P[8 + row] * t[2] + P[12 + row];
+    }
+    o[15] = 1.0f;
+}
+
+#if defined(__AVX__) || defined(TRANSFORM_BATCH_SSE)
+// 4キューブ分の列 (成分ごとのベクトル) を転置して、キューブごとの行列として書き出す
+static inline void storeColumns(__m128 c[4][4], float *out, size_t stride, int lanes) {
+    for (int col = 0; col < 4; col++) {
+        _MM_TRANSPOSE4_PS(c[col][0], c[col][1], c[col][2], c[col][3]);
+    }
+    for (int lane = 0; lane < lanes; lane++) {
+        float *o = out + stride * lane;
+        for (int col = 0; col < 4; col++) _mm_storeu_ps(o + 4 * col, c[col][lane]);
+    }
+}
+#endif
+
+#if defined(__AVX__)
+static inline void compose8(const float *P, const RigidTransformsSoA &in, int i, float *out, size_t stride, int lanes) {
+    __m256 R[9], p[3], t[3];
+    for (int k = 0; k < 9; k++) R[k] = _mm256_loadu_ps(&in.r[k][i]);
+    for (int k = 0; k < 3; k++) p[k] = _mm256_loadu_ps(&in.p[k][i]);
+
+    for (int row = 0; row < 3; row++) {
+        t[row] = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(R[row], p[0]), _mm256_mul_ps(R[3 + row], p[1])), _mm256_mul_ps(R[6 + row], p[2]));
+    }
+
+    __m256 c[4][4];
+    for (int row = 0; row < 3; row++) {
+        const __m256 p0 = _mm256_set1_ps(P[row]);
+        const __m256 p1 = _mm256_set1_ps(P[4 + row]);
+        const __m256 p2 = _mm256_set1_ps(P[8 + row]);
+        for (int col = 0; col < 3; col++) {
+            c[col][row] = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(p0, R[3 * col + 0]), _mm256_mul_ps(p1, R[3 * col + 1])), _mm256_mul_ps(p2, R[3 * col + 2]));
+        }
+        c[3][row] = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(p0, t[0]), _mm256_mul_ps(p1, t[1])),
+                                  _mm256_add_ps(_mm256_mul_ps(p2, t[2]), _mm256_set1_ps(P[12 + row])));
+    }
+    for (int col = 0; col < 3; col++) c[col][3] = _mm256_setzero_ps();
+    c[3][3] = _mm256_set1_ps(1.0f);
+
+    // 前半と後半の4キューブに分けて書き出す
+    __m128 lo[4][4], hi[4][4];
+    for (int col = 0; col < 4; col++) {
+        for (int row = 0; row < 4; row++) {
+            lo[col][row] = _mm256_castps256_ps128(c[col][row]);
+            hi[col][row] = _mm256_extractf128_ps(c[col][row], 1);
+        }
+    }
+    storeColumns(lo, out, stride, lanes < 4 ? lanes : 4);
+    if (lanes > 4) storeColumns(hi, out + stride * 4, stride, lanes - 4);
+}
+#elif defined(TRANSFORM_BATCH_SSE)
+static inline void compose4(const float *P, const RigidTransformsSoA &in, int i, float *out, size_t stride, int lanes) {
+    __m128 R[9], p[3], t[3];
+    for (int k = 0; k < 9; k++) R[k] = _mm_loadu_ps(&in.r[k][i]);
+    for (int k = 0; k < 3; k++) p[k] = _mm_loadu_ps(&in.p[k][i]);
+
+    for (int row = 0; row < 3; row++) {
+        t[row] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(R[row], p[0]), _mm_mul_ps(R[3 + row], p[1])), _mm_mul_ps(R[6 + row], p[2]));
+    }
+
+    __m128 c[4][4];
+    for (int row = 0; row < 3; row++) {
+        const __m128 p0 = _mm_set1_ps(P[row]);
+        const __m128 p1 = _mm_set1_ps(P[4 + row]);
+        const __m128 p2 = _mm_set1_ps(P[8 + row]);
+        for (int col = 0; col < 3; col++) {
+            c[col][row] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(p0, R[3 * col + 0]), _mm_mul_ps(p1, R[3 * col + 1])), _mm_mul_ps(p2, R[3 * col + 2]));
+        }
+        c[3][row] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(p0, t[0]), _mm_mul_ps(p1, t[1])),
+                               _mm_add_ps(_mm_mul_ps(p2, t[2]), _mm_set1_ps(P[12 + row])));
+    }
+    for (int col = 0; col < 3; col++) c[col][3] = _mm_setzero_ps();
+    c[3][3] = _mm_set1_ps(1.0f);
+
+    storeColumns(c, out, stride, lanes);
+}
+#endif
+
+void composeRigidTransforms(const float *prefix, const RigidTransformsSoA &in, float *out, size_t outStride) {
+    int i = 0;
+#if defined(__AVX__)
+    for (; i < in.count; i += 8) {
+        compose8(prefix, in, i, out + outStride * i, outStride, in.count - i < 8 ? in.count - i : 8);
+    }
+#elif defined(TRANSFORM_BATCH_SSE)
+    for (; i < in.count; i += 4) {
+        compose4(prefix, in, i, out + outStride * i, outStride, in.count - i < 4 ? in.count - i : 4);
+    }
+#endif
+    for (; i < in.count; i++) {
+        composeOne(prefix, in, i, out + outStride * i);
+    }
+}
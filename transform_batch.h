@@ -0,0 +1,34 @@
+#ifndef _TRANSFORM_BATCH_H_
+#define _TRANSFORM_BATCH_H_
+
+#include <cstddef>
+#include <vector>
+
+/*
+RigidTransformsSoA
+全キューブの剛体変換 (回転 * 平行移動) を成分ごとの配列に並べたもの (SoA)。
+r[3 * col + row]: 回転行列の成分 (列優先)
+p[i]: 回転前の平行移動 (キューブの初期位置)
+配列の長さは8の倍数に切り上げてあり、余りの要素は0で埋める。
+*/
+struct RigidTransformsSoA {
+    RigidTransformsSoA()
+        : count(0) {
+    }
+    void resize(int count_);
+
+    int count;
+    std::vector<float> r[9];
+    std::vector<float> p[3];
+};
+
+/*
+全キューブについて out = prefix * [R | 0] * [I | p] をまとめて計算する。
+prefix: 全キューブ共通の行列 (列優先の4x4、最後の行は (0, 0, 0, 1) とみなす)
+out: 列優先の4x4行列をoutStride個のfloat間隔で書き出す
+SSE/AVXが使える場合は4/8キューブずつ計算する。
+剛体変換なので、法線の変換には結果の左上3x3をそのまま使える (逆行列は不要)。
+*/
+void composeRigidTransforms(const float *prefix, const RigidTransformsSoA &in, float *out, size_t outStride);
+
+#endif  // _TRANSFORM_BATCH_H_
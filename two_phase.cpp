@@ -0,0 +1,692 @@
+#include "two_phase.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include <unistd.h>
+
+#include "cube_symmetry.h"
+#include "optimal_solver.h"
+
+// 座標の大きさ
+static const int N_TWIST = 2187;
+static const int N_FLIP = 2048;
+static const int N_SLICE = 495;
+static const int N_CORNER_PERM = 40320;
+static const int N_UD_EDGE_PERM = 40320;
+static const int N_SLICE_PERM = 24;
+static const int N_FLIP_SLICE = N_FLIP * N_SLICE;
+
+// UD軸を保つ16通りの対称性 (U軸周りの回転、F軸周りの180度、左右の鏡映の組み合わせ) で分けた同値類の数
+static const int N_UD_SYMMETRIES = 16;
+static const int N_FLIP_SLICE_CLASS = 64430;
+static const int N_CORNER_CLASS = 2768;
+
+// フェーズ2で使う回転 (U, U2, U', R2, F2, D, D2, D', L2, B2)
+static const int N_PHASE2_TURNS = 10;
+static const int phase2Turns[N_PHASE2_TURNS] = { 0, 1, 2, 4, 7, 9, 10, 11, 13, 16 };
+
+// フェーズ2の手数の上限 (これより長くなるフェーズ1の解は捨てて、次の解を探す)
+static const int MAX_PHASE2_LENGTH = 12;
+
+// 各フェーズの揃うまでの手数の最大 (枝刈り表をたどってこれより長くなれば、表が壊れている)
+static const int MAX_PHASE1_DISTANCE = 12;
+static const int MAX_PHASE2_DISTANCE = 18;
+
+/*
+探索する向き
+元の向き、x軸周り、z軸周りに持ち替えた向きの3通りと、それぞれの逆手順の状態を同時に探す。
+(フェーズ1で揃える軸が変わるので、短い解が早く見つかりやすい)
+*/
+static const int N_SEARCH_AXES = 3;
+static const int rotationAxes[N_SEARCH_AXES] = { -1, 0, 2 };
+static const int N_SEARCHES = N_SEARCH_AXES * 2;
+
+// 同じ面や、向かい合う面を逆の順番で続けて回す手順は探さない
+// (向かい合う面はU -> Dの順だけを許す)
+static inline bool isRedundant(int face, int lastFace) {
+    return face == lastFace || face + 3 == lastFace;
+}
+
+// フェーズ1を終えた最後の回転がフェーズ2の回転なら、より短いフェーズ1の解がある
+static inline bool isPhase2Turn(int turn) {
+    const int face = turn / 3;
+    return face == TURN_U || face == TURN_D || turn % 3 == 1;
+}
+
+static inline int inverseTurn(int turn) {
+    return turn / 3 * 3 + 2 - turn % 3;
+}
+
+/*
+揃うまでの手数を3で割った余りを1状態2bitで詰めた枝刈り表 (3は未知の状態)
+1手で手数は1しか変わらないので、一つ前の状態の手数が分かっていれば余りから手数が決まる。
+*/
+static const int DEPTH3_UNKNOWN = 3;
+
+static inline int getDepth3(const std::vector<uint8_t> &table, uint64_t index) {
+    return (table[index >> 2] >> ((index & 3) << 1)) & 3;
+}
+
+static inline void setDepth3(std::vector<uint8_t> &table, uint64_t index, int value) {
+    uint8_t &b = table[index >> 2];
+    const int shift = (int)(index & 3) << 1;
+    b = (uint8_t)((b & ~(3 << shift)) | (value << shift));
+}
+
+// 手数がdepthの状態から1手進めた状態の手数 (余りはvalue)
+static inline int nextDepth(int depth, int value) {
+    static const int delta[3] = { 0, 1, -1 };
+    return depth + delta[(value - depth % 3 + 3) % 3];
+}
+
+/*
+対称性を使った枝刈り表のファイル
+作るのに時間がかかるので、一度作ったらデータのディレクトリ (optimal_solver.hのdefaultDataDirectory) に置いて次から読む。
+ヘッダの後に、フェーズ1とフェーズ2の表をそのまま続ける。表の作り方を変えたらTWO_PHASE_VERSIONを上げる。
+ヘッダには2つの表のチェックサムも入れ、大きさが合っていても中身の壊れたファイルは読まずに作り直す。
+*/
+static const char TWO_PHASE_MAGIC[8] = { 'C', 'U', 'B', 'E', '2', 'P', 'H', '\0' };
+static const uint32_t TWO_PHASE_VERSION = 2;
+static const char *const TWO_PHASE_FILE_NAME = "two_phase.prun";
+
+struct TwoPhaseFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t phase1Bytes;
+    uint64_t phase2Bytes;
+    uint64_t checksum;
+};
+
+static const uint64_t PHASE1_PRUN_BYTES = ((uint64_t)N_FLIP_SLICE_CLASS * N_TWIST + 3) / 4;
+static const uint64_t PHASE2_PRUN_BYTES = ((uint64_t)N_CORNER_CLASS * N_UD_EDGE_PERM + 3) / 4;
+
+// 表のチェックサム (FNV-1a、1バイトずつ混ぜる)
+static uint64_t tableChecksum(uint64_t h, const std::vector<uint8_t> &table) {
+    for (size_t i = 0; i < table.size(); i++) {
+        h ^= table[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+static uint64_t pruningChecksum(const std::vector<uint8_t> &phase1, const std::vector<uint8_t> &phase2) {
+    return tableChecksum(tableChecksum(14695981039346656037ull, phase1), phase2);
+}
+
+static bool readPruningTables(const std::string &path, std::vector<uint8_t> *phase1, std::vector<uint8_t> *phase2) {
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (fp == NULL) return false;
+
+    TwoPhaseFileHeader header;
+    bool ok = fread(&header, 1, sizeof(header), fp) == sizeof(header) && memcmp(header.magic, TWO_PHASE_MAGIC, sizeof(TWO_PHASE_MAGIC)) == 0 &&
+              header.version == TWO_PHASE_VERSION && header.phase1Bytes == PHASE1_PRUN_BYTES && header.phase2Bytes == PHASE2_PRUN_BYTES;
+    if (ok) {
+        phase1->resize((size_t)PHASE1_PRUN_BYTES);
+        phase2->resize((size_t)PHASE2_PRUN_BYTES);
+        ok = fread(phase1->data(), 1, phase1->size(), fp) == phase1->size() && fread(phase2->data(), 1, phase2->size(), fp) == phase2->size();
+        ok = ok && pruningChecksum(*phase1, *phase2) == header.checksum;
+    }
+    fclose(fp);
+    if (!ok) fprintf(stderr, "Rebuilding damaged or outdated two-phase tables: %s\n", path.c_str());
+    return ok;
+}
+
+// 途中で止まっても壊れたファイルが残らないように、別の名前で書いてから置き換える
+// (初めて使う時に複数のプロセスが同時に作ることがあるので、一時ファイルの名前はプロセスごとに変える)
+static bool writePruningTables(const std::string &path, const std::vector<uint8_t> &phase1, const std::vector<uint8_t> &phase2) {
+    TwoPhaseFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TWO_PHASE_MAGIC, sizeof(TWO_PHASE_MAGIC));
+    header.version = TWO_PHASE_VERSION;
+    header.phase1Bytes = phase1.size();
+    header.phase2Bytes = phase2.size();
+    header.checksum = pruningChecksum(phase1, phase2);
+
+    const std::string tmpPath = path + ".tmp." + std::to_string(getpid());
+    FILE *fp = fopen(tmpPath.c_str(), "wb");
+    if (fp == NULL) return false;
+    bool ok = fwrite(&header, 1, sizeof(header), fp) == sizeof(header);
+    ok = ok && fwrite(phase1.data(), 1, phase1.size(), fp) == phase1.size();
+    ok = ok && fwrite(phase2.data(), 1, phase2.size(), fp) == phase2.size();
+    ok = fclose(fp) == 0 && ok;
+    if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0) {
+        remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+/*
+SymCoordinate
+対称性で同値類に分けた座標。状態xの座標をrawとすると、S^-1 * x * S (Sはsym[raw]番目の対称性) の座標が
+同値類classOf[raw]の代表rep[]になる。selfSymは代表を変えない対称性のビットの集合。
+*/
+struct SymCoordinate {
+    std::vector<uint16_t> classOf;
+    std::vector<uint8_t> sym;
+    std::vector<uint32_t> rep;
+    std::vector<uint16_t> selfSym;
+};
+
+struct TwoPhaseTables {
+    TwoPhaseTables();
+
+    // 移動表 (座標 * 回転の数 + 回転)
+    std::vector<uint16_t> twistMove;
+    std::vector<uint16_t> flipMove;
+    std::vector<uint16_t> sliceMove;
+    std::vector<uint16_t> cornerPermMove;
+    std::vector<uint16_t> udEdgePermMove;
+    std::vector<uint8_t> slicePermMove;
+
+    // UD軸を保つ対称性 (cube_symmetry.hの番号) と、その中での逆の番号
+    int udSymmetries[N_UD_SYMMETRIES];
+    int udSymmetryInverse[N_UD_SYMMETRIES];
+
+    // 対称性で分けた座標 (flipSlice = slice * N_FLIP + flip) と、対称性で見た座標 (座標 * 16 + 対称性)
+    SymCoordinate flipSlice;
+    SymCoordinate corner;
+    std::vector<uint16_t> twistConj;
+    std::vector<uint16_t> udEdgeConj;
+
+    // 枝刈り表
+    // フェーズ1: flipSliceの同値類 * N_TWIST + 対称性で見たtwist (手数の余り、getDepth3)
+    // フェーズ2: 角の置換の同値類 * N_UD_EDGE_PERM + 対称性で見たudEdgePerm (手数の余り)、
+    //           UDスライスの辺の置換と角・辺の置換の組 (揃うまでの手数の下限)
+    std::vector<uint8_t> phase1Prun;
+    std::vector<uint8_t> phase2Prun;
+    std::vector<int8_t> sliceCornerPrun;
+    std::vector<int8_t> sliceEdgePrun;
+
+    // 座標から枝刈り表の番号を求める
+    uint64_t phase1Index(int twist, int flip, int slice) const {
+        const int raw = slice * N_FLIP + flip;
+        return (uint64_t)flipSlice.classOf[raw] * N_TWIST + twistConj[twist * N_UD_SYMMETRIES + flipSlice.sym[raw]];
+    }
+    uint64_t phase2Index(int cornerPerm, int udEdgePerm) const {
+        return (uint64_t)corner.classOf[cornerPerm] * N_UD_EDGE_PERM + udEdgeConj[udEdgePerm * N_UD_SYMMETRIES + corner.sym[cornerPerm]];
+    }
+
+    // 揃うまでの手数 (手数の余りが1ずつ減る回転をたどって数える)。たどれなければ表が壊れているので-1を返す
+    int phase1Distance(int twist, int flip, int slice) const;
+    int phase2Distance(int cornerPerm, int udEdgePerm) const;
+
+    // 持ち替えた向きの状態 (rotationInv * cube * rotation) と、その向きでの回転から元の向きの回転への対応
+    CubieCube rotation[N_SEARCH_AXES];
+    CubieCube rotationInv[N_SEARCH_AXES];
+    int turnMap[N_SEARCH_AXES][NUM_FACE_TURNS];
+};
+
+/*
+幅優先探索で枝刈り表を作る
+a, bの2つの座標の組 (a * nb + b) について、揃った状態 (0, 0) からの手数を求める。
+*/
+template <typename TA, typename TB>
+static void buildPruning(std::vector<int8_t> &table, int na, int nb, const std::vector<TA> &moveA, const std::vector<TB> &moveB, int numTurns) {
+    table.assign((size_t)na * nb, -1);
+    table[0] = 0;
+    int done = 1;
+    for (int depth = 0; done < na * nb; depth++) {
+        for (int i = 0; i < na * nb; i++) {
+            if (table[i] != depth) continue;
+            const int a = i / nb;
+            const int b = i % nb;
+            for (int m = 0; m < numTurns; m++) {
+                const int j = moveA[a * numTurns + m] * nb + moveB[b * numTurns + m];
+                if (table[j] < 0) {
+                    table[j] = depth + 1;
+                    done++;
+                }
+            }
+        }
+    }
+}
+
+/*
+座標を対称性で同値類に分ける
+conjugate(raw, s)はs番目の対称性で見た座標。番号の小さい順に、まだ分けていない座標を新しい同値類の代表にする。
+*/
+template <typename Conjugate>
+static void buildSymCoordinate(SymCoordinate &coord, int n, const int *symInverse, Conjugate conjugate) {
+    coord.classOf.assign(n, 0xFFFF);
+    coord.sym.assign(n, 0);
+    coord.rep.clear();
+    coord.selfSym.clear();
+    for (int raw = 0; raw < n; raw++) {
+        if (coord.classOf[raw] != 0xFFFF) continue;
+        const int c = (int)coord.rep.size();
+        uint16_t self = 0;
+        for (int s = 0; s < N_UD_SYMMETRIES; s++) {
+            const int x = conjugate(raw, s);
+            if (x == raw) self |= 1 << s;
+            if (coord.classOf[x] != 0xFFFF) continue;
+            coord.classOf[x] = (uint16_t)c;
+            coord.sym[x] = (uint8_t)symInverse[s];
+        }
+        coord.rep.push_back(raw);
+        coord.selfSym.push_back(self);
+    }
+}
+
+/*
+幅優先探索で対称性を使った枝刈り表を作る
+状態は (aの同値類, 対称性で見たb) で、aの代表から回転させた先を同値類と対称性に直して引く。
+代表を変えない対称性があれば、それで見たbも同じ手数になる。
+moveA(raw, m)はaの回転、bConjは対称性で見たbの表 (b * 16 + 対称性)。
+手数の余りしか持たないので、残りの状態の方が少なくなったら、未知の状態から1手で行ける状態を探す (後ろ向き)。
+*/
+template <typename MoveA>
+static void buildSymPruning(std::vector<uint8_t> &table, const SymCoordinate &a, int nb, const std::vector<uint16_t> &moveB,
+                            const std::vector<uint16_t> &bConj, int numTurns, MoveA moveA) {
+    const uint64_t numClasses = a.rep.size();
+    const uint64_t n = numClasses * nb;
+    table.assign((size_t)((n + 3) / 4), 0xFF);
+    setDepth3(table, 0, 0);
+
+    std::vector<uint64_t> nextBase(numTurns);
+    std::vector<int> nextSym(numTurns);
+    uint64_t done = 1, frontier = 1;
+    for (int depth = 0; done < n; depth++) {
+        const bool backward = frontier >= n - done;
+        const int value = depth % 3, next = (depth + 1) % 3;
+        uint64_t found = 0;
+        for (uint64_t c = 0; c < numClasses; c++) {
+            // 代表の回転先は、bによらず同じ
+            for (int m = 0; m < numTurns; m++) {
+                const int raw = moveA(a.rep[c], m);
+                nextBase[m] = (uint64_t)a.classOf[raw] * nb;
+                nextSym[m] = a.sym[raw];
+            }
+            for (int b = 0; b < nb; b++) {
+                const uint64_t i = c * nb + b;
+                const int d = getDepth3(table, i);
+                if (backward ? d != DEPTH3_UNKNOWN : d != value) continue;
+
+                for (int m = 0; m < numTurns; m++) {
+                    const uint64_t j = nextBase[m] + bConj[moveB[b * numTurns + m] * N_UD_SYMMETRIES + nextSym[m]];
+                    uint64_t mark;
+                    if (backward) {
+                        if (getDepth3(table, j) != value) continue;
+                        mark = i;
+                    } else {
+                        if (getDepth3(table, j) != DEPTH3_UNKNOWN) continue;
+                        mark = j;
+                    }
+
+                    setDepth3(table, mark, next);
+                    found++;
+                    const uint64_t mc = mark / nb;
+                    const int mb = (int)(mark % nb);
+                    for (int s = 1; s < N_UD_SYMMETRIES; s++) {
+                        if (!(a.selfSym[mc] & (1 << s))) continue;
+                        const uint64_t k = mc * nb + bConj[mb * N_UD_SYMMETRIES + s];
+                        if (getDepth3(table, k) != DEPTH3_UNKNOWN) continue;
+                        setDepth3(table, k, next);
+                        found++;
+                    }
+                    if (backward) break;
+                }
+            }
+        }
+        done += found;
+        frontier = found;
+    }
+}
+
+TwoPhaseTables::TwoPhaseTables() {
+    // フェーズ1の移動表 (18通りの回転)
+    twistMove.resize(N_TWIST * NUM_FACE_TURNS);
+    for (int i = 0; i < N_TWIST; i++) {
+        for (int m = 0; m < NUM_FACE_TURNS; m++) {
+            CubieCube a;
+            a.setTwist(i);
+            a.cornerMultiply(faceTurnCube(m));
+            twistMove[i * NUM_FACE_TURNS + m] = a.twist();
+        }
+    }
+    flipMove.resize(N_FLIP * NUM_FACE_TURNS);
+    for (int i = 0; i < N_FLIP; i++) {
+        for (int m = 0; m < NUM_FACE_TURNS; m++) {
+            CubieCube a;
+            a.setFlip(i);
+            a.edgeMultiply(faceTurnCube(m));
+            flipMove[i * NUM_FACE_TURNS + m] = a.flip();
+        }
+    }
+    sliceMove.resize(N_SLICE * NUM_FACE_TURNS);
+    for (int i = 0; i < N_SLICE; i++) {
+        for (int m = 0; m < NUM_FACE_TURNS; m++) {
+            CubieCube a;
+            a.setSlice(i);
+            a.edgeMultiply(faceTurnCube(m));
+            sliceMove[i * NUM_FACE_TURNS + m] = a.slice();
+        }
+    }
+
+    // フェーズ2の移動表 (10通りの回転)
+    cornerPermMove.resize(N_CORNER_PERM * N_PHASE2_TURNS);
+    for (int i = 0; i < N_CORNER_PERM; i++) {
+        for (int m = 0; m < N_PHASE2_TURNS; m++) {
+            CubieCube a;
+            a.setCornerPerm(i);
+            a.cornerMultiply(faceTurnCube(phase2Turns[m]));
+            cornerPermMove[i * N_PHASE2_TURNS + m] = a.cornerPerm();
+        }
+    }
+    udEdgePermMove.resize(N_UD_EDGE_PERM * N_PHASE2_TURNS);
+    for (int i = 0; i < N_UD_EDGE_PERM; i++) {
+        for (int m = 0; m < N_PHASE2_TURNS; m++) {
+            CubieCube a;
+            a.setUDEdgePerm(i);
+            a.edgeMultiply(faceTurnCube(phase2Turns[m]));
+            udEdgePermMove[i * N_PHASE2_TURNS + m] = a.udEdgePerm();
+        }
+    }
+    slicePermMove.resize(N_SLICE_PERM * N_PHASE2_TURNS);
+    for (int i = 0; i < N_SLICE_PERM; i++) {
+        for (int m = 0; m < N_PHASE2_TURNS; m++) {
+            CubieCube a;
+            a.setSlicePerm(i);
+            a.edgeMultiply(faceTurnCube(phase2Turns[m]));
+            slicePermMove[i * N_PHASE2_TURNS + m] = a.slicePerm();
+        }
+    }
+
+    // UD軸を保つ対称性は、Uの回転をU面かD面の回転に移すもの
+    int count = 0;
+    for (int s = 0; s < NUM_SYMMETRIES; s++) {
+        const int face = conjugateTurn(s, 0) / 3;
+        if (face == TURN_U || face == TURN_D) udSymmetries[count++] = s;
+    }
+    for (int s = 0; s < N_UD_SYMMETRIES; s++) {
+        for (int t = 0; t < N_UD_SYMMETRIES; t++) {
+            if (udSymmetries[t] == inverseSymmetry(udSymmetries[s])) udSymmetryInverse[s] = t;
+        }
+    }
+
+    // 対称性で見た座標
+    twistConj.resize(N_TWIST * N_UD_SYMMETRIES);
+    for (int i = 0; i < N_TWIST; i++) {
+        CubieCube a;
+        a.setTwist(i);
+        for (int s = 0; s < N_UD_SYMMETRIES; s++) twistConj[i * N_UD_SYMMETRIES + s] = conjugateBySymmetry(a, udSymmetries[s]).twist();
+    }
+    udEdgeConj.resize(N_UD_EDGE_PERM * N_UD_SYMMETRIES);
+    for (int i = 0; i < N_UD_EDGE_PERM; i++) {
+        CubieCube a;
+        a.setUDEdgePerm(i);
+        for (int s = 0; s < N_UD_SYMMETRIES; s++) udEdgeConj[i * N_UD_SYMMETRIES + s] = conjugateBySymmetry(a, udSymmetries[s]).udEdgePerm();
+    }
+    buildSymCoordinate(flipSlice, N_FLIP_SLICE, udSymmetryInverse, [&](int raw, int s) {
+        CubieCube a;
+        a.setSlice(raw / N_FLIP);
+        a.setFlip(raw % N_FLIP);
+        const CubieCube b = conjugateBySymmetry(a, udSymmetries[s]);
+        return b.slice() * N_FLIP + b.flip();
+    });
+    buildSymCoordinate(corner, N_CORNER_PERM, udSymmetryInverse, [&](int raw, int s) {
+        CubieCube a;
+        a.setCornerPerm(raw);
+        return conjugateBySymmetry(a, udSymmetries[s]).cornerPerm();
+    });
+
+    // 対称性を使った枝刈り表 (ファイルが無ければ作って書き出す)
+    const std::string dataDirectory = defaultDataDirectory();
+    const std::string path = dataDirectory + TWO_PHASE_FILE_NAME;
+    if (dataDirectory.empty() || !readPruningTables(path, &phase1Prun, &phase2Prun)) {
+        buildSymPruning(phase1Prun, flipSlice, N_TWIST, twistMove, twistConj, NUM_FACE_TURNS, [&](int raw, int m) {
+            return sliceMove[raw / N_FLIP * NUM_FACE_TURNS + m] * N_FLIP + flipMove[raw % N_FLIP * NUM_FACE_TURNS + m];
+        });
+        buildSymPruning(phase2Prun, corner, N_UD_EDGE_PERM, udEdgePermMove, udEdgeConj, N_PHASE2_TURNS, [&](int raw, int m) {
+            return cornerPermMove[raw * N_PHASE2_TURNS + m];
+        });
+        if (!dataDirectory.empty() && (!prepareDataDirectory(dataDirectory) || !writePruningTables(path, phase1Prun, phase2Prun))) {
+            fprintf(stderr, "Failed to save two-phase tables: %s\n", path.c_str());
+        }
+    }
+    buildPruning(sliceCornerPrun, N_SLICE_PERM, N_CORNER_PERM, slicePermMove, cornerPermMove, N_PHASE2_TURNS);
+    buildPruning(sliceEdgePrun, N_SLICE_PERM, N_UD_EDGE_PERM, slicePermMove, udEdgePermMove, N_PHASE2_TURNS);
+
+    // 持ち替えた向きでの回転uは、元の向きでturnMap[u]の回転になる
+    for (int v = 0; v < N_SEARCH_AXES; v++) {
+        if (rotationAxes[v] >= 0) rotation[v] = wholeCubeRotation(rotationAxes[v]);
+        rotationInv[v] = rotation[v].inverse();
+        for (int t = 0; t < NUM_FACE_TURNS; t++) {
+            CubieCube a = rotationInv[v];
+            a.multiply(faceTurnCube(t));
+            a.multiply(rotation[v]);
+            for (int u = 0; u < NUM_FACE_TURNS; u++) {
+                if (a == faceTurnCube(u)) turnMap[v][u] = t;
+            }
+        }
+    }
+}
+
+int TwoPhaseTables::phase1Distance(int twist, int flip, int slice) const {
+    int depth = 0;
+    int value = getDepth3(phase1Prun, phase1Index(twist, flip, slice));
+    while (twist != 0 || flip != 0 || slice != 0) {
+        // 正しい表なら手数の余りが1減る回転は必ずあり、最大の手数までに揃う
+        if (depth >= MAX_PHASE1_DISTANCE) return -1;
+        const int target = (value + 2) % 3;
+        int m = 0;
+        for (; m < NUM_FACE_TURNS; m++) {
+            const int t = twistMove[twist * NUM_FACE_TURNS + m];
+            const int f = flipMove[flip * NUM_FACE_TURNS + m];
+            const int s = sliceMove[slice * NUM_FACE_TURNS + m];
+            if (getDepth3(phase1Prun, phase1Index(t, f, s)) == target) {
+                twist = t;
+                flip = f;
+                slice = s;
+                break;
+            }
+        }
+        if (m == NUM_FACE_TURNS) return -1;
+        value = target;
+        depth++;
+    }
+    return depth;
+}
+
+int TwoPhaseTables::phase2Distance(int cornerPerm, int udEdgePerm) const {
+    int depth = 0;
+    int value = getDepth3(phase2Prun, phase2Index(cornerPerm, udEdgePerm));
+    while (cornerPerm != 0 || udEdgePerm != 0) {
+        if (depth >= MAX_PHASE2_DISTANCE) return -1;
+        const int target = (value + 2) % 3;
+        int m = 0;
+        for (; m < N_PHASE2_TURNS; m++) {
+            const int c = cornerPermMove[cornerPerm * N_PHASE2_TURNS + m];
+            const int e = udEdgePermMove[udEdgePerm * N_PHASE2_TURNS + m];
+            if (getDepth3(phase2Prun, phase2Index(c, e)) == target) {
+                cornerPerm = c;
+                udEdgePerm = e;
+                break;
+            }
+        }
+        if (m == N_PHASE2_TURNS) return -1;
+        value = target;
+        depth++;
+    }
+    return depth;
+}
+
+static const TwoPhaseTables &getTables() {
+    static const TwoPhaseTables tables;
+    return tables;
+}
+
+void initTwoPhaseTables() {
+    getTables();
+}
+
+/*
+TwoPhaseSearch
+一回の探索の状態。表は共有し、探索中の手順はここに持つ。
+*/
+struct TwoPhaseSearch {
+    TwoPhaseSearch(const TwoPhaseTables &tables_, int maxLength_)
+        : tables(tables_), maxLength(maxLength_), current(0), length(0), corrupt(false) {
+    }
+
+    bool run(const CubieCube &cube);
+    bool phase1(int twist, int flip, int slice, int distance, int depth, int togo, int lastFace);
+    bool startPhase2(int depth);
+    bool phase2(int corner, int edge, int slicePerm, int distance, int depth, int togo, int lastFace);
+
+    // 見つかった解を元の向きの手順に直す
+    void getSolution(std::vector<int> *solution) const;
+
+    const TwoPhaseTables &tables;
+    int maxLength;
+    CubieCube cubes[N_SEARCHES];
+    int current;
+    int length;
+    int path[64];
+    // 枝刈り表から手数を求められなかった (表が壊れているので、探索をやめて失敗にする)
+    bool corrupt;
+};
+
+bool TwoPhaseSearch::run(const CubieCube &cube) {
+    int twist[N_SEARCHES], flip[N_SEARCHES], slice[N_SEARCHES], h[N_SEARCHES];
+    const CubieCube inv = cube.inverse();
+    for (int k = 0; k < N_SEARCHES; k++) {
+        const int v = k / 2;
+        cubes[k] = tables.rotationInv[v];
+        cubes[k].multiply(k % 2 == 0 ? cube : inv);
+        cubes[k].multiply(tables.rotation[v]);
+
+        twist[k] = cubes[k].twist();
+        flip[k] = cubes[k].flip();
+        slice[k] = cubes[k].slice();
+        h[k] = tables.phase1Distance(twist[k], flip[k], slice[k]);
+        if (h[k] < 0) corrupt = true;
+    }
+    if (corrupt) return false;
+
+    // フェーズ1の手数を増やしながら、残りの手数でフェーズ2が解けるものを探す
+    for (int length1 = 0; length1 <= maxLength; length1++) {
+        for (current = 0; current < N_SEARCHES; current++) {
+            if (h[current] > length1) continue;
+            if (phase1(twist[current], flip[current], slice[current], h[current], 0, length1, -1)) return !corrupt;
+        }
+    }
+    return false;
+}
+
+// distanceはフェーズ1を終えるまでの手数 (枝刈り表の余りから1手ずつ求める)
+bool TwoPhaseSearch::phase1(int twist, int flip, int slice, int distance, int depth, int togo, int lastFace) {
+    if (togo == 0) {
+        if (depth > 0 && isPhase2Turn(path[depth - 1])) return false;
+        return startPhase2(depth);
+    }
+
+    for (int m = 0; m < NUM_FACE_TURNS; m++) {
+        if (isRedundant(m / 3, lastFace)) continue;
+
+        const int t = tables.twistMove[twist * NUM_FACE_TURNS + m];
+        const int f = tables.flipMove[flip * NUM_FACE_TURNS + m];
+        const int s = tables.sliceMove[slice * NUM_FACE_TURNS + m];
+        const int d = nextDepth(distance, getDepth3(tables.phase1Prun, tables.phase1Index(t, f, s)));
+        if (d >= togo) continue;
+
+        path[depth] = m;
+        if (phase1(t, f, s, d, depth + 1, togo - 1, m / 3)) return true;
+    }
+    return false;
+}
+
+bool TwoPhaseSearch::startPhase2(int depth) {
+    // フェーズ1の手順を施して、フェーズ2の座標を求める
+    CubieCube c = cubes[current];
+    for (int i = 0; i < depth; i++) c.multiply(faceTurnCube(path[i]));
+
+    const int corner = c.cornerPerm();
+    const int edge = c.udEdgePerm();
+    const int slicePerm = c.slicePerm();
+    const int distance = tables.phase2Distance(corner, edge);
+    if (distance < 0) {
+        // trueを返して探索を打ち切る (runでcorruptを見て失敗にする)
+        corrupt = true;
+        return true;
+    }
+    const int h = std::max(std::max((int)tables.sliceCornerPrun[slicePerm * N_CORNER_PERM + corner], (int)tables.sliceEdgePrun[slicePerm * N_UD_EDGE_PERM + edge]),
+                           distance);
+    const int lastFace = depth > 0 ? path[depth - 1] / 3 : -1;
+
+    for (int length2 = h; length2 <= MAX_PHASE2_LENGTH && depth + length2 <= maxLength; length2++) {
+        if (phase2(corner, edge, slicePerm, distance, depth, length2, lastFace)) {
+            length = depth + length2;
+            return true;
+        }
+    }
+    return false;
+}
+
+// distanceは角とU, D面の辺の置換を揃えるまでの手数
+bool TwoPhaseSearch::phase2(int corner, int edge, int slicePerm, int distance, int depth, int togo, int lastFace) {
+    if (togo == 0) return corner == 0 && edge == 0 && slicePerm == 0;
+
+    for (int m = 0; m < N_PHASE2_TURNS; m++) {
+        const int turn = phase2Turns[m];
+        if (isRedundant(turn / 3, lastFace)) continue;
+
+        const int c = tables.cornerPermMove[corner * N_PHASE2_TURNS + m];
+        const int e = tables.udEdgePermMove[edge * N_PHASE2_TURNS + m];
+        const int d = nextDepth(distance, getDepth3(tables.phase2Prun, tables.phase2Index(c, e)));
+        if (d >= togo) continue;
+        const int s = tables.slicePermMove[slicePerm * N_PHASE2_TURNS + m];
+        if (tables.sliceCornerPrun[s * N_CORNER_PERM + c] >= togo) continue;
+        if (tables.sliceEdgePrun[s * N_UD_EDGE_PERM + e] >= togo) continue;
+
+        path[depth] = turn;
+        if (phase2(c, e, s, d, depth + 1, togo - 1, turn / 3)) return true;
+    }
+    return false;
+}
+
+void TwoPhaseSearch::getSolution(std::vector<int> *solution) const {
+    const int *map = tables.turnMap[current / 2];
+    solution->resize(length);
+    for (int i = 0; i < length; i++) {
+        // 逆の状態を解いた場合は、逆順にして逆回転にする
+        if (current % 2 == 0) {
+            (*solution)[i] = map[path[i]];
+        } else {
+            (*solution)[length - 1 - i] = inverseTurn(map[path[i]]);
+        }
+    }
+}
+
+bool solveTwoPhase(const CubieCube &cube, int maxLength, std::vector<int> *solution) {
+    if (!cube.isValid()) return false;
+    if (maxLength > 60) maxLength = 60;
+
+    TwoPhaseSearch search(getTables(), maxLength);
+    if (!search.run(cube)) {
+        if (search.corrupt) fprintf(stderr, "Two-phase pruning tables are corrupt\n");
+        return false;
+    }
+
+    search.getSolution(solution);
+    return true;
+}
+
+bool solveTwoPhase(const CubeState &state, int maxLength, std::vector<CubeMove> *moves) {
+    CubieCube cube;
+    if (state.size() != 3 || state.mode() == 1 || !cubieCubeFromState(state, &cube)) return false;
+
+    std::vector<int> turns;
+    if (!solveTwoPhase(cube, maxLength, &turns)) return false;
+
+    moves->clear();
+    for (size_t i = 0; i < turns.size(); i++) {
+        moves->push_back(faceTurnToCubeMove(turns[i], 3));
+    }
+    return true;
+}
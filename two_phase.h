@@ -0,0 +1,34 @@
+#ifndef _TWO_PHASE_H_
+#define _TWO_PHASE_H_
+
+#include <vector>
+
+#include "cube_state.h"
+#include "cubie_cube.h"
+
+/*
+二段階法 (Kociembaのアルゴリズム) による3x3のソルバ
+フェーズ1: 角と辺の向きとUDスライスの辺の位置を揃えて、<U, D, R2, F2, L2, B2> で解ける状態にする
+フェーズ2: <U, D, R2, F2, L2, B2> だけで揃える
+座標ごとの移動表と枝刈り表は最初に使うときに一度だけ作り、スレッド間で共有する (スレッドセーフ)。
+フェーズ1 (flip * slice * twist) とフェーズ2 (角の置換 * U, D面の辺の置換) の枝刈り表は、UD軸を保つ16通りの対称性で
+まとめた表 (合わせて約63MB) を使う。作るのに時間がかかるので、初めて作った時にデータのディレクトリ
+(optimal_solver.hのdefaultDataDirectory) のtwo_phase.prunに書き出し、次からはそれを読む。
+*/
+
+// 手数の上限の既定値 (短くするほど探索に時間がかかる)
+static const int TWO_PHASE_MAX_LENGTH = 22;
+
+// 移動表と枝刈り表を作る (使う前に呼ぶ必要はないが、起動時に作っておくと最初の解が速くなる。ファイルが無い時は数十秒かかる)
+void initTwoPhaseTables();
+
+/*
+maxLength手以内の解 (面の回転の列) を探す
+揃えられない状態や、maxLength手以内の解が見つからない場合はfalseを返す。
+*/
+bool solveTwoPhase(const CubieCube &cube, int maxLength, std::vector<int> *solution);
+
+// N = 3のCubeStateを揃える回転操作の列を探す (色だけを揃えるので、ミラーブロックス (モード1) ではfalseを返す)
+bool solveTwoPhase(const CubeState &state, int maxLength, std::vector<CubeMove> *moves);
+
+#endif  // _TWO_PHASE_H_
@@ -0,0 +1,96 @@
+#include "work_stealing_pool.h"
+
+#include <chrono>
+
+typedef std::chrono::steady_clock Clock;
+
+WorkStealingPool::WorkStealingPool(int threads_)
+    : queued(0)
+    , unfinished(0)
+    , nextWorker(0)
+    , stopping(false) {
+    int n = threads_ > 0 ? threads_ : (int)std::thread::hardware_concurrency();
+    if (n < 1) n = 1;
+
+    for (int i = 0; i < n; i++) workers.push_back(std::unique_ptr<Worker>(new Worker()));
+    for (int i = 0; i < n; i++) threads.push_back(std::thread(&WorkStealingPool::run, this, i));
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeCondition.notify_all();
+    for (size_t i = 0; i < threads.size(); i++) threads[i].join();
+}
+
+void WorkStealingPool::submit(const Task &task) {
+    unfinished++;
+    Worker &w = *workers[nextWorker++ % workers.size()];
+    {
+        std::lock_guard<std::mutex> lock(w.mutex);
+        w.tasks.push_back(task);
+    }
+
+    // 待っているスレッドが数え間違えないように、数はmutexの中で増やす
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queued++;
+    }
+    wakeCondition.notify_one();
+}
+
+void WorkStealingPool::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    idleCondition.wait(lock, [this]() { return unfinished == 0; });
+}
+
+std::vector<WorkStealingPool::ThreadStats> WorkStealingPool::stats() const {
+    std::vector<ThreadStats> s;
+    for (size_t i = 0; i < workers.size(); i++) s.push_back(workers[i]->stats);
+    return s;
+}
+
+bool WorkStealingPool::take(int self, Task *task, bool *stolen) {
+    // 自分のキューから取り、無ければ隣のスレッドから順に盗む
+    const int n = (int)workers.size();
+    for (int k = 0; k < n; k++) {
+        Worker &w = *workers[(self + k) % n];
+        std::lock_guard<std::mutex> lock(w.mutex);
+        if (w.tasks.empty()) continue;
+
+        *task = w.tasks.front();
+        w.tasks.pop_front();
+        *stolen = k > 0;
+        queued--;
+        return true;
+    }
+    return false;
+}
+
+void WorkStealingPool::run(int self) {
+    Worker &me = *workers[self];
+    for (;;) {
+        Task task;
+        bool stolen = false;
+        if (!take(self, &task, &stolen)) {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeCondition.wait(lock, [this]() { return queued > 0 || stopping; });
+            if (stopping && queued == 0) return;
+            continue;
+        }
+
+        const Clock::time_point start = Clock::now();
+        task();
+        me.stats.busySeconds += std::chrono::duration<double>(Clock::now() - start).count();
+        me.stats.tasks++;
+        if (stolen) me.stats.steals++;
+
+        if (--unfinished == 0) {
+            std::lock_guard<std::mutex> lock(mutex);
+            idleCondition.notify_all();
+        }
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef _WORK_STEALING_POOL_H_
+#define _WORK_STEALING_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+WorkStealingPool
+スレッドごとに仕事のキュー (両端キュー) を持つスレッドプール。
+submitした仕事は順番に各スレッドのキューへ配り、各スレッドは自分のキューの先頭から取り出す。
+自分のキューが空になったら、他のスレッドのキューの先頭 (一番古い仕事) を盗む。
+一つ一つの仕事の重さが大きく違っても、空いたスレッドが残りを引き取るので負荷が偏らない。
+*/
+class WorkStealingPool {
+public:
+    typedef std::function<void()> Task;
+
+    // スレッドごとの集計
+    struct ThreadStats {
+        ThreadStats()
+            : tasks(0)
+            , steals(0)
+            , busySeconds(0.0) {
+        }
+
+        uint64_t tasks;      // 実行した仕事の数
+        uint64_t steals;     // そのうち他のスレッドから盗んだ数
+        double busySeconds;  // 仕事を実行していた時間
+    };
+
+    // threadsが0ならハードウェアのスレッド数
+    explicit WorkStealingPool(int threads = 0);
+
+    // 残っている仕事を全て終えてからスレッドを止める
+    ~WorkStealingPool();
+
+    int size() const { return (int)threads.size(); }
+
+    void submit(const Task &task);
+
+    // submitした仕事が全て終わるまで待つ
+    void wait();
+
+    // wait()の後に呼ぶ
+    std::vector<ThreadStats> stats() const;
+
+private:
+    WorkStealingPool(const WorkStealingPool &) = delete;
+    WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        ThreadStats stats;
+    };
+
+    bool take(int self, Task *task, bool *stolen);
+    void run(int self);
+
+    std::vector<std::unique_ptr<Worker> > workers;
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    std::condition_variable wakeCondition;  // キューに仕事が入った
+    std::condition_variable idleCondition;  // 全ての仕事が終わった
+    std::atomic<int> queued;                // キューに入っている仕事の数
+    std::atomic<int> unfinished;            // submitしてまだ終わっていない仕事の数
+    unsigned int nextWorker;
+    bool stopping;
+};
+
+#endif  // _WORK_STEALING_POOL_H_